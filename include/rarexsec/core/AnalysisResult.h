@@ -1,7 +1,6 @@
 #ifndef ANALYSIS_RESULT_H
 #define ANALYSIS_RESULT_H
 
-#include "TFile.h"
 #include "TObject.h"
 
 #include <rarexsec/core/VariableResult.h>
@@ -12,6 +11,8 @@
 #include <map>
 #include <memory>
 #include <string>
+#include <utility>
+#include <vector>
 
 namespace analysis {
 
@@ -54,6 +55,25 @@ class AnalysisResult : public TObject {
         }
     }
 
+    // Combines the partial results of a sharded run. Regions and variables
+    // are matched by key; covariances have to be computed on the merged
+    // result.
+    static AnalysisResult merge(std::vector<AnalysisResult> parts) {
+        AnalysisResult merged;
+        for (auto &part : parts) {
+            for (auto &[key, region] : part.regions_) {
+                auto it = merged.regions_.find(key);
+                if (it == merged.regions_.end())
+                    merged.regions_.emplace(key, std::move(region));
+                else
+                    it->second.merge(region);
+            }
+            part.variable_results_.clear();
+        }
+        merged.build();
+        return merged;
+    }
+
     std::map<std::string, AnalysisResult> resultsByBeam() const {
         std::map<std::string, AnalysisResult> m;
 
@@ -66,18 +86,6 @@ class AnalysisResult : public TObject {
         return m;
     }
 
-    void saveToFile(const std::string &path) const {
-        TFile outfile(path.c_str(), "RECREATE");
-        outfile.WriteObject(this, "analysis_result");
-        outfile.Close();
-    }
-
-    static std::unique_ptr<AnalysisResult> loadFromFile(const std::string &path) {
-        TFile infile(path.c_str(), "READ");
-        auto *ptr = infile.Get<AnalysisResult>("analysis_result");
-        return ptr ? std::unique_ptr<AnalysisResult>(static_cast<AnalysisResult *>(ptr->Clone())) : nullptr;
-    }
-
     static void printSummary(const VariableResult &r) {
         auto name = r.binning_.getVariable();
         auto bins = r.binning_.getBinNumber();
@@ -107,7 +115,7 @@ class AnalysisResult : public TObject {
             std::cout << sub << '\n';
             std::cout << std::left << std::setw(width) << "Available Systematics" << '\n';
             for (const auto &[k, c] : r.covariance_matrices_)
-                if (c.GetNrows() > 0)
+                if (!c.empty())
                     std::cout << k.str() << '\n';
         }
 
@@ -0,0 +1,474 @@
+#ifndef ANALYSIS_RESULT_IO_H
+#define ANALYSIS_RESULT_IO_H
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <Eigen/Dense>
+
+#include <rarexsec/core/AnalysisResult.h>
+#include <rarexsec/core/RegionAnalysis.h>
+#include <rarexsec/core/VariableResult.h>
+#include <rarexsec/hist/CovarianceMatrix.h>
+#include <rarexsec/utils/Logger.h>
+
+namespace analysis {
+
+// Binary form of an AnalysisResult: written by PipelineRunner::run, read
+// back for plot-only reruns and to merge the partial results of sharded
+// runs. Values are stored in native byte order; every histogram of a
+// variable shares the variable's binning, which is written once. Files are
+// memory-mapped and decoded in one sequential pass.
+//
+// Bump kFormatVersion whenever the layout changes; older files are rejected
+// rather than misread.
+class AnalysisResultIO {
+  public:
+    static constexpr char kMagic[4] = {'R', 'X', 'S', 'R'};
+    static constexpr char kVariableMagic[4] = {'R', 'X', 'S', 'V'};
+    static constexpr std::uint32_t kFormatVersion = 4;
+    static constexpr const char *kExtension = ".rxsr";
+
+    // Where the result for an output name such as "out.root" is kept: the
+    // same name with kExtension, so no ".root" path ever holds this format.
+    static std::string resultPath(const std::string &output_path) {
+        return std::filesystem::path(output_path).replace_extension(kExtension).string();
+    }
+
+    static void write(const AnalysisResult &result, const std::string &path) {
+        Writer w;
+        writeHeader(w, kMagic);
+        w.u64(result.regions().size());
+        for (const auto &[key, region] : result.regions())
+            writeRegion(w, region);
+        writeFile(w, path);
+    }
+
+    static AnalysisResult read(const std::string &path) {
+        const MappedFile file(path);
+        Reader r{file.begin(), file.end(), path};
+        readHeader(r, kMagic);
+
+        RegionAnalysisMap regions;
+        for (auto n = r.u64(); n > 0; --n) {
+            auto region = readRegion(r);
+            auto key = region.regionKey();
+            regions.insert_or_assign(std::move(key), std::move(region));
+        }
+        return AnalysisResult(std::move(regions));
+    }
+
+    // A single variable result in the same encoding, as kept by ResultCache.
+    static void writeVariable(const VariableResult &result, const std::string &path) {
+        Writer w;
+        writeHeader(w, kVariableMagic);
+        writeVariable(w, result);
+        writeFile(w, path);
+    }
+
+    static VariableResult readVariable(const std::string &path) {
+        const MappedFile file(path);
+        Reader r{file.begin(), file.end(), path};
+        readHeader(r, kVariableMagic);
+        return readVariable(r);
+    }
+
+  private:
+    class MappedFile {
+      public:
+        explicit MappedFile(const std::string &path) {
+            fd_ = ::open(path.c_str(), O_RDONLY);
+            struct stat st {};
+            if (fd_ < 0 || ::fstat(fd_, &st) != 0)
+                log::fatal("AnalysisResultIO::read", "Cannot open", path);
+            size_ = static_cast<std::size_t>(st.st_size);
+            if (size_ == 0)
+                return;
+            void *data = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+            if (data == MAP_FAILED)
+                log::fatal("AnalysisResultIO::read", "Cannot map", path);
+            ::madvise(data, size_, MADV_SEQUENTIAL);
+            data_ = static_cast<const char *>(data);
+        }
+        ~MappedFile() {
+            if (data_)
+                ::munmap(const_cast<char *>(data_), size_);
+            if (fd_ >= 0)
+                ::close(fd_);
+        }
+        MappedFile(const MappedFile &) = delete;
+        MappedFile &operator=(const MappedFile &) = delete;
+
+        const char *begin() const noexcept { return data_; }
+        const char *end() const noexcept { return data_ + size_; }
+
+      private:
+        int fd_{-1};
+        const char *data_{nullptr};
+        std::size_t size_{0};
+    };
+
+    struct Writer {
+        std::vector<char> buffer;
+
+        void raw(const void *data, std::size_t size) {
+            const auto *bytes = static_cast<const char *>(data);
+            buffer.insert(buffer.end(), bytes, bytes + size);
+        }
+        template <typename T> void pod(T value) {
+            static_assert(std::is_trivially_copyable_v<T>);
+            raw(&value, sizeof(T));
+        }
+        void u32(std::uint32_t v) { pod(v); }
+        void u64(std::uint64_t v) { pod(v); }
+        void f64(double v) { pod(v); }
+        void str(const std::string &s) {
+            u64(s.size());
+            raw(s.data(), s.size());
+        }
+        void doubles(const double *data, std::size_t n) { raw(data, n * sizeof(double)); }
+    };
+
+    struct Reader {
+        const char *pos;
+        const char *end;
+        const std::string &path;
+
+        void raw(void *out, std::size_t size) {
+            if (static_cast<std::size_t>(end - pos) < size)
+                log::fatal("AnalysisResultIO::read", path, "is truncated");
+            std::memcpy(out, pos, size);
+            pos += size;
+        }
+        template <typename T> T pod() {
+            T value;
+            raw(&value, sizeof(T));
+            return value;
+        }
+        std::uint32_t u32() { return pod<std::uint32_t>(); }
+        std::uint64_t u64() { return pod<std::uint64_t>(); }
+        double f64() { return pod<double>(); }
+        std::string str() {
+            const auto n = u64();
+            if (static_cast<std::uint64_t>(end - pos) < n)
+                log::fatal("AnalysisResultIO::read", path, "is truncated");
+            std::string s(pos, n);
+            pos += n;
+            return s;
+        }
+        void doubles(double *out, std::size_t n) { raw(out, n * sizeof(double)); }
+    };
+
+    static void writeHeader(Writer &w, const char (&magic)[4]) {
+        w.raw(magic, sizeof(magic));
+        w.u32(kFormatVersion);
+    }
+
+    static void readHeader(Reader &r, const char (&magic)[4]) {
+        char found[sizeof(magic)];
+        r.raw(found, sizeof(found));
+        if (std::memcmp(found, magic, sizeof(magic)) != 0)
+            log::fatal("AnalysisResultIO::read", r.path, "is not an analysis result");
+        const auto version = r.u32();
+        if (version != kFormatVersion)
+            log::fatal("AnalysisResultIO::read", r.path, "has format version", version, "; expected", kFormatVersion);
+    }
+
+    // Written to a temporary file that is renamed on success, so an
+    // interrupted run or a concurrent shard never leaves a truncated file
+    // under the final name.
+    static void writeFile(const Writer &w, const std::string &path) {
+        const auto tmp_path = path + ".tmp" + std::to_string(::getpid());
+        {
+            std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+            out.write(w.buffer.data(), static_cast<std::streamsize>(w.buffer.size()));
+            out.close();
+            if (!out) {
+                std::error_code ec;
+                std::filesystem::remove(tmp_path, ec);
+                log::fatal("AnalysisResultIO::write", "Cannot write", path);
+            }
+        }
+        std::error_code ec;
+        std::filesystem::rename(tmp_path, path, ec);
+        if (ec) {
+            const auto reason = ec.message();
+            std::filesystem::remove(tmp_path, ec);
+            log::fatal("AnalysisResultIO::write", "Cannot finalise", path, "(", reason, ")");
+        }
+    }
+
+    static void writeRegion(Writer &w, const RegionAnalysis &region) {
+        w.str(region.regionKey().str());
+        w.str(region.regionLabel());
+        w.f64(region.protonsOnTarget());
+        w.u32(region.isBlinded() ? 1 : 0);
+        w.str(region.beamConfig());
+        w.u64(region.runNumbers().size());
+        for (const auto &run : region.runNumbers())
+            w.str(run);
+
+        w.u64(region.cutFlow().size());
+        for (const auto &stage : region.cutFlow()) {
+            w.f64(stage.total);
+            w.f64(stage.total_w2);
+            w.u64(stage.schemes.size());
+            for (const auto &[scheme, strata] : stage.schemes) {
+                w.str(scheme);
+                w.u64(strata.size());
+                for (const auto &[stratum, sums] : strata) {
+                    w.pod<std::int32_t>(stratum);
+                    w.f64(sums.first);
+                    w.f64(sums.second);
+                }
+            }
+        }
+
+        w.u64(region.finalVariables().size());
+        for (const auto &[key, result] : region.finalVariables()) {
+            w.str(key.str());
+            writeVariable(w, result);
+        }
+    }
+
+    static RegionAnalysis readRegion(Reader &r) {
+        RegionKey key{r.str()};
+        auto label = r.str();
+        const double pot = r.f64();
+        const bool blinded = r.u32() != 0;
+        auto beam = r.str();
+        std::vector<std::string> runs(r.u64());
+        for (auto &run : runs)
+            run = r.str();
+        RegionAnalysis region(std::move(key), std::move(label), pot, blinded, std::move(beam), std::move(runs));
+
+        std::vector<RegionAnalysis::StageCount> cut_flow(r.u64());
+        for (auto &stage : cut_flow) {
+            stage.total = r.f64();
+            stage.total_w2 = r.f64();
+            for (auto n = r.u64(); n > 0; --n) {
+                auto &strata = stage.schemes[r.str()];
+                for (auto m = r.u64(); m > 0; --m) {
+                    const int stratum = r.pod<std::int32_t>();
+                    const double sum = r.f64();
+                    strata[stratum] = {sum, r.f64()};
+                }
+            }
+        }
+        region.setCutFlow(std::move(cut_flow));
+
+        for (auto n = r.u64(); n > 0; --n) {
+            VariableKey key{r.str()};
+            region.addFinalVariable(std::move(key), readVariable(r));
+        }
+        return region;
+    }
+
+    static void writeVariable(Writer &w, const VariableResult &v) {
+        const auto &b = v.binning_;
+        w.u64(b.getEdges().size());
+        w.doubles(b.getEdges().data(), b.getEdges().size());
+        w.str(b.getVariable());
+        w.str(b.getTexLabel());
+        w.u64(b.getSelectionKeys().size());
+        for (const auto &k : b.getSelectionKeys())
+            w.str(k.str());
+        w.str(b.getStratifierKey().str());
+
+        writeHist(w, v.data_hist_);
+        writeHist(w, v.total_mc_hist_);
+        writeHistMap(w, v.strat_hists_);
+        w.u64(v.raw_detvar_hists_.size());
+        for (const auto &[sample_key, variations] : v.raw_detvar_hists_) {
+            w.str(sample_key.str());
+            w.u64(variations.size());
+            for (const auto &[variation, hist] : variations) {
+                w.pod<std::int32_t>(static_cast<std::int32_t>(variation));
+                writeHist(w, hist);
+            }
+        }
+        writeHistMap(w, v.variation_hists_);
+        writeHistMap(w, v.transfer_ratio_hists_);
+        writeHistMap(w, v.delta_hists_);
+        w.u64(v.covariance_matrices_.size());
+        for (const auto &[key, cov] : v.covariance_matrices_) {
+            w.str(key.str());
+            writeSym(w, cov);
+        }
+        writeSym(w, v.total_covariance_);
+        writeSym(w, v.total_correlation_);
+        writeHist(w, v.nominal_with_band_);
+        w.u64(v.universe_projected_hists_.size());
+        for (const auto &[key, hists] : v.universe_projected_hists_) {
+            w.str(key.str());
+            w.u64(hists.size());
+            for (const auto &hist : hists)
+                writeCounts(w, hist);
+        }
+        w.u64(v.universe_counts_.size());
+        for (const auto &[key, counts] : v.universe_counts_) {
+            w.str(key.str());
+            writeMatrix(w, counts);
+        }
+    }
+
+    static VariableResult readVariable(Reader &r) {
+        VariableResult v;
+        std::vector<double> edges(r.u64());
+        r.doubles(edges.data(), edges.size());
+        auto branch = r.str();
+        auto tex = r.str();
+        std::vector<SelectionKey> selection_keys;
+        for (auto n = r.u64(); n > 0; --n)
+            selection_keys.emplace_back(r.str());
+        auto strat_key = r.str();
+        v.binning_ = BinningDefinition(std::move(edges), branch, tex, std::move(selection_keys), strat_key);
+
+        const auto &b = v.binning_;
+        v.data_hist_ = readHist(r, b);
+        v.total_mc_hist_ = readHist(r, b);
+        readHistMap(r, b, v.strat_hists_);
+        for (auto n = r.u64(); n > 0; --n) {
+            auto &variations = v.raw_detvar_hists_[SampleKey{r.str()}];
+            for (auto m = r.u64(); m > 0; --m) {
+                const auto variation = static_cast<SampleVariation>(r.pod<std::int32_t>());
+                variations.insert_or_assign(variation, readHist(r, b));
+            }
+        }
+        readHistMap(r, b, v.variation_hists_);
+        readHistMap(r, b, v.transfer_ratio_hists_);
+        readHistMap(r, b, v.delta_hists_);
+        for (auto n = r.u64(); n > 0; --n) {
+            SystematicKey key{r.str()};
+            v.covariance_matrices_.insert_or_assign(std::move(key), readSym(r));
+        }
+        v.total_covariance_ = readSym(r);
+        v.total_correlation_ = readSym(r);
+        v.nominal_with_band_ = readHist(r, b);
+        for (auto n = r.u64(); n > 0; --n) {
+            auto &hists = v.universe_projected_hists_[SystematicKey{r.str()}];
+            hists.resize(r.u64());
+            for (auto &hist : hists)
+                hist = readCounts(r, b);
+        }
+        for (auto n = r.u64(); n > 0; --n) {
+            SystematicKey key{r.str()};
+            v.universe_counts_.insert_or_assign(std::move(key), readMatrix(r));
+        }
+        return v;
+    }
+
+    // An empty histogram is written as zero bins.
+    static void writeHist(Writer &w, const BinnedHistogram &h) {
+        const auto &u = h.hist;
+        const std::size_t n = u.counts.size();
+        w.u64(n);
+        if (n == 0)
+            return;
+        w.doubles(u.counts.data(), n);
+        writeMatrix(w, u.shifts);
+        writeMatrix(w, u.variance);
+        w.str(h.GetName());
+        w.str(h.GetTitle());
+    }
+
+    static BinnedHistogram readHist(Reader &r, const BinningDefinition &b) {
+        const auto n = r.u64();
+        if (n == 0)
+            return BinnedHistogram();
+        if (n != b.getBinNumber())
+            log::fatal("AnalysisResultIO::read", r.path, "has a histogram of", n, "bins for", b.getVariable());
+        std::vector<double> counts(n);
+        r.doubles(counts.data(), n);
+        const Eigen::MatrixXd shifts = readMatrix(r);
+        const Eigen::MatrixXd variance = readMatrix(r);
+        auto name = r.str();
+        auto title = r.str();
+        BinnedHistogram h(b, counts, shifts, name.c_str(), title.c_str());
+        if (variance.size() != 0)
+            h.hist.variance = variance.col(0);
+        return h;
+    }
+
+    static void writeCounts(Writer &w, const HistogramCounts &h) {
+        const auto n = static_cast<std::size_t>(h.size());
+        w.u64(n);
+        if (n == 0)
+            return;
+        w.doubles(h.sumw().data(), n);
+        w.doubles(h.sumw2().data(), n);
+    }
+
+    static HistogramCounts readCounts(Reader &r, const BinningDefinition &b) {
+        const auto n = r.u64();
+        if (n == 0)
+            return HistogramCounts();
+        if (n != b.getBinNumber())
+            log::fatal("AnalysisResultIO::read", r.path, "has a histogram of", n, "bins for", b.getVariable());
+        Eigen::VectorXd sumw(n), sumw2(n);
+        r.doubles(sumw.data(), n);
+        r.doubles(sumw2.data(), n);
+        return HistogramCounts::fromSums(b.getEdges(), sumw, sumw2);
+    }
+
+    template <typename Key> static void writeHistMap(Writer &w, const std::map<Key, BinnedHistogram> &hists) {
+        w.u64(hists.size());
+        for (const auto &[key, hist] : hists) {
+            w.str(key.str());
+            writeHist(w, hist);
+        }
+    }
+
+    template <typename Key>
+    static void readHistMap(Reader &r, const BinningDefinition &b, std::map<Key, BinnedHistogram> &hists) {
+        for (auto n = r.u64(); n > 0; --n) {
+            Key key{r.str()};
+            hists.insert_or_assign(std::move(key), readHist(r, b));
+        }
+    }
+
+    // Column-major, as Eigen stores it.
+    static void writeMatrix(Writer &w, const Eigen::MatrixXd &m) {
+        w.u64(static_cast<std::uint64_t>(m.rows()));
+        w.u64(static_cast<std::uint64_t>(m.cols()));
+        w.doubles(m.data(), static_cast<std::size_t>(m.size()));
+    }
+
+    static Eigen::MatrixXd readMatrix(Reader &r) {
+        const auto rows = r.u64();
+        const auto cols = r.u64();
+        Eigen::MatrixXd m(static_cast<Eigen::Index>(rows), static_cast<Eigen::Index>(cols));
+        r.doubles(m.data(), static_cast<std::size_t>(m.size()));
+        return m;
+    }
+
+    // Packed lower triangle.
+    static void writeSym(Writer &w, const CovarianceMatrix &m) {
+        w.u64(static_cast<std::uint64_t>(m.size()));
+        w.doubles(m.packed().data(), static_cast<std::size_t>(m.packed().size()));
+    }
+
+    static CovarianceMatrix readSym(Reader &r) {
+        const int n = static_cast<int>(r.u64());
+        Eigen::VectorXd packed(CovarianceMatrix::packedSize(n));
+        r.doubles(packed.data(), static_cast<std::size_t>(packed.size()));
+        return CovarianceMatrix::fromPacked(n, std::move(packed));
+    }
+};
+
+}
+
+#endif
@@ -1,5 +1,6 @@
 #pragma once
 #include <algorithm>
+#include <deque>
 #include <map>
 #include <memory>
 #include <numeric>
@@ -15,12 +16,17 @@
 #include <rarexsec/hist/HistogramFactory.h>
 #include <rarexsec/utils/Logger.h>
 #include <rarexsec/core/RegionAnalysis.h>
+#include <rarexsec/core/ResultCache.h>
 #include <rarexsec/data/SampleDataset.h>
 #include <rarexsec/core/SelectionRegistry.h>
 #include <rarexsec/syst/SystematicsProcessor.h>
 #include <rarexsec/core/VariableResult.h>
+#include <rarexsec/data/ExpressionCompiler.h>
 
+#include <rarexsec/core/ColumnDependencyAnalyzer.h>
+#include <rarexsec/core/CutFlowCalculator.h>
 #include <rarexsec/core/SampleProcessorFactory.h>
+#include <rarexsec/core/SelectionCompiler.h>
 #include <rarexsec/core/VariableProcessor.h>
 
 #include <rarexsec/plug/PluginAliases.h>
@@ -51,6 +57,9 @@ public:
 
     for (const auto &s : analysis_specs) {
       a_host_.add(s.id, s.args);
+      if (s.id == "CutFlowPlugin") {
+        book_cut_flows_ = true;
+      }
     }
   }
 
@@ -65,9 +74,183 @@ public:
     // Configure systematics plugins
     s_host_.forEach([&](ISystematicsPlugin& sp){ sp.configure(systematics_processor_); });
 
+    this->selectSamples();
+    this->resolveColumns();
+    if (dry_run_) {
+      log::info("AnalysisRunner::run", "Dry run requested; skipping event loops.");
+      return AnalysisResult{};
+    }
+
     analysis_definition_.resolveDynamicBinning(data_loader_);
+    this->attachResultCache();
+
+    selection_compiler_ = SelectionCompiler(analysis_definition_);
+    selection_compiler_.defineMask(data_loader_.getSampleFrames());
+    this->reportUndeclaredColumns();
     RegionAnalysisMap analysis_regions;
 
+    if (batch_regions_) {
+      runBatched(analysis_regions);
+    } else {
+      runSequential(analysis_regions);
+    }
+    data_loader_.genieModeStats().report();
+    ExpressionCompiler::instance().report();
+
+    AnalysisResult result(std::move(analysis_regions));
+
+    // Finalisation callback
+    a_host_.forEach([&](IAnalysisPlugin& pl){ pl.onFinalisation(result); });
+
+    // Optional: plot host hook if you wire plot specs elsewhere
+    // p_host_.forEach([&](IPlotPlugin& pp){ pp.onPlot(result); });
+
+    return result;
+  }
+
+  void setBatchRegions(bool batch) { batch_regions_ = batch; }
+
+  bool batchRegions() const { return batch_regions_; }
+
+  // Tally region cut flows in the batched event loop instead of a separate
+  // pass from CutFlowPlugin.
+  void setBookCutFlows(bool book) { book_cut_flows_ = book; }
+
+  // Resolve and report the input branches without running any event loop.
+  void setDryRun(bool dry_run) { dry_run_ = dry_run; }
+
+  // Reuse per-sample variable results of earlier runs whose inputs are
+  // unchanged; only the remaining samples are booked.
+  void setResultCache(ResultCacheConfig config) {
+    result_cache_ = ResultCache(std::move(config));
+  }
+
+  const ColumnRequirements &columnRequirements() const {
+    return column_requirements_;
+  }
+
+private:
+  // Only samples some region is eligible for get their frames built.
+  void selectSamples() {
+    const auto &regions = analysis_definition_.regions();
+    data_loader_.selectSamples(
+        [&regions](const SampleKey &key, const RunConfig *run_config) {
+          for (const auto &region_handle : regions) {
+            if (!region_handle.analysis())
+              return true;
+            const auto &region = *region_handle.analysis();
+            if (SampleProcessorFactory<AnalysisDataLoader>::isSampleEligible(
+                    key, run_config, region.beamConfig(),
+                    region.runNumbers()))
+              return true;
+          }
+          return false;
+        });
+  }
+
+  void attachResultCache() {
+    if (!result_cache_.enabled())
+      return;
+    std::unordered_map<SampleKey, std::string> signatures;
+    for (const auto &[key, sample_def] : data_loader_.getSampleFrames())
+      signatures.emplace(key, sample_def.signature_);
+    log::info("AnalysisRunner::attachResultCache", "Reusing cached results from",
+              result_cache_.config().directory_);
+    variable_processor_.setResultCache(&result_cache_, std::move(signatures));
+  }
+
+  void resolveColumns() {
+    ColumnDependencyAnalyzer analyzer(analysis_definition_,
+                                      systematics_processor_);
+    for (const auto &expression : data_loader_.loadingExpressions())
+      analyzer.addExpression(expression);
+    if (book_cut_flows_)
+      analyzer.addColumns(
+          CutFlowCalculator<AnalysisDataLoader>::stratifierSchemes());
+
+    column_graph_ = ColumnDependencyGraph();
+    data_loader_.declareColumns(column_graph_);
+    const auto available = data_loader_.inputBranches();
+    column_requirements_ = analyzer.analyse(column_graph_, available);
+    ColumnDependencyAnalyzer::report(column_requirements_, available,
+                                     dry_run_);
+    ColumnDependencyAnalyzer::reportGraph(column_graph_, column_requirements_,
+                                          dry_run_);
+    data_loader_.restrictColumns(column_requirements_);
+  }
+
+  // Checked once the frames exist, as building them only for this check
+  // would run the sample-cache snapshots early.
+  void reportUndeclaredColumns() {
+    for (const auto &column : data_loader_.undeclaredColumns(column_graph_))
+      log::warn("AnalysisRunner::reportUndeclaredColumns",
+                "Column defined but not declared by its processor:", column);
+  }
+
+  struct PendingRegion {
+    RegionKey key_;
+    RegionAnalysis analysis_;
+    VariableProcessor<SystematicsProcessor>::RegionBooking booking_;
+    CutFlowCalculator<AnalysisDataLoader>::PendingCutFlow cut_flow_;
+  };
+
+  // Regions are filtered branches of the same per-sample graphs, so booking
+  // every region before running lets the inputs be read once per beamline.
+  void runBatched(RegionAnalysisMap &analysis_regions) {
+    const auto &regions = analysis_definition_.regions();
+    const std::size_t region_count = regions.size();
+    std::deque<PendingRegion> pending;
+    CutFlowCalculator<AnalysisDataLoader> cut_flow_calculator(
+        data_loader_, analysis_definition_);
+    cut_flow_calculator.setSelectionCompiler(&selection_compiler_);
+
+    std::size_t region_index = 0;
+    for (const auto &region_handle : regions) {
+      ++region_index;
+      log::info("AnalysisRunner::runBatched",
+                "Booking region (", region_index, "/", region_count, "):",
+                region_handle.key_.str());
+
+      RegionAnalysis region_analysis = std::move(*region_handle.analysis());
+
+      auto [sample_processors, monte_carlo_nodes] =
+          sample_processor_factory_.create(region_handle, region_analysis,
+                                           &selection_compiler_);
+
+      auto booking = variable_processor_.book(region_handle, sample_processors,
+                                              monte_carlo_nodes);
+      pending.push_back(PendingRegion{region_handle.key_,
+                                      std::move(region_analysis),
+                                      std::move(booking), {}});
+      if (book_cut_flows_) {
+        pending.back().cut_flow_ = cut_flow_calculator.book(region_handle);
+      }
+    }
+
+    std::vector<ROOT::RDF::RResultHandle> handles;
+    for (auto &region : pending) {
+      VariableProcessor<SystematicsProcessor>::collectHandles(region.booking_,
+                                                              handles);
+      CutFlowCalculator<AnalysisDataLoader>::collectHandles(region.cut_flow_,
+                                                            handles);
+    }
+    log::info("AnalysisRunner::runBatched", "Running one event loop for",
+              region_count, "regions (", handles.size(), "handles)");
+    if (!handles.empty())
+      ROOT::RDF::RunGraphs(handles);
+
+    for (std::size_t i = 0; i < pending.size(); ++i) {
+      auto &region = pending[i];
+      variable_processor_.finalise(region.booking_, region.analysis_);
+      if (book_cut_flows_) {
+        cut_flow_calculator.finalise(regions[i], region.cut_flow_,
+                                     region.analysis_);
+      }
+      analysis_regions[region.key_] = std::move(region.analysis_);
+    }
+  }
+
+  void runSequential(RegionAnalysisMap &analysis_regions) {
     const auto &regions = analysis_definition_.regions();
     size_t region_count = regions.size();
     size_t region_index = 0;
@@ -80,7 +263,8 @@ public:
       RegionAnalysis region_analysis = std::move(*region_handle.analysis());
 
       auto [sample_processors, monte_carlo_nodes] =
-          sample_processor_factory_.create(region_handle, region_analysis);
+          sample_processor_factory_.create(region_handle, region_analysis,
+                                           &selection_compiler_);
 
       variable_processor_.process(region_handle, region_analysis,
                                   sample_processors, monte_carlo_nodes);
@@ -91,19 +275,8 @@ public:
                 "Region protocol complete (", region_index, "/", region_count, "):",
                 region_handle.key_.str());
     }
-
-    AnalysisResult result(std::move(analysis_regions));
-
-    // Finalisation callback
-    a_host_.forEach([&](IAnalysisPlugin& pl){ pl.onFinalisation(result); });
-
-    // Optional: plot host hook if you wire plot specs elsewhere
-    // p_host_.forEach([&](IPlotPlugin& pp){ pp.onPlot(result); });
-
-    return result;
   }
 
-private:
   SystematicsPluginHost s_host_;
   AnalysisPluginHost a_host_;
   PlotPluginHost     p_host_; // present for future use
@@ -114,9 +287,16 @@ private:
   AnalysisDefinition analysis_definition_;
   SystematicsProcessor &systematics_processor_;
 
+  SelectionCompiler selection_compiler_;
   SampleProcessorFactory<AnalysisDataLoader> sample_processor_factory_;
   std::unique_ptr<HistogramFactory> histogram_factory_;
   VariableProcessor<SystematicsProcessor> variable_processor_;
+  ColumnRequirements column_requirements_;
+  ColumnDependencyGraph column_graph_;
+  ResultCache result_cache_;
+  bool batch_regions_{true};
+  bool book_cut_flows_{false};
+  bool dry_run_{false};
 };
 
 } // namespace analysis
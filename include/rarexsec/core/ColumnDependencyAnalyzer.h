@@ -0,0 +1,131 @@
+#ifndef COLUMN_DEPENDENCY_ANALYZER_H
+#define COLUMN_DEPENDENCY_ANALYZER_H
+
+#include <cstdlib>
+#include <cxxabi.h>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <rarexsec/core/AnalysisDefinition.h>
+#include <rarexsec/data/ColumnDependencies.h>
+#include <rarexsec/data/VariableRegistry.h>
+#include <rarexsec/syst/SystematicsProcessor.h>
+#include <rarexsec/utils/Logger.h>
+
+namespace analysis {
+
+// Walks the configured regions, variables, stratifiers and systematics and
+// resolves them through the processor column graph into the input branches
+// the analysis reads.
+class ColumnDependencyAnalyzer {
+  public:
+    ColumnDependencyAnalyzer(const AnalysisDefinition &def, const SystematicsProcessor &sys_proc) {
+        seeds_.insert("nominal_event_weight");
+
+        for (const auto &region_handle : def.regions()) {
+            for (const auto &clause : def.regionClauses(region_handle.key_))
+                this->addExpression(clause);
+            this->addExpression(region_handle.selection().str());
+        }
+
+        for (const auto &variable_handle : def.variables()) {
+            this->addExpression(variable_handle.expression());
+            const auto &strat_key = variable_handle.binning().getStratifierKey();
+            if (!strat_key.str().empty())
+                seeds_.insert(strat_key.str());
+            if (!variable_handle.stratifier().empty())
+                seeds_.insert(variable_handle.stratifier());
+        }
+
+        if (sys_proc.hasStrategies()) {
+            for (const auto &knob : sys_proc.knobDefinitions()) {
+                seeds_.insert(knob.up_column_);
+                seeds_.insert(knob.dn_column_);
+            }
+            for (const auto &universe : sys_proc.universeDefinitions())
+                seeds_.insert(universe.vector_name_);
+        }
+    }
+
+    void addColumns(const std::vector<std::string> &columns) { seeds_.insert(columns.begin(), columns.end()); }
+
+    void addExpression(const std::string &expression) {
+        for (auto &column : ColumnDependencyGraph::identifiers(expression))
+            seeds_.insert(std::move(column));
+    }
+
+    const std::set<std::string> &seeds() const { return seeds_; }
+
+    ColumnRequirements analyse(const ColumnDependencyGraph &graph, const std::set<std::string> &available) const {
+        return graph.resolve(seeds_, available);
+    }
+
+    // Summarises the requirements; the full branch lists are printed at info
+    // level for a dry run and at debug level otherwise.
+    static void report(const ColumnRequirements &req, const std::set<std::string> &available, bool dry_run) {
+        log::info("ColumnDependencyAnalyzer::report", "Analysis reads", req.inputs.size(), "of", available.size(),
+                  "input branches through", req.derived.size(), "derived columns");
+
+        std::vector<std::string> skipped_images;
+        for (const auto &column : VariableRegistry::heavyImageVariables()) {
+            if (available.count(column) && !req.inputs.count(column))
+                skipped_images.push_back(column);
+        }
+        if (!skipped_images.empty())
+            log::info("ColumnDependencyAnalyzer::report", "Image branches not needed:", skipped_images.size());
+
+        for (const auto &column : req.unknown)
+            log::warn("ColumnDependencyAnalyzer::report", "Referenced column not found in inputs:", column);
+
+        for (const auto &column : req.inputs) {
+            if (dry_run)
+                log::info("ColumnDependencyAnalyzer::report", "  input  ", column);
+            else
+                log::debug("ColumnDependencyAnalyzer::report", "  input  ", column);
+        }
+        for (const auto &column : req.derived) {
+            if (dry_run)
+                log::info("ColumnDependencyAnalyzer::report", "  derived", column);
+            else
+                log::debug("ColumnDependencyAnalyzer::report", "  derived", column);
+        }
+    }
+
+    // Lists the derived columns several processors declare, which the chain
+    // defines once, and those no part of the analysis consumes.
+    static void reportGraph(const ColumnDependencyGraph &graph, const ColumnRequirements &req, bool dry_run) {
+        const auto shared = graph.shared();
+        const auto unused = graph.unused(req);
+        log::info("ColumnDependencyAnalyzer::reportGraph", graph.definitions().size(), "derived columns,",
+                  shared.size(), "shared between processors,", unused.size(), "not consumed");
+
+        for (const auto &[column, owners] : shared) {
+            std::string names;
+            for (const auto &owner : owners)
+                names += (names.empty() ? "" : ", ") + demangle(owner);
+            log::debug("ColumnDependencyAnalyzer::reportGraph", "  shared ", column, "(", names, ")");
+        }
+        for (const auto &column : unused) {
+            if (dry_run)
+                log::info("ColumnDependencyAnalyzer::reportGraph", "  unused ", column);
+            else
+                log::debug("ColumnDependencyAnalyzer::reportGraph", "  unused ", column);
+        }
+    }
+
+  private:
+    static std::string demangle(const std::string &name) {
+        int status = 0;
+        std::unique_ptr<char, void (*)(void *)> out(abi::__cxa_demangle(name.c_str(), nullptr, nullptr, &status),
+                                                    std::free);
+        return status == 0 && out ? std::string(out.get()) : name;
+    }
+
+    std::set<std::string> seeds_;
+};
+
+}
+
+#endif
@@ -1,7 +1,6 @@
 #ifndef CUT_FLOW_CALCULATOR_H
 #define CUT_FLOW_CALCULATOR_H
 
-#include <functional>
 #include <iomanip>
 #include <iostream>
 #include <string>
@@ -10,74 +9,140 @@
 
 #include <rarexsec/data/AnalysisDataLoader.h>
 #include <rarexsec/core/AnalysisDefinition.h>
+#include <rarexsec/core/CutFlowHelper.h>
 #include <rarexsec/utils/Logger.h>
 #include <rarexsec/core/RegionAnalysis.h>
 #include <rarexsec/core/RegionHandle.h>
+#include <rarexsec/core/SelectionCompiler.h>
+#include <rarexsec/hist/StratifiedFillHelper.h>
 #include <rarexsec/hist/StratifierRegistry.h>
 
 namespace analysis {
 
 template <typename Loader> class CutFlowCalculator {
 public:
+  // Cut-flow actions booked for one region, one per sample.
+  struct PendingCutFlow {
+    std::size_t n_stages{};
+    std::vector<ROOT::RDF::RResultPtr<CutFlowCounts>> futures;
+  };
+
   CutFlowCalculator(Loader &ldr, AnalysisDefinition &def)
-      : data_loader_(ldr), analysis_definition_(def) {}
+      : data_loader_(ldr), analysis_definition_(def),
+        schemes_(stratifierSchemes()) {
+    stratum_indices_.reserve(schemes_.size());
+    for (const auto &scheme : schemes_) {
+      stratum_indices_.emplace_back(
+          stratifier_registry_.getAllStratumIntKeysForScheme(scheme));
+    }
+  }
+
+  // Stratifier columns every cut flow is broken down by.
+  static std::vector<std::string> stratifierSchemes() {
+    return {"inclusive_strange_channels", "exclusive_strange_channels",
+            "channel_definitions"};
+  }
+
+  // Stages of compiled regions are then read from the shared clause mask.
+  void setSelectionCompiler(const SelectionCompiler *compiler) {
+    selection_compiler_ = compiler;
+  }
 
   void compute(const RegionHandle &region_handle,
                RegionAnalysis &region_analysis) {
+    auto pending = book(region_handle);
+    std::vector<ROOT::RDF::RResultHandle> handles;
+    collectHandles(pending, handles);
+    ROOT::RDF::RunGraphs(handles);
+    finalise(region_handle, pending, region_analysis);
+  }
+
+  // Books one action per sample without running the event loop, so that cut
+  // flows can share a RunGraphs call with the region histograms.
+  PendingCutFlow book(const RegionHandle &region_handle) {
     auto &sample_frames = data_loader_.getSampleFrames();
-    auto clauses = analysis_definition_.regionClauses(region_handle.key_);
-
-    std::vector<RegionAnalysis::StageCount> stage_counts(clauses.size() + 1);
-
-    StratifierRegistry strat_reg;
-    const std::vector<std::string> schemes{"inclusive_strange_channels",
-                                           "exclusive_strange_channels",
-                                           "channel_definitions"};
-    std::unordered_map<std::string, std::vector<int>> scheme_keys;
-    std::unordered_map<std::string, std::unordered_map<int, std::string>>
-        scheme_filters;
-
-    for (const auto &scheme : schemes) {
-      for (int int_key : strat_reg.getAllStratumIntKeysForScheme(scheme)) {
-        scheme_keys[scheme].push_back(int_key);
-        scheme_filters[scheme][int_key] =
-            scheme + " == " + std::to_string(int_key);
-      }
-    }
+    const auto &clauses = analysis_definition_.regionClauses(region_handle.key_);
+    const auto stage_expr = stageExpression(clauses);
+
+    PendingCutFlow pending;
+    pending.n_stages = clauses.size() + 1;
+    pending.futures.reserve(sample_frames.size());
 
-    log::debug("CutFlowCalculator::compute", "Processing", sample_frames.size(),
+    log::debug("CutFlowCalculator::book", "Processing", sample_frames.size(),
                "sample frames");
     for (auto &[skey, sample_def] : sample_frames) {
-      log::debug("CutFlowCalculator::compute", "Examining sample", skey.str());
+      log::debug("CutFlowCalculator::book", "Examining sample", skey.str());
+
+      auto df = defineStage(sample_def.nominal_node_, region_handle.key_,
+                            stage_expr);
+      for (const auto &scheme : schemes_) {
+        const auto type = df.GetColumnType(scheme);
+        if (type != "int" && type != "Int_t") {
+          log::fatal("CutFlowCalculator::book", "Unsupported type", type,
+                     "for stratifier column", scheme);
+        }
+      }
 
-      auto base_df = sample_def.nominal_node_.Define(
-          "w2", "nominal_event_weight*nominal_event_weight");
+      const auto weight_type = df.GetColumnType("nominal_event_weight");
+      const bool booked = dispatchWeightColumn(weight_type, [&](auto tag) {
+        using Weight = typename decltype(tag)::type;
+        pending.futures.push_back(df.template Book<int, Weight, int, int, int>(
+            CutFlowHelper<Weight, int, int, int>(
+                pending.n_stages, stratum_indices_, df.GetNSlots()),
+            {"cutflow_stage", "nominal_event_weight", schemes_[0], schemes_[1],
+             schemes_[2]}));
+      });
+      if (!booked) {
+        log::fatal("CutFlowCalculator::book", "Unsupported weight type",
+                   weight_type);
+      }
+    }
+    return pending;
+  }
 
-      auto cumulative_nodes = buildCumulativeFilters(base_df, clauses);
+  static void collectHandles(PendingCutFlow &pending,
+                             std::vector<ROOT::RDF::RResultHandle> &handles) {
+    for (auto &future : pending.futures) {
+      handles.emplace_back(future);
+    }
+  }
 
-      calculateWeightsPerStage(cumulative_nodes, stage_counts, schemes,
-                               scheme_keys, scheme_filters);
-      log::debug("CutFlowCalculator::compute", "Completed sample", skey.str());
+  void finalise(const RegionHandle &region_handle, PendingCutFlow &pending,
+                RegionAnalysis &region_analysis) {
+    std::vector<RegionAnalysis::StageCount> stage_counts(pending.n_stages);
+    for (auto &future : pending.futures) {
+      accumulateCutFlow(*future, schemes_, stratum_indices_, stage_counts);
     }
 
-    printSummary(region_handle, clauses, stage_counts);
+    printSummary(region_handle,
+                 analysis_definition_.regionClauses(region_handle.key_),
+                 stage_counts);
     region_analysis.setCutFlow(std::move(stage_counts));
   }
 
-  static std::vector<ROOT::RDF::RNode>
-  buildCumulativeFilters(const ROOT::RDF::RNode &base_df,
-                         const std::vector<std::string> &clauses) {
-    std::vector<ROOT::RDF::RNode> nodes;
-    nodes.reserve(clauses.size() + 1);
-    nodes.push_back(base_df);
-
-    auto current = base_df;
-    for (const auto &clause : clauses) {
-      current = current.Filter(clause);
-      nodes.push_back(current);
+  ROOT::RDF::RNode defineStage(ROOT::RDF::RNode node, const RegionKey &key,
+                               const std::string &stage_expr) const {
+    if (selection_compiler_ && selection_compiler_->compiled(key) &&
+        node.HasColumn(SelectionCompiler::kMaskColumn)) {
+      return node.Define(
+          "cutflow_stage",
+          [bits = selection_compiler_->regionBits(key)](ULong64_t mask) {
+            return SelectionCompiler::stageReached(mask, bits);
+          },
+          {SelectionCompiler::kMaskColumn});
     }
+    return node.Define("cutflow_stage", stage_expr);
+  }
 
-    return nodes;
+  // Number of leading clauses an event passes. The conditional chain stops at
+  // the first failure, mirroring the short-circuit of chained filters.
+  static std::string stageExpression(const std::vector<std::string> &clauses) {
+    std::string expr;
+    for (std::size_t i = 0; i < clauses.size(); ++i) {
+      expr += "!(" + clauses[i] + ") ? " + std::to_string(i) + " : ";
+    }
+    expr += std::to_string(clauses.size());
+    return "static_cast<int>(" + expr + ")";
   }
 
   static void
@@ -137,81 +202,12 @@ public:
   }
 
 private:
-  void updateSchemeTallies(
-      ROOT::RDF::RNode df, const std::vector<std::string> &schemes,
-      const std::unordered_map<std::string, std::vector<int>> &scheme_keys,
-      const std::unordered_map<
-          std::string, std::unordered_map<int, std::string>> &scheme_filters,
-      RegionAnalysis::StageCount &stage_count,
-      std::vector<ROOT::RDF::RResultPtr<double>> &results,
-      std::vector<std::function<void()>> &value_setters) {
-    for (const auto &scheme : schemes) {
-      log::debug("CutFlowCalculator::updateSchemeTallies", "Scheme", scheme);
-      for (int key : scheme_keys.at(scheme)) {
-        log::debug("CutFlowCalculator::updateSchemeTallies", "  Key", key);
-        auto ch_df = df.Filter(scheme_filters.at(scheme).at(key));
-
-        auto ch_w = ch_df.Sum<double>("nominal_event_weight");
-        auto ch_w2 = ch_df.Sum<double>("w2");
-
-        stage_count.schemes[scheme][key];
-
-        results.emplace_back(ch_w);
-        results.emplace_back(ch_w2);
-
-        value_setters.emplace_back([&stage_count, scheme, key, ch_w]() mutable {
-          stage_count.schemes[scheme][key].first += ch_w.GetValue();
-        });
-        value_setters.emplace_back(
-            [&stage_count, scheme, key, ch_w2]() mutable {
-              stage_count.schemes[scheme][key].second += ch_w2.GetValue();
-            });
-      }
-    }
-  }
-
-  void calculateWeightsPerStage(
-      const std::vector<ROOT::RDF::RNode> &cumulative_nodes,
-      std::vector<RegionAnalysis::StageCount> &stage_counts,
-      const std::vector<std::string> &schemes,
-      const std::unordered_map<std::string, std::vector<int>> &scheme_keys,
-      const std::unordered_map<
-          std::string, std::unordered_map<int, std::string>> &scheme_filters) {
-    std::vector<ROOT::RDF::RResultPtr<double>> results;
-    std::vector<std::function<void()>> value_setters;
-
-    for (size_t i = 0; i < cumulative_nodes.size(); ++i) {
-      auto df = cumulative_nodes[i];
-      log::debug("CutFlowCalculator::calculateWeightsPerStage", "Stage", i);
-
-      auto tot_w = df.Sum<double>("nominal_event_weight");
-      auto tot_w2 = df.Sum<double>("w2");
-
-      results.emplace_back(tot_w);
-      results.emplace_back(tot_w2);
-
-      value_setters.emplace_back([&stage_counts, i, tot_w]() mutable {
-        stage_counts[i].total += tot_w.GetValue();
-      });
-      value_setters.emplace_back([&stage_counts, i, tot_w2]() mutable {
-        stage_counts[i].total_w2 += tot_w2.GetValue();
-      });
-
-      updateSchemeTallies(df, schemes, scheme_keys, scheme_filters,
-                          stage_counts[i], results, value_setters);
-    }
-
-    for (auto &res : results) {
-      res.GetValue();
-    }
-
-    for (auto &setter : value_setters) {
-      setter();
-    }
-  }
-
   Loader &data_loader_;
   AnalysisDefinition &analysis_definition_;
+  StratifierRegistry stratifier_registry_;
+  std::vector<std::string> schemes_;
+  std::vector<StratumIndex> stratum_indices_;
+  const SelectionCompiler *selection_compiler_{nullptr};
 };
 
 } // namespace analysis
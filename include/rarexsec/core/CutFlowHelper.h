@@ -0,0 +1,121 @@
+#ifndef CUT_FLOW_HELPER_H
+#define CUT_FLOW_HELPER_H
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "ROOT/RDF/RActionImpl.hxx"
+#include "ROOT/RDataFrame.hxx"
+#include <Eigen/Dense>
+
+#include <rarexsec/core/RegionAnalysis.h>
+#include <rarexsec/hist/StratifiedFillHelper.h>
+
+namespace analysis {
+
+// Sums of w and w^2 per stage (rows). Column 0 is the stage total; the strata
+// of each scheme follow in the order the schemes were given.
+struct CutFlowCounts {
+    Eigen::MatrixXd sumw;
+    Eigen::MatrixXd sumw2;
+};
+
+// RDataFrame action for a whole cut flow. Each event carries the number of
+// leading clauses it passed, so it is tallied once at that depth and the
+// per-stage sums are recovered with a reverse cumulative sum in Finalize.
+template <typename Weight, typename... Schemes>
+class CutFlowHelper : public ROOT::Detail::RDF::RActionImpl<CutFlowHelper<Weight, Schemes...>> {
+  public:
+    using Result_t = CutFlowCounts;
+
+    CutFlowHelper(std::size_t n_stages, std::vector<StratumIndex> indices, unsigned n_slots)
+        : indices_(std::move(indices)), result_(std::make_shared<Result_t>()) {
+        offsets_.reserve(indices_.size());
+        Eigen::Index n_cols = 1;
+        for (const auto &index : indices_) {
+            offsets_.push_back(n_cols);
+            n_cols += static_cast<Eigen::Index>(index.size());
+        }
+        const auto n_rows = static_cast<Eigen::Index>(n_stages);
+        result_->sumw = Eigen::MatrixXd::Zero(n_rows, n_cols);
+        result_->sumw2 = Eigen::MatrixXd::Zero(n_rows, n_cols);
+        slot_counts_.assign(n_slots, *result_);
+    }
+
+    CutFlowHelper(CutFlowHelper &&) = default;
+    CutFlowHelper(const CutFlowHelper &) = delete;
+
+    std::shared_ptr<Result_t> GetResultPtr() const { return result_; }
+
+    void Initialize() {}
+
+    void InitTask(TTreeReader *, unsigned int) {}
+
+    void Exec(unsigned int slot, const int &stage, const Weight &weight, const Schemes &...schemes) {
+        auto &counts = slot_counts_[slot];
+        const double w = static_cast<double>(weight);
+        const double w2 = w * w;
+        counts.sumw(stage, 0) += w;
+        counts.sumw2(stage, 0) += w2;
+
+        std::size_t j = 0;
+        const auto tally = [&](long long value) {
+            const int stratum = indices_[j].find(value);
+            if (stratum >= 0) {
+                counts.sumw(stage, offsets_[j] + stratum) += w;
+                counts.sumw2(stage, offsets_[j] + stratum) += w2;
+            }
+            ++j;
+        };
+        (tally(static_cast<long long>(schemes)), ...);
+    }
+
+    void Finalize() {
+        for (const auto &counts : slot_counts_) {
+            result_->sumw += counts.sumw;
+            result_->sumw2 += counts.sumw2;
+        }
+        for (Eigen::Index r = result_->sumw.rows() - 2; r >= 0; --r) {
+            result_->sumw.row(r) += result_->sumw.row(r + 1);
+            result_->sumw2.row(r) += result_->sumw2.row(r + 1);
+        }
+    }
+
+    std::string GetActionName() { return "CutFlow"; }
+
+  private:
+    std::vector<StratumIndex> indices_;
+    std::vector<Eigen::Index> offsets_;
+    std::shared_ptr<Result_t> result_;
+    std::vector<Result_t> slot_counts_;
+};
+
+// Adds one sample's cut flow onto the region tallies. Every stratum of every
+// scheme gets an entry, even when empty, so downstream plots see all keys.
+inline void accumulateCutFlow(const CutFlowCounts &counts, const std::vector<std::string> &schemes,
+                              const std::vector<StratumIndex> &indices,
+                              std::vector<RegionAnalysis::StageCount> &stage_counts) {
+    for (std::size_t stage = 0; stage < stage_counts.size(); ++stage) {
+        const auto r = static_cast<Eigen::Index>(stage);
+        auto &stage_count = stage_counts[stage];
+        stage_count.total += counts.sumw(r, 0);
+        stage_count.total_w2 += counts.sumw2(r, 0);
+
+        Eigen::Index col = 1;
+        for (std::size_t j = 0; j < schemes.size(); ++j) {
+            auto &tallies = stage_count.schemes[schemes[j]];
+            for (int key : indices[j].keys()) {
+                auto &entry = tallies[key];
+                entry.first += counts.sumw(r, col);
+                entry.second += counts.sumw2(r, col);
+                ++col;
+            }
+        }
+    }
+}
+
+}
+
+#endif
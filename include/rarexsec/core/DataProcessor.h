@@ -9,26 +9,26 @@ class DataProcessor : public ISampleProcessor {
   public:
     explicit DataProcessor(SampleDataset dataset) : dataset_(std::move(dataset)) {}
 
-    void book(HistogramFactory &factory, const BinningDefinition &binning, const ROOT::RDF::TH1DModel &model) override {
-        data_future_ = factory.bookNominalHist(binning, dataset_, model);
+    void book(HistogramFactory &factory, const BinningDefinition &binning, const ROOT::RDF::TH1DModel &) override {
+        data_future_ = factory.bookNominalHist(binning, dataset_);
     }
 
     std::size_t expectedHandleCount() const override { return 1; }
 
+    std::unique_ptr<ISampleProcessor> clone() const override { return std::make_unique<DataProcessor>(dataset_); }
+
     void collectHandles(std::vector<ROOT::RDF::RResultHandle> &handles) override {
         handles.emplace_back(data_future_);
     }
 
     void contributeTo(VariableResult &result) override {
-        if (data_future_.GetPtr()) {
-            result.data_hist_ =
-                result.data_hist_ + BinnedHistogram::createFromTH1D(result.binning_, *data_future_.GetPtr());
-        }
+        if (const auto *counts = data_future_.GetPtr())
+            result.data_hist_.addSums(result.binning_, counts->sumw(), counts->sumw2());
     }
 
   private:
     SampleDataset dataset_;
-    ROOT::RDF::RResultPtr<TH1D> data_future_;
+    ROOT::RDF::RResultPtr<HistogramCounts> data_future_;
 };
 
 }
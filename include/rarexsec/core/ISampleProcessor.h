@@ -6,6 +6,7 @@
 #include <ROOT/RDataFrame.hxx>
 #include <vector>
 #include <cstddef>
+#include <memory>
 
 namespace analysis {
 
@@ -20,6 +21,10 @@ class ISampleProcessor {
 
     virtual void contributeTo(VariableResult &result) = 0;
     virtual std::size_t expectedHandleCount() const = 0;
+
+    // Fresh, unbooked processor over the same datasets so that several
+    // variables can be booked against one event loop.
+    virtual std::unique_ptr<ISampleProcessor> clone() const = 0;
 };
 
 }
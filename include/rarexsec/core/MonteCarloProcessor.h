@@ -17,27 +17,30 @@ class MonteCarloProcessor : public ISampleProcessor {
         : sample_key_(key), nominal_dataset_(std::move(ensemble.nominal_)),
           variation_datasets_(std::move(ensemble.variations_)) {}
 
-    void book(HistogramFactory &factory, const BinningDefinition &binning, const ROOT::RDF::TH1DModel &model) override {
+    void book(HistogramFactory &factory, const BinningDefinition &binning, const ROOT::RDF::TH1DModel &) override {
         analysis::log::info("MonteCarloProcessor::book", "Beginning stratification...");
         analysis::log::debug("MonteCarloProcessor::book", "Requested stratifier key:", binning.getStratifierKey().str());
-        nominal_futures_ = factory.bookStratifiedHists(binning, nominal_dataset_, model);
+        nominal_future_ = factory.bookStratifiedHists(binning, nominal_dataset_);
 
         analysis::log::info("MonteCarloProcessor::book", "Booking nominals...");
         if (!variation_datasets_.empty()) {
             for (auto &[var_key, dataset] : variation_datasets_) {
-                variation_futures_[var_key] = factory.bookNominalHist(binning, dataset, model);
+                variation_futures_[var_key] = factory.bookNominalHist(binning, dataset);
             }
         }
     }
 
     std::size_t expectedHandleCount() const override {
-        return nominal_futures_.size() + variation_futures_.size();
+        return 1 + variation_futures_.size();
+    }
+
+    std::unique_ptr<ISampleProcessor> clone() const override {
+        return std::make_unique<MonteCarloProcessor>(sample_key_,
+                                                     SampleDatasetGroup{nominal_dataset_, variation_datasets_});
     }
 
     void collectHandles(std::vector<ROOT::RDF::RResultHandle> &handles) override {
-        for (auto &pair : nominal_futures_) {
-            handles.emplace_back(pair.second);
-        }
+        handles.emplace_back(nominal_future_.counts);
         for (auto &pair : variation_futures_) {
             handles.emplace_back(pair.second);
         }
@@ -46,19 +49,20 @@ class MonteCarloProcessor : public ISampleProcessor {
     void contributeTo(VariableResult &result) override {
         log::info("MonteCarloProcessor::contributeTo", "Contributing histograms from sample:", sample_key_.str());
 
-        for (auto &[stratum_key, future] : nominal_futures_) {
-            if (future.GetPtr()) {
-                auto hist = BinnedHistogram::createFromTH1D(result.binning_, *future.GetPtr());
-                ChannelKey channel_key{stratum_key.str()};
-                result.strat_hists_[channel_key] = result.strat_hists_[channel_key] + hist;
-                result.total_mc_hist_ = result.total_mc_hist_ + hist;
+        if (const auto *counts = nominal_future_.counts.GetPtr()) {
+            for (std::size_t i = 0; i < nominal_future_.keys.size(); ++i) {
+                const auto sumw = counts->sumw.row(i).transpose();
+                const auto sumw2 = counts->sumw2.row(i).transpose();
+                ChannelKey channel_key{nominal_future_.keys[i].str()};
+                result.strat_hists_[channel_key].addSums(result.binning_, sumw, sumw2);
+                result.total_mc_hist_.addSums(result.binning_, sumw, sumw2);
             }
         }
 
         for (auto &[var_key, future] : variation_futures_) {
-            if (future.GetPtr()) {
-                auto hist = BinnedHistogram::createFromTH1D(result.binning_, *future.GetPtr());
-                result.raw_detvar_hists_[sample_key_][var_key] = hist;
+            if (const auto *counts = future.GetPtr()) {
+                result.raw_detvar_hists_[sample_key_][var_key] =
+                    BinnedHistogram::createFromCounts(result.binning_, *counts);
             }
         }
     }
@@ -68,8 +72,8 @@ class MonteCarloProcessor : public ISampleProcessor {
     SampleDataset nominal_dataset_;
     std::unordered_map<SampleVariation, SampleDataset> variation_datasets_;
 
-    std::unordered_map<StratumKey, ROOT::RDF::RResultPtr<TH1D>> nominal_futures_;
-    std::unordered_map<SampleVariation, ROOT::RDF::RResultPtr<TH1D>> variation_futures_;
+    StratifiedFuture nominal_future_;
+    std::unordered_map<SampleVariation, ROOT::RDF::RResultPtr<HistogramCounts>> variation_futures_;
 };
 
 }
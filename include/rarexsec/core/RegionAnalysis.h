@@ -2,6 +2,7 @@
 
 #include <rarexsec/core/VariableResult.h>
 #include <rarexsec/core/AnalysisKey.h>
+#include <rarexsec/utils/Logger.h>
 
 #include <map>
 #include <stdexcept>
@@ -75,6 +76,39 @@ class RegionAnalysis {
     void setCutFlow(std::vector<StageCount> cf) { cut_flow_ = std::move(cf); }
     const std::vector<StageCount> &cutFlow() const noexcept { return cut_flow_; }
 
+    // Adds the partial result of the same region over other events. The
+    // exposure comes from the run configuration and is the same in every
+    // part, so it is not summed.
+    void merge(const RegionAnalysis &other) {
+        for (const auto &[key, result] : other.final_variables_) {
+            auto [it, inserted] = final_variables_.try_emplace(key, result);
+            if (!inserted)
+                it->second.merge(result);
+        }
+
+        if (cut_flow_.empty()) {
+            cut_flow_ = other.cut_flow_;
+            return;
+        }
+        if (other.cut_flow_.empty())
+            return;
+        if (cut_flow_.size() != other.cut_flow_.size())
+            log::fatal("RegionAnalysis::merge", "Cut flows of", region_key_.str(), "have different stage counts");
+        for (std::size_t i = 0; i < cut_flow_.size(); ++i) {
+            auto &stage = cut_flow_[i];
+            const auto &other_stage = other.cut_flow_[i];
+            stage.total += other_stage.total;
+            stage.total_w2 += other_stage.total_w2;
+            for (const auto &[scheme, strata] : other_stage.schemes) {
+                for (const auto &[stratum, sums] : strata) {
+                    auto &into = stage.schemes[scheme][stratum];
+                    into.first += sums.first;
+                    into.second += sums.second;
+                }
+            }
+        }
+    }
+
   private:
     RegionKey region_key_{};
     std::string region_label_{};
@@ -0,0 +1,126 @@
+#ifndef RESULT_CACHE_H
+#define RESULT_CACHE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+#include <unistd.h>
+
+#include <rarexsec/core/AnalysisResultIO.h>
+#include <rarexsec/core/VariableResult.h>
+#include <rarexsec/data/SampleCache.h>
+#include <rarexsec/utils/Logger.h>
+
+namespace analysis {
+
+struct ResultCacheConfig {
+    std::string directory_;
+    bool write_{true};
+
+    bool enabled() const noexcept { return !directory_.empty(); }
+
+    // Reads the optional "result_cache" block of the samples catalog. The
+    // ANALYSIS_RESULT_CACHE environment variable overrides its directory.
+    static ResultCacheConfig fromJson(const nlohmann::json &samples) {
+        ResultCacheConfig cfg;
+        if (samples.contains("result_cache")) {
+            const auto &j = samples.at("result_cache");
+            cfg.directory_ = j.value("directory", "");
+            cfg.write_ = j.value("write", true);
+        }
+        if (const char *dir = std::getenv("ANALYSIS_RESULT_CACHE"))
+            cfg.directory_ = dir;
+        return cfg;
+    }
+};
+
+// Keeps the filled histograms and systematic variations of one sample in one
+// region and variable, so that a rerun only books the entries whose inputs
+// changed. Entries are keyed by a hash of the sample signature, the region
+// selection and its clauses, the variable definition and binning, the
+// systematics configuration and the source digest of the build; a changed input
+// gives a new key and the stale entry is simply never read again.
+class ResultCache {
+  public:
+    // Bump whenever the entry layout changes; code changes are covered by
+    // SampleCache::kSourceHash.
+    static constexpr int kFormatVersion = 1;
+
+    explicit ResultCache(ResultCacheConfig config = {}) : config_(std::move(config)) {
+        if (!config_.enabled())
+            return;
+        std::error_code ec;
+        std::filesystem::create_directories(config_.directory_, ec);
+        if (ec) {
+            log::warn("ResultCache", "Cannot create cache directory", config_.directory_, "(", ec.message(),
+                      "); caching disabled");
+            config_.directory_.clear();
+        }
+    }
+
+    bool enabled() const noexcept { return config_.enabled(); }
+
+    const ResultCacheConfig &config() const noexcept { return config_; }
+
+    // Location of the entry named `name` whose inputs are described by
+    // `parts`, in order.
+    std::string entryPath(const std::string &name, const std::vector<std::string> &parts) const {
+        std::uint64_t h = SampleCache::fnv1a("rarexsec-result-cache");
+        h = SampleCache::fnv1a(std::to_string(kFormatVersion), h);
+        h = SampleCache::fnv1a(std::to_string(AnalysisResultIO::kFormatVersion), h);
+        h = SampleCache::fnv1a(SampleCache::kSourceHash, h);
+        for (const auto &part : parts)
+            h = SampleCache::fnv1a(part, h);
+
+        char hex[17];
+        std::snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(h));
+        return (std::filesystem::path(config_.directory_) / (sanitise(name) + "-" + hex + ".bin")).string();
+    }
+
+    std::optional<VariableResult> load(const std::string &entry_path) const {
+        if (!std::filesystem::exists(entry_path))
+            return std::nullopt;
+        log::debug("ResultCache::load", "Reusing", entry_path);
+        return AnalysisResultIO::readVariable(entry_path);
+    }
+
+    // Written to a temporary file that is renamed on success, so concurrent
+    // shards and interrupted runs never expose a partial entry.
+    void store(const std::string &entry_path, const VariableResult &result) const {
+        if (!config_.write_)
+            return;
+        const auto tmp_path = entry_path + ".tmp" + std::to_string(::getpid());
+        AnalysisResultIO::writeVariable(result, tmp_path);
+        std::error_code ec;
+        std::filesystem::rename(tmp_path, entry_path, ec);
+        if (ec) {
+            log::warn("ResultCache::store", "Cannot finalise", entry_path, "(", ec.message(), ")");
+            std::filesystem::remove(tmp_path, ec);
+        }
+    }
+
+  private:
+    static std::string sanitise(std::string name) {
+        for (auto &c : name) {
+            const bool keep = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+                              c == '_' || c == '-' || c == '.';
+            if (!keep)
+                c = '_';
+        }
+        return name;
+    }
+
+    ResultCacheConfig config_;
+};
+
+}
+
+#endif
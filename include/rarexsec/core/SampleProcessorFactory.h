@@ -15,6 +15,8 @@
 #include <rarexsec/core/MonteCarloProcessor.h>
 #include <rarexsec/core/RegionAnalysis.h>
 #include <rarexsec/core/RegionHandle.h>
+#include <rarexsec/core/SelectionCompiler.h>
+#include <rarexsec/data/ExpressionCompiler.h>
 #include <rarexsec/data/SampleDataset.h>
 
 namespace analysis {
@@ -24,7 +26,8 @@ template <typename Loader> class SampleProcessorFactory {
     explicit SampleProcessorFactory(Loader &ldr) : data_loader_(ldr) {}
 
     auto create(const RegionHandle &region_handle,
-                RegionAnalysis &region_analysis)
+                RegionAnalysis &region_analysis,
+                const SelectionCompiler *selection_compiler = nullptr)
         -> std::pair<
             std::unordered_map<SampleKey, std::unique_ptr<ISampleProcessor>>,
             std::unordered_map<SampleKey, ROOT::RDF::RNode>> {
@@ -52,8 +55,14 @@ template <typename Loader> class SampleProcessorFactory {
                                                       region_runs);
                           }));
 
-        const auto applySelection = [&](auto df) {
-            return selection_expr.empty() ? df : df.Filter(selection_expr);
+        const bool use_mask = selection_compiler &&
+                              selection_compiler->compiled(region_handle.key_);
+        const auto applySelection = [&](ROOT::RDF::RNode df) -> ROOT::RDF::RNode {
+            if (use_mask)
+                return selection_compiler->filter(df, region_handle.key_);
+            if (selection_expr.empty())
+                return df;
+            return ExpressionCompiler::instance().filter(df, selection_expr);
         };
 
         std::size_t sample_index = 0;
@@ -0,0 +1,181 @@
+#ifndef SELECTION_COMPILER_H
+#define SELECTION_COMPILER_H
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "ROOT/RDataFrame.hxx"
+
+#include <rarexsec/core/AnalysisDefinition.h>
+#include <rarexsec/core/AnalysisKey.h>
+#include <rarexsec/data/ExpressionCompiler.h>
+#include <rarexsec/utils/Logger.h>
+
+namespace analysis {
+
+// Collects every distinct clause used by the configured regions and evaluates
+// each of them once per event into a 64 bit mask column. Region selections,
+// cut-flow stages and N-1 tests then become integer mask tests instead of
+// separate JIT filters per region. Every clause in the mask is evaluated on
+// every event, so only clauses within the expression grammar are compiled;
+// anything else (indexing, calls, division) may rely on the clauses before
+// it as guards, and its regions keep their short-circuiting filter.
+class SelectionCompiler {
+  public:
+    static constexpr std::size_t kMaxClauses = 64;
+    static constexpr const char *kMaskColumn = "selection_mask";
+
+    SelectionCompiler() = default;
+
+    explicit SelectionCompiler(const AnalysisDefinition &def) {
+        for (const auto &region_handle : def.regions()) {
+            const auto &clauses = def.regionClauses(region_handle.key_);
+            if (!clauses.empty()) {
+                this->addRegion(region_handle.key_, clauses);
+            } else if (!region_handle.selection().empty()) {
+                this->addRegion(region_handle.key_, {region_handle.selection().str()});
+            } else {
+                this->addRegion(region_handle.key_, {});
+            }
+        }
+        log::info("SelectionCompiler", "Compiled", region_bits_.size(), "regions onto", clauses_.size(),
+                  "distinct clauses");
+    }
+
+    // Registers a region by its ordered clauses. Regions with a clause outside
+    // the grammar, or that would take the mask beyond 64 clauses, are left
+    // uncompiled and keep their JIT filter.
+    bool addRegion(const RegionKey &key, const std::vector<std::string> &clauses) {
+        std::vector<std::string> normalised;
+        normalised.reserve(clauses.size());
+        std::size_t n_new = 0;
+        for (const auto &clause : clauses) {
+            auto norm = normalise(clause);
+            if (norm.empty())
+                continue;
+            if (!ExpressionCompiler::instance().compilable(norm)) {
+                log::info("SelectionCompiler::addRegion", "Region", key.str(), "keeps its filter chain for clause",
+                          norm);
+                return false;
+            }
+            if (clause_bits_.find(norm) == clause_bits_.end() &&
+                std::find(normalised.begin(), normalised.end(), norm) == normalised.end())
+                ++n_new;
+            normalised.push_back(std::move(norm));
+        }
+        if (clauses_.size() + n_new > kMaxClauses) {
+            log::warn("SelectionCompiler::addRegion", "Clause mask is full; region", key.str(),
+                      "falls back to its JIT selection");
+            return false;
+        }
+
+        std::vector<int> bits;
+        bits.reserve(normalised.size());
+        std::uint64_t mask = 0;
+        for (auto &clause : normalised) {
+            const int bit = this->internClause(std::move(clause));
+            bits.push_back(bit);
+            mask |= std::uint64_t{1} << bit;
+        }
+        region_bits_.insert_or_assign(key, std::move(bits));
+        region_masks_.insert_or_assign(key, mask);
+        return true;
+    }
+
+    bool compiled(const RegionKey &key) const { return region_masks_.count(key) != 0; }
+
+    std::uint64_t regionMask(const RegionKey &key) const { return region_masks_.at(key); }
+
+    // Bit of each clause of the region, in selection order.
+    const std::vector<int> &regionBits(const RegionKey &key) const { return region_bits_.at(key); }
+
+    const std::vector<std::string> &clauses() const { return clauses_; }
+
+    std::string maskExpression() const {
+        if (clauses_.empty())
+            return "static_cast<ULong64_t>(0)";
+        std::string expr = "static_cast<ULong64_t>(";
+        for (std::size_t i = 0; i < clauses_.size(); ++i) {
+            if (i != 0)
+                expr += " | ";
+            expr += "((" + clauses_[i] + ") ? (1ULL << " + std::to_string(i) + ") : 0ULL)";
+        }
+        return expr + ")";
+    }
+
+    // Clauses within the expression grammar are evaluated by one typed
+    // closure; otherwise the mask is left to JIT.
+    ROOT::RDF::RNode defineMask(ROOT::RDF::RNode df) const {
+        if (ExpressionCompiler::instance().defineMask(df, kMaskColumn, clauses_, df.HasColumn(kMaskColumn)))
+            return df;
+        if (df.HasColumn(kMaskColumn))
+            return df.Redefine(kMaskColumn, this->maskExpression());
+        return df.Define(kMaskColumn, this->maskExpression());
+    }
+
+    template <typename Frames> void defineMask(Frames &sample_frames) const {
+        for (auto &[sample_key, sample_def] : sample_frames) {
+            sample_def.nominal_node_ = this->defineMask(sample_def.nominal_node_);
+            for (auto &[variation, node] : sample_def.variation_nodes_) {
+                node = this->defineMask(node);
+            }
+        }
+    }
+
+    ROOT::RDF::RNode filter(ROOT::RDF::RNode df, const RegionKey &key) const {
+        const std::uint64_t mask = this->regionMask(key);
+        if (mask == 0)
+            return df;
+        return df.Filter([mask](ULong64_t m) { return (m & mask) == mask; }, {kMaskColumn});
+    }
+
+    // Number of leading clauses passed, i.e. the last cut-flow stage reached.
+    static int stageReached(std::uint64_t mask, const std::vector<int> &bits) {
+        int stage = 0;
+        for (int bit : bits) {
+            if (!(mask >> bit & 1U))
+                break;
+            ++stage;
+        }
+        return stage;
+    }
+
+    // N-1 test: every clause of the region except `bit` is satisfied.
+    static bool passesAllBut(std::uint64_t mask, std::uint64_t region_mask, int bit) {
+        const std::uint64_t others = region_mask & ~(std::uint64_t{1} << bit);
+        return (mask & others) == others;
+    }
+
+  private:
+    static std::string normalise(const std::string &clause) {
+        const auto first = clause.find_first_not_of(" \t\n");
+        if (first == std::string::npos)
+            return {};
+        const auto last = clause.find_last_not_of(" \t\n");
+        return clause.substr(first, last - first + 1);
+    }
+
+    int internClause(std::string norm) {
+        auto it = clause_bits_.find(norm);
+        if (it != clause_bits_.end())
+            return it->second;
+        const int bit = static_cast<int>(clauses_.size());
+        clauses_.push_back(norm);
+        clause_bits_.emplace(std::move(norm), bit);
+        return bit;
+    }
+
+    std::vector<std::string> clauses_;
+    std::unordered_map<std::string, int> clause_bits_;
+    std::map<RegionKey, std::vector<int>> region_bits_;
+    std::map<RegionKey, std::uint64_t> region_masks_;
+};
+
+}
+
+#endif
@@ -1,8 +1,11 @@
 #ifndef VARIABLE_PROCESSOR_H
 #define VARIABLE_PROCESSOR_H
 
+#include <cstdio>
 #include <memory>
+#include <string>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include <rarexsec/core/AnalysisDefinition.h>
@@ -10,8 +13,10 @@
 #include <rarexsec/core/ISampleProcessor.h>
 #include <rarexsec/core/RegionAnalysis.h>
 #include <rarexsec/core/RegionHandle.h>
+#include <rarexsec/core/ResultCache.h>
 #include <rarexsec/core/VariableResult.h>
 #include <rarexsec/hist/HistogramFactory.h>
+#include <rarexsec/syst/SystematicStrategy.h>
 #include <rarexsec/utils/Logger.h>
 
 #include <ROOT/RDataFrame.hxx>
@@ -20,10 +25,44 @@ namespace analysis {
 
 template <typename SysProc> class VariableProcessor {
 public:
+  // Everything booked for one variable. The sample processors are clones of
+  // the region prototypes so that each variable owns its futures.
+  struct VariableBooking {
+    VariableBooking() = default;
+    VariableBooking(VariableBooking &&) = default;
+    VariableBooking &operator=(VariableBooking &&) = default;
+    VariableBooking(const VariableBooking &) = delete;
+    VariableBooking &operator=(const VariableBooking &) = delete;
+
+    VariableKey key_;
+    VariableResult result_;
+    std::unordered_map<SampleKey, std::unique_ptr<ISampleProcessor>>
+        sample_processors_;
+    SystematicFutures systematic_futures_;
+    // Cache entries to write for the booked samples, and the contributions
+    // of the samples that were found in the cache instead of booked.
+    std::unordered_map<SampleKey, std::string> cache_entries_;
+    std::vector<VariableResult> cached_results_;
+  };
+
+  using RegionBooking = std::vector<VariableBooking>;
+
   VariableProcessor(AnalysisDefinition &def, SysProc &sys_proc,
-                    HistogramFactory &factory)
+                    HistogramFactory &factory, bool batch_variables = true)
       : analysis_definition_(def), systematics_processor_(sys_proc),
-        histogram_factory_(factory) {}
+        histogram_factory_(factory), batch_variables_(batch_variables) {}
+
+  void setBatchVariables(bool batch) { batch_variables_ = batch; }
+
+  bool batchVariables() const { return batch_variables_; }
+
+  // Reuses the per-sample results of earlier runs. Only samples with a
+  // signature are cached; the cache must outlive the processor.
+  void setResultCache(const ResultCache *cache,
+                      std::unordered_map<SampleKey, std::string> signatures) {
+    result_cache_ = cache && cache->enabled() ? cache : nullptr;
+    sample_signatures_ = std::move(signatures);
+  }
 
   void
   process(const RegionHandle &region_handle, RegionAnalysis &region_analysis,
@@ -33,73 +72,219 @@ public:
     log::info("VariableProcessor::process",
               "Iterating across observable variables...");
 
+    if (batch_variables_) {
+      auto booking = book(region_handle, sample_processors, monte_carlo_nodes);
+      std::vector<ROOT::RDF::RResultHandle> handles;
+      collectHandles(booking, handles);
+      log::info("VariableProcessor::process", "Running one event loop for",
+                booking.size(), "variables (", handles.size(), "handles)");
+      if (!handles.empty())
+        ROOT::RDF::RunGraphs(handles);
+      finalise(booking, region_analysis);
+      return;
+    }
+
     const auto &vars = region_handle.vars();
     const auto total_vars = vars.size();
-
     for (std::size_t index = 0; index < total_vars; ++index) {
-      const auto &var_key = vars[index];
-      const auto &variable_handle = analysis_definition_.variable(var_key);
-      const auto &binning = variable_handle.binning();
-      const auto model = binning.toTH1DModel();
-
-      VariableResult result;
-      result.binning_ = binning;
-
       log::info("VariableProcessor::process", "Deploying variable pipeline (",
-                index + 1, "/", total_vars, "):", var_key.str());
-
-      log::info("VariableProcessor::process", "Executing sample processors...");
-      for (auto &entry : sample_processors) {
-        entry.second->book(histogram_factory_, binning, model);
-      }
+                index + 1, "/", total_vars, "):", vars[index].str());
+      RegionBooking booking;
+      booking.push_back(bookVariable(region_handle, vars[index],
+                                     sample_processors, monte_carlo_nodes));
+      std::vector<ROOT::RDF::RResultHandle> handles;
+      collectHandles(booking, handles);
+      if (!handles.empty())
+        ROOT::RDF::RunGraphs(handles);
+      finalise(booking, region_analysis);
+    }
+  }
 
-      if (systematics_processor_.hasStrategies()) {
-        log::info("VariableProcessor::process",
-                  "Registering systematic variations...");
-        for (auto &entry : monte_carlo_nodes) {
-          systematics_processor_.bookSystematics(entry.first, entry.second,
-                                                 binning, model);
-        }
-      }
+  // Registers the nominal, stratified, detector-variation and systematic
+  // histograms of every variable in the region without triggering the loop.
+  RegionBooking
+  book(const RegionHandle &region_handle,
+       const std::unordered_map<SampleKey, std::unique_ptr<ISampleProcessor>>
+           &sample_processors,
+       std::unordered_map<SampleKey, ROOT::RDF::RNode> &monte_carlo_nodes) {
+    const auto &vars = region_handle.vars();
+    RegionBooking booking;
+    booking.reserve(vars.size());
+    for (std::size_t index = 0; index < vars.size(); ++index) {
+      log::info("VariableProcessor::book", "Booking variable (", index + 1,
+                "/", vars.size(), "):", vars[index].str());
+      booking.push_back(bookVariable(region_handle, vars[index],
+                                     sample_processors, monte_carlo_nodes));
+    }
+    return booking;
+  }
 
-      log::info("VariableProcessor::process", "Persisting results...");
-      std::size_t total_handles = 0;
-      for (auto &entry : sample_processors) {
+  static void collectHandles(RegionBooking &booking,
+                             std::vector<ROOT::RDF::RResultHandle> &handles) {
+    std::size_t total_handles = handles.size();
+    for (const auto &variable : booking) {
+      for (const auto &entry : variable.sample_processors_) {
         total_handles += entry.second->expectedHandleCount();
       }
-      std::vector<ROOT::RDF::RResultHandle> handles;
-      handles.reserve(total_handles);
-      for (auto &entry : sample_processors) {
+    }
+    handles.reserve(total_handles);
+    for (auto &variable : booking) {
+      for (auto &entry : variable.sample_processors_) {
         entry.second->collectHandles(handles);
       }
-      ROOT::RDF::RunGraphs(handles);
-      for (auto &entry : sample_processors) {
-        entry.second->contributeTo(result);
+    }
+  }
+
+  // Distributes the filled histograms to each VariableResult once the event
+  // loop has run.
+  void finalise(RegionBooking &booking, RegionAnalysis &region_analysis) {
+    for (auto &variable : booking) {
+      auto &result = variable.result_;
+      log::info("VariableProcessor::finalise", "Persisting results:",
+                variable.key_.str());
+      if (variable.cache_entries_.empty() && variable.cached_results_.empty()) {
+        for (auto &entry : variable.sample_processors_) {
+          entry.second->contributeTo(result);
+        }
+        SysProc::collectSystematics(result, variable.systematic_futures_);
+      } else {
+        finaliseCached(variable);
       }
 
-      if (systematics_processor_.hasSystematics() ||
+      if (!variable.systematic_futures_.empty() ||
           !result.raw_detvar_hists_.empty()) {
-        log::info("VariableProcessor::process",
+        log::info("VariableProcessor::finalise",
                   "Computing systematic covariances");
-        // systematics_processor_.processSystematics(result);
+        // systematics_processor_.processSystematics(result,
+        //                                           variable.systematic_futures_);
       } else {
-        log::info("VariableProcessor::process",
+        log::info("VariableProcessor::finalise",
                   "No systematics found. Skipping covariance calculation.");
       }
-      systematics_processor_.clearFutures();
 
       AnalysisResult::printSummary(result);
-      region_analysis.addFinalVariable(var_key, std::move(result));
-
-      log::info("VariableProcessor::process", "Variable pipeline concluded (",
-                index + 1, "/", total_vars, "):", var_key.str());
+      region_analysis.addFinalVariable(variable.key_, std::move(result));
     }
+    booking.clear();
   }
 
 private:
+  // Samples with a cache entry are collected on their own so that their
+  // contribution can be stored before it is merged.
+  void finaliseCached(VariableBooking &variable) {
+    auto &result = variable.result_;
+    const auto &entries = variable.cache_entries_;
+    for (auto &[sample_key, processor] : variable.sample_processors_) {
+      auto it = entries.find(sample_key);
+      if (it == entries.end()) {
+        processor->contributeTo(result);
+        continue;
+      }
+      VariableResult part;
+      part.binning_ = result.binning_;
+      processor->contributeTo(part);
+      auto futures = SysProc::selectSamples(
+          variable.systematic_futures_,
+          [&](const SampleKey &key) { return key == sample_key; });
+      SysProc::collectSystematics(part, futures);
+      result_cache_->store(it->second, part);
+      result.merge(part);
+    }
+    auto uncached = SysProc::selectSamples(
+        variable.systematic_futures_,
+        [&](const SampleKey &key) { return entries.count(key) == 0; });
+    SysProc::collectSystematics(result, uncached);
+    for (const auto &part : variable.cached_results_) {
+      result.merge(part);
+    }
+    variable.cached_results_.clear();
+  }
+
+  // Everything besides the sample that decides what a variable fills. The
+  // clauses are what the selection compiler turns into mask bits.
+  std::vector<std::string>
+  cacheKey(const RegionHandle &region_handle, const VariableKey &var_key,
+           const BinningDefinition &binning) const {
+    std::string edges;
+    char buf[32];
+    for (double edge : binning.getEdges()) {
+      std::snprintf(buf, sizeof(buf), "%.17g,", edge);
+      edges += buf;
+    }
+    std::string clauses;
+    for (const auto &clause :
+         analysis_definition_.regionClauses(region_handle.key_))
+      clauses += clause + ";";
+    return {region_handle.selection().str(), clauses,
+            analysis_definition_.variable(var_key).expression(),
+            binning.getVariable(), edges, binning.getStratifierKey().str(),
+            systematics_processor_.hasStrategies()
+                ? systematics_processor_.signature()
+                : std::string()};
+  }
+
+  VariableBooking bookVariable(
+      const RegionHandle &region_handle, const VariableKey &var_key,
+      const std::unordered_map<SampleKey, std::unique_ptr<ISampleProcessor>>
+          &sample_processors,
+      std::unordered_map<SampleKey, ROOT::RDF::RNode> &monte_carlo_nodes) {
+    const auto &variable_handle = analysis_definition_.variable(var_key);
+    const auto &binning = variable_handle.binning();
+    const auto model = binning.toTH1DModel();
+
+    VariableBooking booking;
+    booking.key_ = var_key;
+    booking.result_.binning_ = binning;
+
+    std::vector<std::string> key;
+    if (result_cache_)
+      key = cacheKey(region_handle, var_key, binning);
+
+    for (const auto &entry : sample_processors) {
+      auto signature = sample_signatures_.find(entry.first);
+      if (result_cache_ && signature != sample_signatures_.end()) {
+        key.push_back(signature->second);
+        auto entry_path = result_cache_->entryPath(
+            region_handle.key_.str() + "-" + var_key.str() + "-" +
+                entry.first.str(),
+            key);
+        key.pop_back();
+        if (auto cached = result_cache_->load(entry_path)) {
+          booking.cached_results_.push_back(std::move(*cached));
+          continue;
+        }
+        booking.cache_entries_.emplace(entry.first, std::move(entry_path));
+      }
+      auto processor = entry.second->clone();
+      processor->book(histogram_factory_, binning, model);
+      booking.sample_processors_.emplace(entry.first, std::move(processor));
+    }
+
+    if (systematics_processor_.hasStrategies()) {
+      log::debug("VariableProcessor::bookVariable",
+                 "Registering systematic variations for", var_key.str());
+      for (auto &entry : monte_carlo_nodes) {
+        if (!booking.sample_processors_.count(entry.first))
+          continue;
+        systematics_processor_.bookSystematics(entry.first, entry.second,
+                                               binning, model,
+                                               booking.systematic_futures_);
+      }
+    }
+
+    if (!booking.cached_results_.empty())
+      log::info("VariableProcessor::bookVariable", "Reusing",
+                booking.cached_results_.size(), "cached samples for",
+                var_key.str());
+    return booking;
+  }
+
   AnalysisDefinition &analysis_definition_;
   SysProc &systematics_processor_;
   HistogramFactory &histogram_factory_;
+  bool batch_variables_;
+  const ResultCache *result_cache_{nullptr};
+  std::unordered_map<SampleKey, std::string> sample_signatures_;
 };
 
 } // namespace analysis
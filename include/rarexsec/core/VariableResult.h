@@ -6,11 +6,14 @@
 #include <unordered_map>
 #include <vector>
 
-#include "TMatrixDSym.h"
+#include <Eigen/Dense>
 
 #include <rarexsec/hist/BinnedHistogram.h>
+#include <rarexsec/hist/CovarianceMatrix.h>
+#include <rarexsec/hist/HistogramCounts.h>
 #include <rarexsec/core/AnalysisKey.h>
 #include <rarexsec/data/SampleTypes.h>
+#include <rarexsec/utils/Logger.h>
 
 namespace analysis {
 
@@ -25,13 +28,67 @@ struct VariableResult {
     std::map<SystematicKey, BinnedHistogram> variation_hists_;
     std::map<SystematicKey, BinnedHistogram> transfer_ratio_hists_;
     std::map<SystematicKey, BinnedHistogram> delta_hists_;
-    std::map<SystematicKey, TMatrixDSym> covariance_matrices_;
+    std::map<SystematicKey, CovarianceMatrix> covariance_matrices_;
 
-    TMatrixDSym total_covariance_;
-    TMatrixDSym total_correlation_;
+    CovarianceMatrix total_covariance_;
+    CovarianceMatrix total_correlation_;
     BinnedHistogram nominal_with_band_;
 
-    std::map<SystematicKey, std::vector<BinnedHistogram>> universe_projected_hists_;
+    std::map<SystematicKey, std::vector<HistogramCounts>> universe_projected_hists_;
+
+    // Bin counts of every universe (universes x bins), summed over samples.
+    std::map<SystematicKey, Eigen::MatrixXd> universe_counts_;
+
+    // Adds a partial result filled from a disjoint set of events. Only the
+    // filled histograms and universe counts are additive; covariances and
+    // everything derived from them are dropped and must be recomputed on the
+    // merged result.
+    void merge(const VariableResult &other) {
+        if (binning_.getEdges() != other.binning_.getEdges())
+            log::fatal("VariableResult::merge", "Partial results of", binning_.getVariable(),
+                       "have different binnings; sharded runs need the same fixed binning in every shard");
+
+        data_hist_ += other.data_hist_;
+        total_mc_hist_ += other.total_mc_hist_;
+        mergeHistograms(strat_hists_, other.strat_hists_);
+        for (const auto &[sample_key, variations] : other.raw_detvar_hists_)
+            mergeHistograms(raw_detvar_hists_[sample_key], variations);
+        mergeHistograms(variation_hists_, other.variation_hists_);
+        for (const auto &[key, counts] : other.universe_counts_) {
+            auto [it, inserted] = universe_counts_.try_emplace(key, counts);
+            if (!inserted && !addUniverseCounts(it->second, counts))
+                log::fatal("VariableResult::merge", "Universe counts of", key.str(), "differ in binning");
+        }
+
+        transfer_ratio_hists_.clear();
+        delta_hists_.clear();
+        covariance_matrices_.clear();
+        total_covariance_ = CovarianceMatrix();
+        total_correlation_ = CovarianceMatrix();
+        nominal_with_band_ = BinnedHistogram();
+        universe_projected_hists_.clear();
+    }
+
+    // Adds (universes x bins) counts. Only the universes filled in both are
+    // kept; false if the binnings differ.
+    static bool addUniverseCounts(Eigen::MatrixXd &into, const Eigen::MatrixXd &counts) {
+        if (into.cols() != counts.cols())
+            return false;
+        if (counts.rows() < into.rows())
+            into.conservativeResize(counts.rows(), Eigen::NoChange);
+        into += counts.topRows(into.rows());
+        return true;
+    }
+
+  private:
+    template <typename Key>
+    static void mergeHistograms(std::map<Key, BinnedHistogram> &into, const std::map<Key, BinnedHistogram> &from) {
+        for (const auto &[key, hist] : from) {
+            auto [it, inserted] = into.try_emplace(key, hist);
+            if (!inserted)
+                it->second += hist;
+        }
+    }
 };
 
 }
@@ -1,16 +1,23 @@
 #ifndef ANALYSIS_DATA_LOADER_H
 #define ANALYSIS_DATA_LOADER_H
 
+#include <algorithm>
+#include <cstddef>
 #include <map>
 #include <memory>
+#include <optional>
+#include <set>
 #include <string>
 #include <unordered_map>
 #include <vector>
 
 #include "ROOT/RDataFrame.hxx"
+#include "ROOT/TSeq.hxx"
+#include "ROOT/TThreadExecutor.hxx"
 
 #include <rarexsec/core/AnalysisKey.h>
 #include <rarexsec/data/BlipProcessor.h>
+#include <rarexsec/data/ColumnDependencies.h>
 #include <rarexsec/data/IEventProcessor.h>
 #include <rarexsec/utils/Logger.h>
 #include <rarexsec/data/MuonSelectionProcessor.h>
@@ -18,7 +25,9 @@
 #include <rarexsec/data/PreselectionProcessor.h>
 #include <rarexsec/data/ReconstructionProcessor.h>
 #include <rarexsec/data/RunConfigRegistry.h>
+#include <rarexsec/data/SampleCache.h>
 #include <rarexsec/data/SampleDefinition.h>
+#include <rarexsec/data/ShardSpec.h>
 #include <rarexsec/core/SelectionQuery.h>
 #include <rarexsec/data/TruthChannelProcessor.h>
 #include <rarexsec/data/VariableRegistry.h>
@@ -32,7 +41,8 @@ class AnalysisDataLoader {
 
     AnalysisDataLoader(const RunConfigRegistry &run_config_registry, VariableRegistry variable_registry,
                        const std::string &beam_mode, std::vector<std::string> periods,
-                       const std::string &ntuple_base_dir, bool blind = true)
+                       const std::string &ntuple_base_dir, bool blind = true,
+                       SampleCacheConfig cache_config = {}, ShardSpec shard = {})
         : run_registry_(run_config_registry),
           var_registry_(std::move(variable_registry)),
           ntuple_base_directory_(ntuple_base_dir),
@@ -40,11 +50,43 @@ class AnalysisDataLoader {
           periods_(std::move(periods)),
           blind_(blind),
           total_pot_(0.0),
-          total_triggers_(0) {
+          total_triggers_(0),
+          sample_cache_(std::move(cache_config)),
+          shard_(shard) {
         this->loadAll();
     }
 
-    SampleFrameMap &getSampleFrames() noexcept { return frames_; }
+    // Builds the frames of the selected samples on first use.
+    SampleFrameMap &getSampleFrames() {
+        this->buildPendingSamples();
+        return frames_;
+    }
+
+    // Drops the samples `keep(sample_key, run_config)` rejects before their
+    // frames are built. Later calls can only narrow the selection further.
+    template <typename Predicate> void selectSamples(Predicate keep) {
+        std::size_t dropped = 0;
+        for (auto it = pending_.begin(); it != pending_.end();) {
+            if (keep(it->first, it->second.run_config)) {
+                ++it;
+            } else {
+                it = pending_.erase(it);
+                ++dropped;
+            }
+        }
+        for (auto it = frames_.begin(); it != frames_.end();) {
+            if (keep(it->first, this->getRunConfigForSample(it->first))) {
+                ++it;
+            } else {
+                it = frames_.erase(it);
+                ++dropped;
+            }
+        }
+        if (dropped != 0)
+            log::info("AnalysisDataLoader::selectSamples", "Skipping", dropped,
+                      "samples no region can use");
+    }
+
     double getTotalPot() const noexcept { return total_pot_; }
     long getTotalTriggers() const noexcept { return total_triggers_; }
     const std::string &getBeam() const noexcept { return beam_; }
@@ -57,29 +99,107 @@ class AnalysisDataLoader {
         return nullptr;
     }
 
+    // Declares the derived columns of the processor chain. Every sample runs
+    // the same chain, so the first pipeline is representative.
+    void declareColumns(ColumnDependencyGraph &graph) const {
+        if (!processors_.empty())
+            processors_.front()->declareChainColumns(graph);
+    }
+
+    // Branches of the input event trees, read from the header of each
+    // sample's first file. No frame is built and no event loop runs, so the
+    // requirements can be resolved before the samples are.
+    std::set<std::string> inputBranches() const {
+        std::set<std::string> branches;
+        const auto add = [&branches](const std::vector<InputFile> &files) {
+            if (files.empty())
+                return;
+            for (auto &branch : treeBranches(files.front().path))
+                branches.insert(std::move(branch));
+        };
+        for (const auto &[sample_key, sample_def] : frames_)
+            add(sample_def.inputFiles());
+        for (const auto &[sample_key, pending] : pending_)
+            add(SampleInputs::resolve(ntuple_base_directory_, *pending.sample_json));
+        return branches;
+    }
+
+    // Columns read while the samples are built, i.e. by truth filters.
+    std::vector<std::string> loadingExpressions() const {
+        std::vector<std::string> expressions;
+        for (const auto &[sample_key, sample_def] : frames_) {
+            if (!sample_def.truth_filter_.empty())
+                expressions.push_back(sample_def.truth_filter_);
+        }
+        for (const auto &[sample_key, pending] : pending_) {
+            auto filter = pending.sample_json->value("truth_filter", "");
+            if (!filter.empty())
+                expressions.push_back(std::move(filter));
+        }
+        if (!sample_cache_.config().preselection_.empty())
+            expressions.push_back(sample_cache_.config().preselection_);
+        return expressions;
+    }
+
+    // Columns the processor chains define on the built sample frames
+    // without declaring them. The requirement analysis cannot see what they
+    // are computed from. Samples not built yet are skipped.
+    std::set<std::string> undeclaredColumns(const ColumnDependencyGraph &graph) {
+        std::set<std::string> undeclared;
+        for (auto &[sample_key, sample_def] : frames_) {
+            for (auto &column : sample_def.nominal_node_.GetDefinedColumnNames()) {
+                if (!graph.isDerived(column) && !isExpressionView(column) && !isWidenedColumn(column))
+                    undeclared.insert(std::move(column));
+            }
+        }
+        return undeclared;
+    }
+
+    // Records the columns the analysis needs, for snapshots that ask for
+    // them instead of an explicit column list.
+    void restrictColumns(const ColumnRequirements &req) {
+        const auto &transient = VariableRegistry::transientColumns();
+        required_columns_.clear();
+        for (auto &column : req.columns()) {
+            if (std::find(transient.begin(), transient.end(), column) == transient.end())
+                required_columns_.push_back(std::move(column));
+        }
+    }
+
+    const std::vector<std::string> &requiredColumns() const noexcept { return required_columns_; }
+
+    // Writes every persistent column unless `columns` is given.
     void snapshot(const std::string &filter_expr, const std::string &output_file,
-                  const std::vector<std::string> &columns = {}) const {
+                  const std::vector<std::string> &columns = {}) {
         bool first = true;
         ROOT::RDF::RSnapshotOptions opts;
-        for (auto const &[key, sample] : frames_) {
+        for (auto const &[key, sample] : this->getSampleFrames()) {
             auto df = sample.nominal_node_;
             if (!filter_expr.empty()) {
                 df = df.Filter(filter_expr);
             }
             opts.fMode = first ? "RECREATE" : "UPDATE";
-            df.Snapshot(key.c_str(), output_file, columns, opts);
+            df.Snapshot(key.c_str(), output_file, columns.empty() ? persistentColumns(df) : columns, opts);
             first = false;
         }
     }
 
     void snapshot(const SelectionQuery &query, const std::string &output_file,
-                  const std::vector<std::string> &columns = {}) const {
+                  const std::vector<std::string> &columns = {}) {
         this->snapshot(query.str(), output_file, columns);
     }
 
+    // GENIE mode frequencies summed over every sample's event loops.
+    GenieModeStats genieModeStats() const {
+        GenieModeStats stats;
+        for (const auto *processor : truth_processors_)
+            stats.merge(processor->modeStats());
+        return stats;
+    }
+
     void printAllBranches() {
         log::debug("AnalysisDataLoader::printAllBranches", "Available branches in loaded samples:");
-        for (auto &[sample_key, sample_def] : frames_) {
+        for (auto &[sample_key, sample_def] : this->getSampleFrames()) {
             log::debug("AnalysisDataLoader::printAllBranches", "--- Sample:", sample_key.str(), "---");
             auto branches = sample_def.nominal_node_.GetColumnNames();
             for (const auto &branch : branches) {
@@ -89,6 +209,14 @@ class AnalysisDataLoader {
     }
 
   private:
+    // A sample whose frame has not been built yet. The JSON lives in the run
+    // config registry, which outlives the loader.
+    struct PendingSample {
+        const nlohmann::json *sample_json;
+        const RunConfig *run_config;
+        IEventProcessor *processor;
+    };
+
     const RunConfigRegistry &run_registry_;
     VariableRegistry var_registry_;
     std::string ntuple_base_directory_;
@@ -101,8 +229,13 @@ class AnalysisDataLoader {
     long total_triggers_;
 
     SampleFrameMap frames_;
+    std::map<SampleKey, PendingSample> pending_;
     std::vector<std::unique_ptr<IEventProcessor>> processors_;
     std::unordered_map<SampleKey, const RunConfig *> run_config_cache_;
+    SampleCache sample_cache_;
+    ShardSpec shard_;
+    std::vector<std::string> required_columns_;
+    std::vector<const TruthChannelProcessor *> truth_processors_;
 
     void loadAll() {
         const std::string ext_beam{"numi_ext"};
@@ -143,23 +276,55 @@ class AnalysisDataLoader {
                 continue;
             }
 
+            auto truth_processor = std::make_unique<TruthChannelProcessor>();
+            truth_processors_.push_back(truth_processor.get());
+
             auto pipeline = this->chainEventProcessors(
                 std::make_unique<WeightProcessor>(sample_json, total_pot_, total_triggers_),
-                std::make_unique<TruthChannelProcessor>(), std::make_unique<BlipProcessor>(),
+                std::move(truth_processor), std::make_unique<BlipProcessor>(),
                   std::make_unique<MuonSelectionProcessor>(),
                   std::make_unique<ReconstructionProcessor>(),
                   std::make_unique<PreselectionProcessor>(),
                   std::make_unique<NuMuCCSelectionProcessor>());
             processors_.push_back(std::move(pipeline));
 
-            auto &proc = *processors_.back();
+            SampleKey sample_key{sample_json.at("sample_key").get<std::string>()};
+            run_config_cache_.emplace(sample_key, &rc);
+            pending_.emplace(std::move(sample_key), PendingSample{&sample_json, &rc, processors_.back().get()});
+        }
+    }
 
-            SampleDefinition sample{sample_json, rc.samples, ntuple_base_directory_, var_registry_, proc};
+    // Opening the files and attaching the processor chain dominates start-up,
+    // so samples are built concurrently on the implicit-MT pool. Each sample
+    // owns its chain; the shared state they touch is synchronised. A cache
+    // that may write runs a Snapshot event loop per sample; started from
+    // pool tasks those loops would nest and oversubscribe the pool, so such
+    // builds stay sequential.
+    void buildPendingSamples() {
+        if (pending_.empty())
+            return;
 
-            run_config_cache_.emplace(sample.sample_key_, &rc);
+        std::vector<std::pair<SampleKey, PendingSample>> work(pending_.begin(), pending_.end());
+        pending_.clear();
+        log::info("AnalysisDataLoader::buildPendingSamples", "Building", work.size(), "sample frames");
 
-            frames_.emplace(sample.sample_key_, std::move(sample));
+        std::vector<std::optional<SampleDefinition>> built(work.size());
+        const auto build = [&](std::size_t i) {
+            const auto &pending = work[i].second;
+            built[i].emplace(*pending.sample_json, pending.run_config->samples, ntuple_base_directory_, var_registry_,
+                             *pending.processor, &sample_cache_, shard_);
+        };
+        const bool cache_writes = sample_cache_.enabled() && sample_cache_.config().write_;
+        if (ROOT::IsImplicitMTEnabled() && work.size() > 1 && !cache_writes) {
+            ROOT::TThreadExecutor pool;
+            pool.Foreach([&](unsigned i) { build(i); }, ROOT::TSeqU(static_cast<unsigned>(work.size())));
+        } else {
+            for (std::size_t i = 0; i < work.size(); ++i)
+                build(i);
         }
+
+        for (std::size_t i = 0; i < work.size(); ++i)
+            frames_.emplace(work[i].first, std::move(*built[i]));
     }
 
     template <typename Head, typename... Tail>
@@ -4,40 +4,59 @@
 #include <rarexsec/data/IEventProcessor.h>
 #include "ROOT/RVec.hxx"
 #include <cmath>
+#include <cstddef>
+#include <memory>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 namespace analysis {
 
+// Stratifier code of a Geant4 creator process, -1 when unclassified.
+inline int blipProcessCode(const std::string &p) {
+    if (p == "null" || p.empty())
+        return 0;
+    if (p == "muMinusCaptureAtRest")
+        return 1;
+    if (p == "nCapture")
+        return 2;
+    if (p == "neutronInelastic")
+        return 3;
+    if (p == "compt" || p == "phot" || p == "conv")
+        return 4;
+    if (p == "eIoni" || p == "eBrem")
+        return 5;
+    if (p == "muIoni")
+        return 6;
+    if (p == "hIoni")
+        return 7;
+    return -1;
+}
+
+// Distance of each blip to the vertex. The loop vectorises when built with
+// -fno-math-errno, as the top-level CMakeLists.txt does.
+inline void blipDistances(const float *bx, const float *by, const float *bz, std::size_t n, float vx, float vy,
+                          float vz, float *out) {
+    for (std::size_t i = 0; i < n; ++i) {
+        const float dx = bx[i] - vx;
+        const float dy = by[i] - vy;
+        const float dz = bz[i] - vz;
+        out[i] = std::sqrt(dx * dx + dy * dy + dz * dz);
+    }
+}
+
 class BlipProcessor : public IEventProcessor {
   public:
     ROOT::RDF::RNode process(ROOT::RDF::RNode df, SampleOrigin st) const override {
-        auto proc_df = df.Define("blip_process_code",
-                                 [](const ROOT::RVec<std::string> &processes) {
-                                     ROOT::RVec<int> codes(processes.size());
-                                     for (size_t i = 0; i < processes.size(); ++i) {
-                                         const auto &p = processes[i];
-                                         int code = -1;
-                                         if (p == "null" || p.empty())
-                                             code = 0;
-                                         else if (p == "muMinusCaptureAtRest")
-                                             code = 1;
-                                         else if (p == "nCapture")
-                                             code = 2;
-                                         else if (p == "neutronInelastic")
-                                             code = 3;
-                                         else if (p == "compt" || p == "phot" || p == "conv")
-                                             code = 4;
-                                         else if (p == "eIoni" || p == "eBrem")
-                                             code = 5;
-                                         else if (p == "muIoni")
-                                             code = 6;
-                                         else if (p == "hIoni")
-                                             code = 7;
-                                         codes[i] = code;
-                                     }
-                                     return codes;
-                                 },
-                                 {"blip_process"});
+        // Per-slot interning tables shared by the column lambdas; the columns
+        // themselves own their values.
+        auto slots = std::make_shared<std::vector<ProcessInterner>>(df.GetNSlots());
+
+        auto proc_df = df.DefineSlot("blip_process_code",
+                                     [slots](unsigned slot, const ROOT::RVec<std::string> &processes) {
+                                         return (*slots)[slot].codes(processes);
+                                     },
+                                     {"blip_process"});
 
         if (proc_df.HasColumn("neutrino_vertex_x")) {
             proc_df = proc_df.Define(
@@ -45,12 +64,7 @@ class BlipProcessor : public IEventProcessor {
                 [](const ROOT::RVec<float> &bx, const ROOT::RVec<float> &by, const ROOT::RVec<float> &bz, float vx,
                    float vy, float vz) {
                     ROOT::RVec<float> dists(bx.size());
-                    for (size_t i = 0; i < bx.size(); ++i) {
-                        float dx = bx[i] - vx;
-                        float dy = by[i] - vy;
-                        float dz = bz[i] - vz;
-                        dists[i] = std::sqrt(dx * dx + dy * dy + dz * dz);
-                    }
+                    blipDistances(bx.data(), by.data(), bz.data(), bx.size(), vx, vy, vz, dists.data());
                     return dists;
                 },
                 {"blip_x", "blip_y", "blip_z", "neutrino_vertex_x", "neutrino_vertex_y", "neutrino_vertex_z"});
@@ -62,6 +76,42 @@ class BlipProcessor : public IEventProcessor {
 
         return next_ ? next_->process(proc_df, st) : proc_df;
     }
+
+    void declareColumns(ColumnDependencyGraph &graph) const override {
+        graph.declare("blip_process_code", {"blip_process"});
+        graph.declare("blip_distance_to_vertex", {"blip_x", "blip_y", "blip_z", "neutrino_vertex_x",
+                                                  "neutrino_vertex_y", "neutrino_vertex_z"});
+    }
+
+    // Classifies each distinct process name once per slot. Blips of one event
+    // mostly repeat the previous name, which skips the hash lookup.
+    class ProcessInterner {
+      public:
+        int intern(const std::string &process) {
+            if (has_last_ && process == last_)
+                return last_code_;
+            auto it = seen_.find(process);
+            if (it == seen_.end())
+                it = seen_.emplace(process, blipProcessCode(process)).first;
+            last_ = process;
+            last_code_ = it->second;
+            has_last_ = true;
+            return last_code_;
+        }
+
+        ROOT::RVec<int> codes(const ROOT::RVec<std::string> &processes) {
+            ROOT::RVec<int> out(processes.size());
+            for (std::size_t i = 0; i < processes.size(); ++i)
+                out[i] = this->intern(processes[i]);
+            return out;
+        }
+
+      private:
+        std::unordered_map<std::string, int> seen_;
+        std::string last_;
+        int last_code_ = 0;
+        bool has_last_ = false;
+    };
 };
 
 }
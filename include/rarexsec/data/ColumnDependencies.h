@@ -0,0 +1,174 @@
+#ifndef COLUMN_DEPENDENCIES_H
+#define COLUMN_DEPENDENCIES_H
+
+#include <cctype>
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace analysis {
+
+struct ColumnRequirements {
+    // Branches that have to be read from the input trees.
+    std::set<std::string> inputs;
+    // Processor outputs the analysis consumes, directly or indirectly.
+    std::set<std::string> derived;
+    // Referenced by the analysis but neither derived nor present in the input.
+    std::set<std::string> unknown;
+
+    std::vector<std::string> columns() const {
+        std::vector<std::string> out(inputs.begin(), inputs.end());
+        out.insert(out.end(), derived.begin(), derived.end());
+        return out;
+    }
+};
+
+// Records which columns each derived column is computed from, so that the set
+// of input branches an analysis actually needs can be worked out before any
+// event is read.
+class ColumnDependencyGraph {
+  public:
+    // Attributes the following declarations to `owner`, normally the
+    // declaring processor.
+    void setOwner(std::string owner) { owner_ = std::move(owner); }
+
+    void declare(const std::string &output, const std::vector<std::string> &inputs) {
+        auto &deps = definitions_[output];
+        deps.insert(inputs.begin(), inputs.end());
+        if (!owner_.empty())
+            owners_[output].insert(owner_);
+    }
+
+    void declareExpression(const std::string &output, const std::string &expression) {
+        this->declare(output, identifiers(expression));
+    }
+
+    bool isDerived(const std::string &column) const { return definitions_.count(column) != 0; }
+
+    const std::map<std::string, std::set<std::string>> &definitions() const { return definitions_; }
+
+    // Columns declared by more than one owner, with their owners. The chain
+    // evaluates each of them once; the first processor to run defines it.
+    std::map<std::string, std::set<std::string>> shared() const {
+        std::map<std::string, std::set<std::string>> out;
+        for (const auto &[column, owners] : owners_) {
+            if (owners.size() > 1)
+                out.emplace(column, owners);
+        }
+        return out;
+    }
+
+    // Declared columns that the requirements never reach. Being lazy, the
+    // event loop does not compute them; they only cost when whole frames are
+    // written out.
+    std::set<std::string> unused(const ColumnRequirements &req) const {
+        std::set<std::string> out;
+        for (const auto &kv : definitions_) {
+            if (!req.derived.count(kv.first))
+                out.insert(kv.first);
+        }
+        return out;
+    }
+
+    // Closes `seeds` over the declared definitions. Inputs of derived columns
+    // that are absent from `available` are fallbacks for other file layouts
+    // and are dropped silently; absent seeds are reported as unknown. An empty
+    // `available` accepts every input.
+    ColumnRequirements resolve(const std::set<std::string> &seeds, const std::set<std::string> &available = {}) const {
+        ColumnRequirements req;
+        std::set<std::string> visited;
+        for (const auto &seed : seeds) {
+            if (!this->isDerived(seed) && !available.empty() && !available.count(seed)) {
+                req.unknown.insert(seed);
+                continue;
+            }
+            this->visit(seed, available, visited, req);
+        }
+        return req;
+    }
+
+    // Identifiers in a JIT expression that may name columns. Function names,
+    // namespace qualifiers, member accesses, literals and keywords are skipped.
+    static std::vector<std::string> identifiers(const std::string &expression) {
+        static const std::set<std::string> keywords = {
+            "true",  "false", "and",    "or",       "not",         "static_cast", "const", "auto",
+            "int",   "float", "double", "unsigned", "long",        "short",       "bool",  "char",
+            "size_t", "return", "if",   "else",     "ULong64_t",   "Long64_t",    "UInt_t", "Int_t"};
+
+        std::vector<std::string> out;
+        const auto n = expression.size();
+        std::size_t i = 0;
+        while (i < n) {
+            const char c = expression[i];
+            if (c == '"' || c == '\'') {
+                const char quote = c;
+                for (++i; i < n && expression[i] != quote; ++i) {
+                    if (expression[i] == '\\')
+                        ++i;
+                }
+                ++i;
+            } else if (std::isdigit(static_cast<unsigned char>(c))) {
+                while (i < n && (std::isalnum(static_cast<unsigned char>(expression[i])) || expression[i] == '.' ||
+                                 expression[i] == '_'))
+                    ++i;
+            } else if (std::isalpha(static_cast<unsigned char>(c)) || c == '_') {
+                const auto begin = i;
+                while (i < n && (std::isalnum(static_cast<unsigned char>(expression[i])) || expression[i] == '_'))
+                    ++i;
+                auto token = expression.substr(begin, i - begin);
+
+                auto prev = begin;
+                while (prev > 0 && std::isspace(static_cast<unsigned char>(expression[prev - 1])))
+                    --prev;
+                const bool member = prev > 0 && (expression[prev - 1] == '.' ||
+                                                 (prev > 1 && expression[prev - 1] == ':' && expression[prev - 2] == ':') ||
+                                                 (prev > 1 && expression[prev - 1] == '>' && expression[prev - 2] == '-'));
+                auto next = i;
+                while (next < n && std::isspace(static_cast<unsigned char>(expression[next])))
+                    ++next;
+                const bool call_or_scope =
+                    next < n && (expression[next] == '(' ||
+                                 (expression[next] == ':' && next + 1 < n && expression[next + 1] == ':'));
+
+                if (!member && !call_or_scope && !keywords.count(token))
+                    out.push_back(std::move(token));
+            } else {
+                ++i;
+            }
+        }
+        return out;
+    }
+
+  private:
+    void visit(const std::string &column, const std::set<std::string> &available, std::set<std::string> &visited,
+               ColumnRequirements &req) const {
+        if (!visited.insert(column).second)
+            return;
+        auto it = definitions_.find(column);
+        if (it == definitions_.end()) {
+            if (available.empty() || available.count(column))
+                req.inputs.insert(column);
+            return;
+        }
+        req.derived.insert(column);
+        for (const auto &input : it->second) {
+            // Redefinitions such as "software_trigger != 0" read the raw branch.
+            if (input == column) {
+                if (available.empty() || available.count(column))
+                    req.inputs.insert(column);
+                continue;
+            }
+            this->visit(input, available, visited, req);
+        }
+    }
+
+    std::map<std::string, std::set<std::string>> definitions_;
+    std::map<std::string, std::set<std::string>> owners_;
+    std::string owner_;
+};
+
+}
+
+#endif
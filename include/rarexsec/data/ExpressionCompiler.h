@@ -0,0 +1,596 @@
+#ifndef EXPRESSION_COMPILER_H
+#define EXPRESSION_COMPILER_H
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "ROOT/RDataFrame.hxx"
+
+#include <rarexsec/utils/Logger.h>
+
+namespace analysis {
+
+// Selection expression lowered to postfix code over the numeric values of its
+// columns. One expression may have several outputs sharing one column table.
+class CompiledExpression {
+  public:
+    enum class Op : std::uint8_t { kColumn, kConst, kNot, kNeg, kAdd, kSub, kMul, kLt, kLe, kGt, kGe, kEq, kNe, kAnd, kOr };
+
+    struct Instr {
+        Op op;
+        std::uint32_t column;
+        double value;
+    };
+
+    static constexpr std::size_t kMaxDepth = 32;
+
+    const std::vector<std::string> &columns() const { return columns_; }
+
+    std::size_t outputs() const { return code_.size(); }
+
+    // True when the first output is a comparison or logical operation, i.e.
+    // JIT would have typed it as bool.
+    bool boolean() const { return !code_.empty() && isBooleanOp(code_.front().back().op); }
+
+    double evaluate(std::size_t output, const double *values) const {
+        double stack[kMaxDepth];
+        std::size_t top = 0;
+        for (const auto &in : code_[output]) {
+            switch (in.op) {
+            case Op::kColumn:
+                stack[top++] = values[in.column];
+                break;
+            case Op::kConst:
+                stack[top++] = in.value;
+                break;
+            case Op::kNot:
+                stack[top - 1] = stack[top - 1] == 0.0;
+                break;
+            case Op::kNeg:
+                stack[top - 1] = -stack[top - 1];
+                break;
+            default: {
+                const double b = stack[--top];
+                double &a = stack[top - 1];
+                a = binary(in.op, a, b);
+            }
+            }
+        }
+        return stack[0];
+    }
+
+  private:
+    friend class ExpressionParser;
+
+    static bool isBooleanOp(Op op) { return op == Op::kNot || (op >= Op::kLt && op <= Op::kOr); }
+
+    static double binary(Op op, double a, double b) {
+        switch (op) {
+        case Op::kAdd:
+            return a + b;
+        case Op::kSub:
+            return a - b;
+        case Op::kMul:
+            return a * b;
+        case Op::kLt:
+            return a < b;
+        case Op::kLe:
+            return a <= b;
+        case Op::kGt:
+            return a > b;
+        case Op::kGe:
+            return a >= b;
+        case Op::kEq:
+            return a == b;
+        case Op::kNe:
+            return a != b;
+        case Op::kAnd:
+            return a != 0.0 && b != 0.0;
+        case Op::kOr:
+            return a != 0.0 || b != 0.0;
+        default:
+            return 0.0;
+        }
+    }
+
+    std::vector<std::string> columns_;
+    std::vector<std::vector<Instr>> code_;
+};
+
+// Recursive-descent parser for the selection grammar: column names, numeric
+// and boolean literals, parentheses, `!`, unary `-`, `+ - *`, comparisons and
+// `&& ||`. Anything else (calls, indexing, members, ternaries, division) is
+// rejected so that the expression is left to JIT with its C++ semantics.
+class ExpressionParser {
+  public:
+    explicit ExpressionParser(CompiledExpression &target) : target_(target) {}
+
+    bool parse(const std::string &expression) {
+        src_ = &expression;
+        pos_ = 0;
+        depth_ = 0;
+        max_depth_ = 0;
+        code_.clear();
+        if (!this->parseOr())
+            return false;
+        this->skipSpace();
+        if (pos_ != src_->size() || max_depth_ > CompiledExpression::kMaxDepth)
+            return false;
+        target_.code_.push_back(std::move(code_));
+        return true;
+    }
+
+  private:
+    using Op = CompiledExpression::Op;
+
+    void skipSpace() {
+        while (pos_ < src_->size() && std::isspace(static_cast<unsigned char>((*src_)[pos_])))
+            ++pos_;
+    }
+
+    bool accept(const char *token) {
+        this->skipSpace();
+        const std::size_t n = std::char_traits<char>::length(token);
+        if (src_->compare(pos_, n, token) != 0)
+            return false;
+        // Keep "<" from matching the start of "<=" and "&" from matching "&&".
+        const char next = pos_ + n < src_->size() ? (*src_)[pos_ + n] : '\0';
+        if (n == 1 && (next == '=' || next == token[0]))
+            return false;
+        if (std::isalpha(static_cast<unsigned char>(token[0])) &&
+            (std::isalnum(static_cast<unsigned char>(next)) || next == '_'))
+            return false;
+        pos_ += n;
+        return true;
+    }
+
+    void emit(Op op, std::uint32_t column = 0, double value = 0.0) {
+        code_.push_back({op, column, value});
+        if (op == Op::kColumn || op == Op::kConst)
+            max_depth_ = std::max(max_depth_, ++depth_);
+        else if (op != Op::kNot && op != Op::kNeg)
+            --depth_;
+    }
+
+    bool parseOr() {
+        if (!this->parseAnd())
+            return false;
+        while (this->accept("||") || this->accept("or")) {
+            if (!this->parseAnd())
+                return false;
+            this->emit(Op::kOr);
+        }
+        return true;
+    }
+
+    bool parseAnd() {
+        if (!this->parseEquality())
+            return false;
+        while (this->accept("&&") || this->accept("and")) {
+            if (!this->parseEquality())
+                return false;
+            this->emit(Op::kAnd);
+        }
+        return true;
+    }
+
+    bool parseEquality() {
+        if (!this->parseRelational())
+            return false;
+        for (;;) {
+            Op op;
+            if (this->accept("=="))
+                op = Op::kEq;
+            else if (this->accept("!="))
+                op = Op::kNe;
+            else
+                return true;
+            if (!this->parseRelational())
+                return false;
+            this->emit(op);
+        }
+    }
+
+    bool parseRelational() {
+        if (!this->parseAdditive())
+            return false;
+        for (;;) {
+            Op op;
+            if (this->accept("<="))
+                op = Op::kLe;
+            else if (this->accept(">="))
+                op = Op::kGe;
+            else if (this->accept("<"))
+                op = Op::kLt;
+            else if (this->accept(">"))
+                op = Op::kGt;
+            else
+                return true;
+            if (!this->parseAdditive())
+                return false;
+            this->emit(op);
+        }
+    }
+
+    bool parseAdditive() {
+        if (!this->parseMultiplicative())
+            return false;
+        for (;;) {
+            Op op;
+            if (this->accept("+"))
+                op = Op::kAdd;
+            else if (this->accept("-"))
+                op = Op::kSub;
+            else
+                return true;
+            if (!this->parseMultiplicative())
+                return false;
+            this->emit(op);
+        }
+    }
+
+    bool parseMultiplicative() {
+        if (!this->parseUnary())
+            return false;
+        while (this->accept("*")) {
+            if (!this->parseUnary())
+                return false;
+            this->emit(Op::kMul);
+        }
+        return true;
+    }
+
+    bool parseUnary() {
+        if (this->accept("!") || this->accept("not")) {
+            if (!this->parseUnary())
+                return false;
+            this->emit(Op::kNot);
+            return true;
+        }
+        if (this->accept("-")) {
+            if (!this->parseUnary())
+                return false;
+            this->emit(Op::kNeg);
+            return true;
+        }
+        if (this->accept("+"))
+            return this->parseUnary();
+        return this->parsePrimary();
+    }
+
+    bool parsePrimary() {
+        this->skipSpace();
+        if (pos_ >= src_->size())
+            return false;
+        const char c = (*src_)[pos_];
+        if (c == '(') {
+            ++pos_;
+            if (!this->parseOr())
+                return false;
+            this->skipSpace();
+            if (pos_ >= src_->size() || (*src_)[pos_] != ')')
+                return false;
+            ++pos_;
+            return true;
+        }
+        if (std::isdigit(static_cast<unsigned char>(c)) || c == '.')
+            return this->parseNumber();
+        if (std::isalpha(static_cast<unsigned char>(c)) || c == '_')
+            return this->parseIdentifier();
+        return false;
+    }
+
+    bool parseNumber() {
+        const char *begin = src_->c_str() + pos_;
+        char *end = nullptr;
+        double value = std::strtod(begin, &end);
+        if (end == begin)
+            return false;
+        pos_ += static_cast<std::size_t>(end - begin);
+        bool is_float = false;
+        while (pos_ < src_->size() && std::isalpha(static_cast<unsigned char>((*src_)[pos_]))) {
+            const char s = static_cast<char>(std::tolower(static_cast<unsigned char>((*src_)[pos_])));
+            if (s == 'f')
+                is_float = true;
+            else if (s != 'u' && s != 'l')
+                return false;
+            ++pos_;
+        }
+        // Hexadecimal and octal literals are left to JIT.
+        if (*begin == '0' && end - begin > 1 && begin[1] != '.' && begin[1] != 'e' && begin[1] != 'E')
+            return false;
+        if (is_float)
+            value = static_cast<float>(value);
+        this->emit(Op::kConst, 0, value);
+        return true;
+    }
+
+    bool parseIdentifier() {
+        const auto begin = pos_;
+        while (pos_ < src_->size() &&
+               (std::isalnum(static_cast<unsigned char>((*src_)[pos_])) || (*src_)[pos_] == '_'))
+            ++pos_;
+        const auto name = src_->substr(begin, pos_ - begin);
+
+        this->skipSpace();
+        if (pos_ < src_->size()) {
+            const char next = (*src_)[pos_];
+            if (next == '(' || next == '[' || next == '.' || next == ':' ||
+                (next == '-' && pos_ + 1 < src_->size() && (*src_)[pos_ + 1] == '>'))
+                return false;
+        }
+
+        if (name == "true" || name == "false") {
+            this->emit(Op::kConst, 0, name == "true" ? 1.0 : 0.0);
+            return true;
+        }
+
+        auto &columns = target_.columns_;
+        auto it = std::find(columns.begin(), columns.end(), name);
+        if (it == columns.end())
+            it = columns.insert(columns.end(), name);
+        this->emit(Op::kColumn, static_cast<std::uint32_t>(it - columns.begin()));
+        return true;
+    }
+
+    CompiledExpression &target_;
+    const std::string *src_ = nullptr;
+    std::size_t pos_ = 0;
+    std::size_t depth_ = 0;
+    std::size_t max_depth_ = 0;
+    std::vector<CompiledExpression::Instr> code_;
+};
+
+struct ExpressionStats {
+    // Filters and definitions served by typed closures instead of JIT.
+    long compiled = 0;
+    // Of those, how many reused an expression parsed earlier.
+    long reused = 0;
+    // Expressions outside the grammar, left to JIT.
+    long jitted = 0;
+    double parse_seconds = 0.0;
+};
+
+// Front end for the string expressions the analysis attaches to its frames.
+// Expressions within the selection grammar are parsed once per process and
+// evaluated by typed closures over the numeric values of their columns, so
+// Cling never sees them; the rest go to JIT unchanged.
+class ExpressionCompiler {
+  public:
+    static constexpr std::size_t kMaxColumns = 16;
+
+    // Prefix of the per-frame numeric views of the columns read by compiled
+    // expressions. They are implementation details and are never written.
+    static constexpr const char *kViewPrefix = "_expr_";
+
+    static ExpressionCompiler &instance() {
+        static ExpressionCompiler compiler;
+        return compiler;
+    }
+
+    // Parses the expressions into one program, or returns null when any of
+    // them is outside the grammar.
+    std::shared_ptr<const CompiledExpression> compile(const std::vector<std::string> &expressions) {
+        std::string key;
+        for (const auto &expression : expressions)
+            key += expression + '\n';
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = cache_.find(key);
+        if (it != cache_.end()) {
+            if (it->second)
+                ++stats_.reused;
+            return it->second;
+        }
+
+        const auto start = std::chrono::steady_clock::now();
+        auto program = std::make_shared<CompiledExpression>();
+        ExpressionParser parser(*program);
+        bool ok = true;
+        for (const auto &expression : expressions)
+            ok = ok && parser.parse(expression);
+        if (ok && program->columns().size() > kMaxColumns)
+            ok = false;
+        stats_.parse_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        std::shared_ptr<const CompiledExpression> result;
+        if (ok)
+            result = std::move(program);
+        else
+            log::debug("ExpressionCompiler::compile", "Leaving expression to JIT:", key);
+        cache_.emplace(std::move(key), result);
+        return result;
+    }
+
+    // Within the grammar an expression only reads columns and does arithmetic
+    // and comparisons, so it is safe to evaluate on any event.
+    bool compilable(const std::string &expression) { return this->compile({expression}) != nullptr; }
+
+    ROOT::RDF::RNode filter(ROOT::RDF::RNode df, const std::string &expression) {
+        auto program = this->compile({expression});
+        if (!program || !this->defineViews(df, *program)) {
+            this->jitted();
+            return df.Filter(expression);
+        }
+        this->compiled();
+        return withArity(program->columns().size(), [&](auto seq) {
+            return filterWith(df, [program](const double *v) { return program->evaluate(0, v) != 0.0; },
+                              viewNames(*program), seq);
+        });
+    }
+
+    // Defines a boolean column. Arithmetic expressions keep their JIT type.
+    ROOT::RDF::RNode define(ROOT::RDF::RNode df, const std::string &name, const std::string &expression) {
+        auto program = this->compile({expression});
+        if (!program || !program->boolean() || !this->defineViews(df, *program)) {
+            this->jitted();
+            return df.Define(name, expression);
+        }
+        this->compiled();
+        return withArity(program->columns().size(), [&](auto seq) {
+            return defineWith(df, name, [program](const double *v) { return program->evaluate(0, v) != 0.0; },
+                              viewNames(*program), seq, false);
+        });
+    }
+
+    // Defines `name` as a word with bit i set when clause i holds, or returns
+    // false when the clauses cannot be compiled together.
+    bool defineMask(ROOT::RDF::RNode &df, const std::string &name, const std::vector<std::string> &clauses,
+                    bool redefine) {
+        auto program = this->compile(clauses);
+        if (!program || program->outputs() > 64 || !this->defineViews(df, *program))
+            return false;
+        this->compiled();
+        df = withArity(program->columns().size(), [&](auto seq) {
+            return defineWith(df, name,
+                              [program](const double *v) {
+                                  ULong64_t mask = 0;
+                                  for (std::size_t i = 0; i < program->outputs(); ++i) {
+                                      if (program->evaluate(i, v) != 0.0)
+                                          mask |= ULong64_t{1} << i;
+                                  }
+                                  return mask;
+                              },
+                              viewNames(*program), seq, redefine);
+        });
+        return true;
+    }
+
+    ExpressionStats stats() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return stats_;
+    }
+
+    void report() const {
+        const auto s = this->stats();
+        if (s.compiled == 0 && s.jitted == 0)
+            return;
+        log::info("ExpressionCompiler::report", "Compiled", s.compiled, "expressions without JIT (", s.reused,
+                  "reused ) in", s.parse_seconds, "s;", s.jitted, "left to JIT");
+    }
+
+  private:
+    ExpressionCompiler() = default;
+
+    template <std::size_t> using Double = double;
+
+    void compiled() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++stats_.compiled;
+    }
+
+    void jitted() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++stats_.jitted;
+    }
+
+    static std::vector<std::string> viewNames(const CompiledExpression &program) {
+        std::vector<std::string> names;
+        for (const auto &column : program.columns())
+            names.push_back(kViewPrefix + column);
+        return names;
+    }
+
+    template <typename T> static ROOT::RDF::RNode defineView(ROOT::RDF::RNode df, const std::string &column) {
+        return df.Define(kViewPrefix + column, [](T v) { return static_cast<double>(v); }, {column});
+    }
+
+    // Adds a double view of every column the program reads. Fails for
+    // columns that are missing or not arithmetic scalars, and for unsigned
+    // and 64-bit integers: doubles cannot hold every 64-bit value, and
+    // unsigned arithmetic wraps where doubles go negative, so those columns
+    // stay on the JIT path.
+    bool defineViews(ROOT::RDF::RNode &df, const CompiledExpression &program) const {
+        using Definer = ROOT::RDF::RNode (*)(ROOT::RDF::RNode, const std::string &);
+        static const std::map<std::string, Definer> definers = {
+            {"bool", &defineView<bool>},
+            {"Bool_t", &defineView<bool>},
+            {"char", &defineView<char>},
+            {"Char_t", &defineView<char>},
+            {"unsigned char", &defineView<unsigned char>},
+            {"UChar_t", &defineView<unsigned char>},
+            {"short", &defineView<short>},
+            {"Short_t", &defineView<short>},
+            {"unsigned short", &defineView<unsigned short>},
+            {"UShort_t", &defineView<unsigned short>},
+            {"int", &defineView<int>},
+            {"Int_t", &defineView<int>},
+            {"float", &defineView<float>},
+            {"Float_t", &defineView<float>},
+            {"double", &defineView<double>},
+            {"Double_t", &defineView<double>}};
+
+        std::vector<Definer> pending;
+        for (const auto &column : program.columns()) {
+            if (df.HasColumn(kViewPrefix + column))
+                continue;
+            if (!df.HasColumn(column))
+                return false;
+            auto it = definers.find(df.GetColumnType(column));
+            if (it == definers.end())
+                return false;
+            pending.push_back(it->second);
+        }
+
+        std::size_t next = 0;
+        for (const auto &column : program.columns()) {
+            if (!df.HasColumn(kViewPrefix + column))
+                df = pending[next++](df, column);
+        }
+        return true;
+    }
+
+    template <std::size_t N = 0, typename Apply> static ROOT::RDF::RNode withArity(std::size_t n, Apply &&apply) {
+        if constexpr (N == kMaxColumns) {
+            return apply(std::make_index_sequence<N>{});
+        } else {
+            if (n == N)
+                return apply(std::make_index_sequence<N>{});
+            return withArity<N + 1>(n, std::forward<Apply>(apply));
+        }
+    }
+
+    template <typename Body, std::size_t... I>
+    static ROOT::RDF::RNode filterWith(ROOT::RDF::RNode df, Body body, const std::vector<std::string> &columns,
+                                       std::index_sequence<I...>) {
+        return df.Filter(
+            [body](Double<I>... v) {
+                const double values[] = {v..., 0.0};
+                return body(values);
+            },
+            columns);
+    }
+
+    template <typename Body, std::size_t... I>
+    static ROOT::RDF::RNode defineWith(ROOT::RDF::RNode df, const std::string &name, Body body,
+                                       const std::vector<std::string> &columns, std::index_sequence<I...>,
+                                       bool redefine) {
+        auto fn = [body](Double<I>... v) {
+            const double values[] = {v..., 0.0};
+            return body(values);
+        };
+        return redefine ? df.Redefine(name, fn, columns) : df.Define(name, fn, columns);
+    }
+
+    mutable std::mutex mutex_;
+    std::map<std::string, std::shared_ptr<const CompiledExpression>> cache_;
+    ExpressionStats stats_;
+};
+
+inline bool isExpressionView(const std::string &column) {
+    return column.rfind(ExpressionCompiler::kViewPrefix, 0) == 0;
+}
+
+}
+
+#endif
@@ -2,9 +2,12 @@
 #define IEVENT_PROCESSOR_H
 
 #include <memory>
+#include <string>
+#include <typeinfo>
 
 #include "ROOT/RDataFrame.hxx"
 
+#include <rarexsec/data/ColumnDependencies.h>
 #include <rarexsec/data/SampleTypes.h>
 
 namespace analysis {
@@ -17,6 +20,41 @@ class IEventProcessor {
 
     void chainNextProcessor(std::unique_ptr<IEventProcessor> next) { next_ = std::move(next); }
 
+    // Identifies the processor and any configuration that changes its output.
+    // Processors carrying configuration must override this so that cached
+    // samples are rebuilt when it changes.
+    virtual std::string signature() const { return typeid(*this).name(); }
+
+    // Declares the inputs of every column this processor defines.
+    virtual void declareColumns(ColumnDependencyGraph &) const {}
+
+    void declareChainColumns(ColumnDependencyGraph &graph) const {
+        graph.setOwner(typeid(*this).name());
+        this->declareColumns(graph);
+        if (next_)
+            next_->declareChainColumns(graph);
+    }
+
+    // Processor signatures followed by the declared column definitions, so
+    // that a new derived column or a changed input list invalidates cached
+    // samples even when no processor signature changes.
+    std::string chainSignature() const {
+        ColumnDependencyGraph graph;
+        this->declareChainColumns(graph);
+        auto sig = this->processorSignatures();
+        for (const auto &[column, inputs] : graph.definitions()) {
+            sig += ";" + column + "=";
+            for (const auto &input : inputs)
+                sig += input + ",";
+        }
+        return sig;
+    }
+
+  private:
+    std::string processorSignatures() const {
+        return next_ ? this->signature() + ">" + next_->processorSignatures() : this->signature();
+    }
+
   protected:
     std::unique_ptr<IEventProcessor> next_;
 };
@@ -2,6 +2,8 @@
 #define MUON_SELECTION_PROCESSOR_H
 
 #include <cmath>
+#include <cstddef>
+#include <utility>
 
 #include "ROOT/RVec.hxx"
 
@@ -9,8 +11,30 @@
 
 namespace analysis {
 
+// Features of the selected muon candidates of one event, one array per
+// feature. `mask` flags the selected entries of the input track vectors.
+struct MuonCandidates {
+  ROOT::RVec<bool> mask;
+  ROOT::RVec<float> score;
+  ROOT::RVec<float> llr_pid;
+  ROOT::RVec<float> start_x;
+  ROOT::RVec<float> start_y;
+  ROOT::RVec<float> start_z;
+  ROOT::RVec<float> end_x;
+  ROOT::RVec<float> end_y;
+  ROOT::RVec<float> end_z;
+  ROOT::RVec<float> length;
+  ROOT::RVec<float> distance;
+  ROOT::RVec<unsigned> generation;
+  ROOT::RVec<float> costheta;
+
+  std::size_t size() const { return score.size(); }
+};
+
 class MuonSelectionProcessor : public IEventProcessor {
 public:
+  static constexpr const char *kCandidatesColumn = "muon_candidates";
+
   ROOT::RDF::RNode process(ROOT::RDF::RNode df,
                            SampleOrigin st) const override {
     if (!df.HasColumn("track_shower_scores")) {
@@ -19,112 +43,146 @@ public:
       return next_ ? next_->process(no_mu_df, st) : no_mu_df;
     }
 
-    auto muon_mask_df = this->buildMuonMask(df);
+    auto candidates_df = df.Define(
+        kCandidatesColumn, &MuonSelectionProcessor::selectCandidates,
+        {"track_shower_scores", "trk_llr_pid_v", "track_length",
+         "track_distance_to_vertex", "track_start_x", "track_start_y",
+         "track_start_z", "track_end_x", "track_end_y", "track_end_z",
+         "pfp_generations", "pfp_num_plane_hits_U", "pfp_num_plane_hits_V",
+         "pfp_num_plane_hits_Y", "track_theta"});
 
-    auto muon_features_df = this->extractMuonFeatures(muon_mask_df);
+    auto muon_features_df = this->exposeCandidates(candidates_df);
 
     return next_ ? next_->process(muon_features_df, st) : muon_features_df;
   }
 
+  // Evaluates the candidate requirements and compacts the features of the
+  // selected tracks in the same pass.
+  static MuonCandidates selectCandidates(
+      const ROOT::RVec<float> &scores, const ROOT::RVec<float> &llr,
+      const ROOT::RVec<float> &lengths, const ROOT::RVec<float> &dists,
+      const ROOT::RVec<float> &start_x, const ROOT::RVec<float> &start_y,
+      const ROOT::RVec<float> &start_z, const ROOT::RVec<float> &end_x,
+      const ROOT::RVec<float> &end_y, const ROOT::RVec<float> &end_z,
+      const ROOT::RVec<unsigned> &gens, const ROOT::RVec<int> &hits_u,
+      const ROOT::RVec<int> &hits_v, const ROOT::RVec<int> &hits_y,
+      const ROOT::RVec<float> &theta) {
+    const float min_x = 5.f, max_x = 251.f;
+    const float min_y = -110.f, max_y = 110.f;
+    const float min_z = 20.f, max_z = 986.f;
+
+    const std::size_t n = scores.size();
+    MuonCandidates c;
+    c.mask.resize(n);
+    for (auto *v : {&c.score, &c.llr_pid, &c.start_x, &c.start_y, &c.start_z,
+                    &c.end_x, &c.end_y, &c.end_z, &c.length, &c.distance,
+                    &c.costheta})
+      v->resize(n);
+    c.generation.resize(n);
+
+    std::size_t k = 0;
+    for (std::size_t i = 0; i < n; ++i) {
+      const bool fid_start =
+          (start_x[i] > min_x) & (start_x[i] < max_x) & (start_y[i] > min_y) &
+          (start_y[i] < max_y) & (start_z[i] > min_z) & (start_z[i] < max_z);
+      const bool fid_end =
+          (end_x[i] > min_x) & (end_x[i] < max_x) & (end_y[i] > min_y) &
+          (end_y[i] < max_y) & (end_z[i] > min_z) & (end_z[i] < max_z);
+      const bool keep = (scores[i] > 0.8f) & (llr[i] > 0.2f) &
+                        (lengths[i] > 10.0f) & (dists[i] < 4.0f) &
+                        (gens[i] == 2u) & fid_start & fid_end &
+                        (hits_u[i] > 0) & (hits_v[i] > 0) & (hits_y[i] > 0);
+      c.mask[i] = keep;
+
+      // Every track is written to slot k; only kept ones advance it.
+      c.score[k] = scores[i];
+      c.llr_pid[k] = llr[i];
+      c.start_x[k] = start_x[i];
+      c.start_y[k] = start_y[i];
+      c.start_z[k] = start_z[i];
+      c.end_x[k] = end_x[i];
+      c.end_y[k] = end_y[i];
+      c.end_z[k] = end_z[i];
+      c.length[k] = lengths[i];
+      c.distance[k] = dists[i];
+      c.generation[k] = gens[i];
+      c.costheta[k] = theta[i];
+      k += keep;
+    }
+
+    for (auto *v : {&c.score, &c.llr_pid, &c.start_x, &c.start_y, &c.start_z,
+                    &c.end_x, &c.end_y, &c.end_z, &c.length, &c.distance,
+                    &c.costheta})
+      v->resize(k);
+    c.generation.resize(k);
+    for (auto &ct : c.costheta)
+      ct = std::cos(ct);
+    return c;
+  }
+
+  void declareColumns(ColumnDependencyGraph &graph) const override {
+    graph.declare(kCandidatesColumn,
+                  {"track_shower_scores", "trk_llr_pid_v", "track_length",
+                   "track_distance_to_vertex", "track_start_x",
+                   "track_start_y", "track_start_z", "track_end_x",
+                   "track_end_y", "track_end_z", "pfp_generations",
+                   "pfp_num_plane_hits_U", "pfp_num_plane_hits_V",
+                   "pfp_num_plane_hits_Y", "track_theta"});
+    for (const char *column :
+         {"muon_mask", "muon_trk_score_v", "muon_trk_llr_pid_v",
+          "muon_trk_start_x_v", "muon_trk_start_y_v", "muon_trk_start_z_v",
+          "muon_trk_end_x_v", "muon_trk_end_y_v", "muon_trk_end_z_v",
+          "muon_trk_length_v", "muon_trk_distance_v", "muon_pfp_generation_v",
+          "muon_track_costheta", "n_muons_tot"})
+      graph.declare(column, {kCandidatesColumn});
+    graph.declare("has_muon", {"n_muons_tot"});
+  }
+
 private:
-  ROOT::RDF::RNode buildMuonMask(ROOT::RDF::RNode df) const {
-    return df.Define(
-        "muon_mask",
-        [](const ROOT::RVec<float> &scores, const ROOT::RVec<float> &llr,
-           const ROOT::RVec<float> &lengths, const ROOT::RVec<float> &dists,
-           const ROOT::RVec<float> &start_x, const ROOT::RVec<float> &start_y,
-           const ROOT::RVec<float> &start_z, const ROOT::RVec<float> &end_x,
-           const ROOT::RVec<float> &end_y, const ROOT::RVec<float> &end_z,
-           const ROOT::RVec<unsigned> &gens,
-           const ROOT::RVec<int> &hits_u, const ROOT::RVec<int> &hits_v,
-           const ROOT::RVec<int> &hits_y) {
-          ROOT::RVec<bool> mask(scores.size());
-          const float min_x = 5.f, max_x = 251.f;
-          const float min_y = -110.f, max_y = 110.f;
-          const float min_z = 20.f, max_z = 986.f;
-          for (size_t i = 0; i < scores.size(); ++i) {
-            bool fid_start = start_x[i] > min_x && start_x[i] < max_x &&
-                             start_y[i] > min_y && start_y[i] < max_y &&
-                             start_z[i] > min_z && start_z[i] < max_z;
-           bool fid_end = end_x[i] > min_x && end_x[i] < max_x &&
-                          end_y[i] > min_y && end_y[i] < max_y &&
-                          end_z[i] > min_z && end_z[i] < max_z;
-            mask[i] =
-                (scores[i] > 0.8f && llr[i] > 0.2f && lengths[i] > 10.0f &&
-                 dists[i] < 4.0f && gens[i] == 2u && fid_start && fid_end &&
-                 hits_u[i] > 0 && hits_v[i] > 0 && hits_y[i] > 0);
-          }
-          return mask;
-        },
-        {"track_shower_scores", "trk_llr_pid_v", "track_length",
-         "track_distance_to_vertex", "track_start_x", "track_start_y",
-         "track_start_z", "track_end_x", "track_end_y", "track_end_z",
-         "pfp_generations", "pfp_num_plane_hits_U",
-         "pfp_num_plane_hits_V", "pfp_num_plane_hits_Y"});
+  template <typename T> static ROOT::RVec<T> view(const ROOT::RVec<T> &v) {
+    return ROOT::RVec<T>(const_cast<T *>(v.data()), v.size());
   }
 
-  ROOT::RDF::RNode extractMuonFeatures(ROOT::RDF::RNode df) const {
-    auto filter_float = [](const ROOT::RVec<float> &vals,
-                           const ROOT::RVec<bool> &mask) {
-      ROOT::RVec<float> out;
-      out.reserve(vals.size());
-      for (size_t i = 0; i < vals.size(); ++i) {
-        if (mask[i])
-          out.push_back(vals[i]);
-      }
-      return out;
-    };
-
-    auto filter_uint = [](const ROOT::RVec<unsigned> &vals,
-                          const ROOT::RVec<bool> &mask) {
-      ROOT::RVec<unsigned> out;
-      out.reserve(vals.size());
-      for (size_t i = 0; i < vals.size(); ++i) {
-        if (mask[i])
-          out.push_back(vals[i]);
-      }
-      return out;
-    };
-
-    auto filter_costheta = [](const ROOT::RVec<float> &theta,
-                              const ROOT::RVec<bool> &mask) {
-      ROOT::RVec<float> out;
-      out.reserve(theta.size());
-      for (size_t i = 0; i < theta.size(); ++i) {
-        if (mask[i])
-          out.push_back(std::cos(theta[i]));
-      }
-      return out;
-    };
-
-    auto mu_df = df.Define("muon_trk_score_v", filter_float,
-                           {"track_shower_scores", "muon_mask"})
-                     .Define("muon_trk_llr_pid_v", filter_float,
-                             {"trk_llr_pid_v", "muon_mask"})
-                     .Define("muon_trk_start_x_v", filter_float,
-                             {"track_start_x", "muon_mask"})
-                     .Define("muon_trk_start_y_v", filter_float,
-                             {"track_start_y", "muon_mask"})
-                     .Define("muon_trk_start_z_v", filter_float,
-                             {"track_start_z", "muon_mask"})
-                     .Define("muon_trk_end_x_v", filter_float,
-                             {"track_end_x", "muon_mask"})
-                     .Define("muon_trk_end_y_v", filter_float,
-                             {"track_end_y", "muon_mask"})
-                     .Define("muon_trk_end_z_v", filter_float,
-                             {"track_end_z", "muon_mask"})
-                     .Define("muon_trk_length_v", filter_float,
-                             {"track_length", "muon_mask"})
-                     .Define("muon_trk_distance_v", filter_float,
-                             {"track_distance_to_vertex", "muon_mask"})
-                    .Define("muon_pfp_generation_v", filter_uint,
-                            {"pfp_generations", "muon_mask"})
-                     .Define("muon_track_costheta", filter_costheta,
-                             {"track_theta", "muon_mask"})
-                     .Define("n_muons_tot", "ROOT::VecOps::Sum(muon_mask)")
-                     .Define("has_muon", "n_muons_tot > 0");
-
-    return mu_df;
+  ROOT::RDF::RNode exposeCandidates(ROOT::RDF::RNode df) const {
+    const std::pair<const char *, ROOT::RVec<float> MuonCandidates::*>
+        features[] = {{"muon_trk_score_v", &MuonCandidates::score},
+                      {"muon_trk_llr_pid_v", &MuonCandidates::llr_pid},
+                      {"muon_trk_start_x_v", &MuonCandidates::start_x},
+                      {"muon_trk_start_y_v", &MuonCandidates::start_y},
+                      {"muon_trk_start_z_v", &MuonCandidates::start_z},
+                      {"muon_trk_end_x_v", &MuonCandidates::end_x},
+                      {"muon_trk_end_y_v", &MuonCandidates::end_y},
+                      {"muon_trk_end_z_v", &MuonCandidates::end_z},
+                      {"muon_trk_length_v", &MuonCandidates::length},
+                      {"muon_trk_distance_v", &MuonCandidates::distance},
+                      {"muon_track_costheta", &MuonCandidates::costheta}};
+
+    // The feature columns are non-owning views of the candidates arrays.
+    // RDataFrame evaluates derived columns at the entry of the value they
+    // read, so the views never outlive it and no array is copied.
+    auto mu_df = df.Define(
+        "muon_mask", [](const MuonCandidates &c) { return view(c.mask); },
+        {kCandidatesColumn});
+    for (const auto &[name, member] : features) {
+      mu_df = mu_df.Define(
+          name,
+          [member = member](const MuonCandidates &c) {
+            return view(c.*member);
+          },
+          {kCandidatesColumn});
+    }
+
+    return mu_df
+        .Define("muon_pfp_generation_v",
+                [](const MuonCandidates &c) { return view(c.generation); },
+                {kCandidatesColumn})
+        .Define("n_muons_tot",
+                [](const MuonCandidates &c) {
+                  return static_cast<unsigned long>(c.size());
+                },
+                {kCandidatesColumn})
+        .Define("has_muon", [](unsigned long n) { return n > 0; },
+                {"n_muons_tot"});
   }
 };
 
@@ -1,131 +1,183 @@
 #ifndef NUMU_CC_SELECTION_PROCESSOR_H
 #define NUMU_CC_SELECTION_PROCESSOR_H
 
-#include <string>
+#include <cstdint>
 
 #include <rarexsec/data/IEventProcessor.h>
 
 namespace analysis {
 
-/// Define boolean columns indicating whether an event passes each stage of the
-/// muon-neutrino charged-current selection. Each stage also produces a string
-/// column describing the reason for failure (empty string when the stage is
-/// passed).
+enum class NuMuCCStage : unsigned { kPre = 0, kFlash, kFv, kMu, kTopo, kFinal };
+
+constexpr unsigned kNuMuCCStageCount = 6;
+
+/// Why an event failed a stage. Only decoded to text for reporting.
+enum class NuMuCCReason : std::uint8_t {
+  kNone = 0,
+  kDatasetGate,
+  kSoftwareTrigger,
+  kNSlice,
+  kTopologicalScore,
+  kNPfpsGen2,
+  kX,
+  kY,
+  kZ,
+  kNoMuon,
+  kContainedFraction,
+  kSliceClusterFraction,
+  kPrecondition
+};
+
+/// Packs the outcome of every stage into one word: bit `stage` is set when the
+/// stage passes and the 4 bits at `8 + 4 * stage` hold its failure reason.
+struct NuMuCCSelectionWord {
+  static constexpr unsigned kReasonShift = 8;
+
+  static constexpr std::uint32_t encode(NuMuCCStage stage, NuMuCCReason reason) {
+    const auto s = static_cast<unsigned>(stage);
+    return reason == NuMuCCReason::kNone
+               ? std::uint32_t{1} << s
+               : static_cast<std::uint32_t>(reason) << (kReasonShift + 4 * s);
+  }
+
+  static constexpr bool passes(std::uint32_t word, unsigned stage) {
+    return (word >> stage) & 1U;
+  }
+
+  static constexpr NuMuCCReason reason(std::uint32_t word, unsigned stage) {
+    return static_cast<NuMuCCReason>((word >> (kReasonShift + 4 * stage)) & 0xFU);
+  }
+
+  static const char *reasonName(NuMuCCReason reason) {
+    switch (reason) {
+    case NuMuCCReason::kNone:
+      return "";
+    case NuMuCCReason::kDatasetGate:
+      return "dataset_gate";
+    case NuMuCCReason::kSoftwareTrigger:
+      return "software_trigger";
+    case NuMuCCReason::kNSlice:
+      return "nslice";
+    case NuMuCCReason::kTopologicalScore:
+      return "topological_score";
+    case NuMuCCReason::kNPfpsGen2:
+      return "n_pfps_gen2";
+    case NuMuCCReason::kX:
+      return "x";
+    case NuMuCCReason::kY:
+      return "y";
+    case NuMuCCReason::kZ:
+      return "z";
+    case NuMuCCReason::kNoMuon:
+      return "no_muon";
+    case NuMuCCReason::kContainedFraction:
+      return "contained_fraction";
+    case NuMuCCReason::kSliceClusterFraction:
+      return "slice_cluster_fraction";
+    case NuMuCCReason::kPrecondition:
+      return "precondition";
+    }
+    return "";
+  }
+};
+
+/// Evaluates every stage of the muon-neutrino charged-current selection once
+/// per event into the `numucc_selection` word. The boolean `pass_*` columns
+/// are views of that word; failure reasons stay encoded until reporting.
 class NuMuCCSelectionProcessor : public IEventProcessor {
 public:
+  static constexpr const char *kSelectionColumn = "numucc_selection";
+
   ROOT::RDF::RNode process(ROOT::RDF::RNode df, SampleOrigin st) const override {
-    // Dataset and trigger gates
-    auto pre_df = df.Define(
-        "pass_pre",
-        [st](int bnb, int ext, float pe_beam, float pe_veto, bool swtrig) {
-          // For non-beam data samples (e.g. Monte Carlo or external), the
-          // dataset gate and software trigger do not apply, so we accept all
-          // events. This prevents the preselection from trivially failing
-          // for those samples where the necessary trigger information is
-          // absent or not meaningful.
-          if (st != SampleOrigin::kData)
-            return true;
-
-          bool dataset_gate =
-              (bnb == 0 && ext == 0) ? (pe_beam > 0.f && pe_veto < 20.f) : true;
-          return dataset_gate && swtrig;
+    auto sel_df = df.Define(
+        kSelectionColumn,
+        [st](int bnb, int ext, float pe_beam, float pe_veto, bool swtrig,
+             int nslice, float topo, int n_gen2, float x, float y, float z,
+             unsigned long nmu, float contained, float cluster) {
+          return NuMuCCSelectionProcessor::evaluate(
+              st, bnb, ext, pe_beam, pe_veto, swtrig, nslice, topo, n_gen2, x,
+              y, z, nmu, contained, cluster);
         },
         {"bnbdata", "extdata", "_opfilter_pe_beam", "_opfilter_pe_veto",
-         "software_trigger"});
-
-    // Basic reconstruction checks
-    auto flash_df = pre_df
-        .Define(
-            "pass_flash",
-            [](int nslice, float topo, int n_gen2) {
-              return nslice == 1 && topo > 0.06f && n_gen2 > 1;
-            },
-            {"nslice", "topological_score", "n_pfps_gen2"})
-        .Define(
-            "reason_flash",
-            [](int nslice, float topo, int n_gen2) {
-              if (nslice != 1)
-                return std::string{"nslice"};
-              if (topo <= 0.06f)
-                return std::string{"topological_score"};
-              if (n_gen2 <= 1)
-                return std::string{"n_pfps_gen2"};
-              return std::string{};
-            },
-            {"nslice", "topological_score", "n_pfps_gen2"});
-
-    // Neutrino-vertex fiducial volume
-    auto fv_df = flash_df
-        .Define(
-            "pass_fv",
-            [](float x, float y, float z) {
-              return x > 5.f && x < 251.f && y > -110.f && y < 110.f &&
-                     z > 20.f && z < 986.f && (z < 675.f || z > 775.f);
-            },
-            {"reco_nu_vtx_sce_x", "reco_nu_vtx_sce_y", "reco_nu_vtx_sce_z"})
-        .Define(
-            "reason_fv",
-            [](float x, float y, float z) {
-              if (x <= 5.f || x >= 251.f)
-                return std::string{"x"};
-              if (y <= -110.f || y >= 110.f)
-                return std::string{"y"};
-              if (z <= 20.f || z >= 986.f || (z > 675.f && z < 775.f))
-                return std::string{"z"};
-              return std::string{};
-            },
-            {"reco_nu_vtx_sce_x", "reco_nu_vtx_sce_y", "reco_nu_vtx_sce_z"});
-
-    // Muon candidate requirements
-    auto mu_df = fv_df
-        .Define("pass_mu", "n_muons_tot > 0")
-        .Define("reason_mu",
-                [](unsigned long nmu) {
-                  return nmu > 0 ? std::string{} : std::string{"no_muon"};
-                },
-                {"n_muons_tot"});
-
-    // Slice-level quality requirements
-    auto topo_df = mu_df
-        .Define(
-            "pass_topo",
-            [](float contained, float cluster) {
-              return contained >= 0.7f && cluster >= 0.5f;
-            },
-            {"contained_fraction", "slice_cluster_fraction"})
-        .Define(
-            "reason_topo",
-            [](float contained, float cluster) {
-              if (contained < 0.7f)
-                return std::string{"contained_fraction"};
-              if (cluster < 0.5f)
-                return std::string{"slice_cluster_fraction"};
-              return std::string{};
-            },
-            {"contained_fraction", "slice_cluster_fraction"});
-
-    // Final event pass (all previous stages)
-    auto final_df = topo_df
-        .Define(
-            "pass_final",
-            [](bool pre, bool flash, bool fv, bool mu, bool topo) {
-              return pre && flash && fv && mu && topo;
-            },
-            {"pass_pre", "pass_flash", "pass_fv", "pass_mu", "pass_topo"})
-        .Define(
-            "reason_final",
-            [](bool pre, bool flash, bool fv, bool mu, bool topo) {
-              if (!(pre && flash && fv && mu && topo))
-                return std::string{"precondition"};
-              return std::string{};
-            },
-            {"pass_pre", "pass_flash", "pass_fv", "pass_mu", "pass_topo"});
-
-    return next_ ? next_->process(final_df, st) : final_df;
+         "software_trigger", "nslice", "topological_score", "n_pfps_gen2",
+         "reco_nu_vtx_sce_x", "reco_nu_vtx_sce_y", "reco_nu_vtx_sce_z",
+         "n_muons_tot", "contained_fraction", "slice_cluster_fraction"});
+
+    auto pass_df = sel_df;
+    const char *pass_columns[kNuMuCCStageCount] = {
+        "pass_pre", "pass_flash", "pass_fv", "pass_mu", "pass_topo", "pass_final"};
+    for (unsigned stage = 0; stage < kNuMuCCStageCount; ++stage) {
+      pass_df = pass_df.Define(
+          pass_columns[stage],
+          [stage](std::uint32_t word) {
+            return NuMuCCSelectionWord::passes(word, stage);
+          },
+          {kSelectionColumn});
+    }
+
+    return next_ ? next_->process(pass_df, st) : pass_df;
+  }
+
+  static std::uint32_t evaluate(SampleOrigin st, int bnb, int ext,
+                                float pe_beam, float pe_veto, bool swtrig,
+                                int nslice, float topo, int n_gen2, float x,
+                                float y, float z, unsigned long nmu,
+                                float contained, float cluster) {
+    using R = NuMuCCReason;
+    using S = NuMuCCStage;
+
+    // The dataset gate and software trigger only apply to beam data; other
+    // samples may lack meaningful trigger information.
+    R pre = R::kNone;
+    if (st == SampleOrigin::kData) {
+      const bool dataset_gate =
+          (bnb == 0 && ext == 0) ? (pe_beam > 0.f && pe_veto < 20.f) : true;
+      pre = !dataset_gate ? R::kDatasetGate
+            : !swtrig     ? R::kSoftwareTrigger
+                          : R::kNone;
+    }
+
+    const R flash = nslice != 1       ? R::kNSlice
+                    : !(topo > 0.06f) ? R::kTopologicalScore
+                    : !(n_gen2 > 1)   ? R::kNPfpsGen2
+                                      : R::kNone;
+
+    const bool x_ok = x > 5.f && x < 251.f;
+    const bool y_ok = y > -110.f && y < 110.f;
+    const bool z_ok = z > 20.f && z < 986.f && (z < 675.f || z > 775.f);
+    const R fv = !x_ok ? R::kX : !y_ok ? R::kY : !z_ok ? R::kZ : R::kNone;
+
+    const R mu = nmu > 0 ? R::kNone : R::kNoMuon;
+
+    const R topology = !(contained >= 0.7f) ? R::kContainedFraction
+                       : !(cluster >= 0.5f) ? R::kSliceClusterFraction
+                                            : R::kNone;
+
+    const bool all = pre == R::kNone && flash == R::kNone && fv == R::kNone &&
+                     mu == R::kNone && topology == R::kNone;
+
+    return NuMuCCSelectionWord::encode(S::kPre, pre) |
+           NuMuCCSelectionWord::encode(S::kFlash, flash) |
+           NuMuCCSelectionWord::encode(S::kFv, fv) |
+           NuMuCCSelectionWord::encode(S::kMu, mu) |
+           NuMuCCSelectionWord::encode(S::kTopo, topology) |
+           NuMuCCSelectionWord::encode(S::kFinal,
+                                       all ? R::kNone : R::kPrecondition);
+  }
+
+  void declareColumns(ColumnDependencyGraph &graph) const override {
+    graph.declare(kSelectionColumn,
+                  {"bnbdata", "extdata", "_opfilter_pe_beam",
+                   "_opfilter_pe_veto", "software_trigger", "nslice",
+                   "topological_score", "n_pfps_gen2", "reco_nu_vtx_sce_x",
+                   "reco_nu_vtx_sce_y", "reco_nu_vtx_sce_z", "n_muons_tot",
+                   "contained_fraction", "slice_cluster_fraction"});
+    for (const char *column : {"pass_pre", "pass_flash", "pass_fv", "pass_mu",
+                               "pass_topo", "pass_final"})
+      graph.declare(column, {kSelectionColumn});
   }
 };
 
 } // namespace analysis
 
 #endif
-
@@ -4,6 +4,7 @@
 #include "ROOT/RVec.hxx"
 #include <rarexsec/data/IEventProcessor.h>
 #include <rarexsec/data/SampleTypes.h>
+#include <rarexsec/data/SharedColumns.h>
 
 namespace analysis {
 
@@ -19,41 +20,9 @@ public:
             .Define("reco_nu_vtx_sce_y", "reco_neutrino_vertex_sce_y")
             .Define("reco_nu_vtx_sce_z", "reco_neutrino_vertex_sce_z");
 
-    if (!proc_df.HasColumn("n_pfps_gen2")) {
-      proc_df = proc_df.Define("n_pfps_gen2",
-                               [](const ROOT::RVec<unsigned> &gens) {
-                                 return ROOT::VecOps::Sum(gens == 2u);
-                               },
-                               {"pfp_generations"});
-    }
-
-    if (st == SampleOrigin::kMonteCarlo) {
-      if (proc_df.HasColumn("software_trigger_pre_ext")) {
-        proc_df = proc_df.Define(
-            "software_trigger",
-            [](unsigned run, int pre, int post) {
-              return run < 16880 ? pre > 0 : post > 0;
-            },
-            {"run", "software_trigger_pre_ext", "software_trigger_post_ext"});
-      } else if (proc_df.HasColumn("software_trigger_pre")) {
-        proc_df = proc_df.Define(
-            "software_trigger",
-            [](unsigned run, int pre, int post) {
-              return run < 16880 ? pre > 0 : post > 0;
-            },
-            {"run", "software_trigger_pre", "software_trigger_post"});
-      } else if (proc_df.HasColumn("software_trigger")) {
-        proc_df = proc_df.Redefine("software_trigger", "software_trigger != 0");
-      } else {
-        proc_df = proc_df.Define("software_trigger", []() { return true; });
-      }
-    } else {
-      if (proc_df.HasColumn("software_trigger")) {
-        proc_df = proc_df.Redefine("software_trigger", "software_trigger != 0");
-      } else {
-        proc_df = proc_df.Define("software_trigger", []() { return true; });
-      }
-    }
+    proc_df = defineRecoFiducial(proc_df);
+    proc_df = definePfpGenerationCount(proc_df, "n_pfps_gen2", 2u);
+    proc_df = defineSoftwareTrigger(proc_df, st);
 
     proc_df = proc_df
                   .Define("bnbdata",
@@ -65,20 +34,33 @@ public:
     auto presel_df = proc_df.Define(
         "numu_presel",
         [st](int bnb, int ext, float pe_beam, float pe_veto, int nslice,
-             float topo, int n_gen2, float x, float y, float z) {
+             float topo, int n_gen2, bool fv) {
           bool dataset_gate =
               (bnb == 0 && ext == 0) ? (pe_beam > 0.f && pe_veto < 20.f) : true;
           bool basic_reco = nslice == 1 && topo > 0.06f && n_gen2 > 1;
-          bool fv = x > 5.f && x < 251.f && y > -110.f && y < 110.f &&
-                    z > 20.f && z < 986.f && (z < 675.f || z > 775.f);
           return dataset_gate && basic_reco && fv;
         },
         {"bnbdata", "extdata", "_opfilter_pe_beam", "_opfilter_pe_veto",
-         "nslice", "topological_score", "n_pfps_gen2", "reco_nu_vtx_sce_x",
-         "reco_nu_vtx_sce_y", "reco_nu_vtx_sce_z"});
+         "nslice", "topological_score", "n_pfps_gen2", "in_reco_fiducial"});
 
     return next_ ? next_->process(presel_df, st) : presel_df;
   }
+
+  void declareColumns(ColumnDependencyGraph &graph) const override {
+    graph.declare("nslice", {"num_slices"});
+    graph.declare("_opfilter_pe_beam", {"optical_filter_pe_beam"});
+    graph.declare("_opfilter_pe_veto", {"optical_filter_pe_veto"});
+    graph.declare("reco_nu_vtx_sce_x", {"reco_neutrino_vertex_sce_x"});
+    graph.declare("reco_nu_vtx_sce_y", {"reco_neutrino_vertex_sce_y"});
+    graph.declare("reco_nu_vtx_sce_z", {"reco_neutrino_vertex_sce_z"});
+    declareSharedColumns(graph);
+    graph.declare("bnbdata", {});
+    graph.declare("extdata", {});
+    graph.declare("numu_presel",
+                  {"bnbdata", "extdata", "_opfilter_pe_beam",
+                   "_opfilter_pe_veto", "nslice", "topological_score",
+                   "n_pfps_gen2", "in_reco_fiducial"});
+  }
 };
 
 } // namespace analysis
@@ -0,0 +1,193 @@
+#ifndef SAMPLE_CACHE_H
+#define SAMPLE_CACHE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include "ROOT/RDataFrame.hxx"
+#include <nlohmann/json.hpp>
+
+#include <rarexsec/data/ExpressionCompiler.h>
+#include <rarexsec/data/VariableRegistry.h>
+#include <rarexsec/hist/ColumnDispatch.h>
+#include <rarexsec/utils/Logger.h>
+
+// Digest of the computing headers, set by the build; see CMakeLists.txt.
+#ifndef RAREXSEC_SOURCE_HASH
+#define RAREXSEC_SOURCE_HASH ""
+#endif
+
+namespace analysis {
+
+struct SampleCacheConfig {
+    std::string directory_;
+    // Optional filter applied before writing; part of the cache key.
+    std::string preselection_;
+    std::vector<std::string> dropped_columns_{VariableRegistry::heavyImageVariables()};
+    bool write_{true};
+
+    bool enabled() const noexcept { return !directory_.empty(); }
+
+    // Reads the optional "sample_cache" block of the samples catalog. The
+    // ANALYSIS_SAMPLE_CACHE environment variable overrides its directory.
+    static SampleCacheConfig fromJson(const nlohmann::json &samples) {
+        SampleCacheConfig cfg;
+        if (samples.contains("sample_cache")) {
+            const auto &j = samples.at("sample_cache");
+            cfg.directory_ = j.value("directory", "");
+            cfg.preselection_ = j.value("preselection", "");
+            cfg.write_ = j.value("write", true);
+            if (j.contains("drop_columns"))
+                cfg.dropped_columns_ = j.at("drop_columns").get<std::vector<std::string>>();
+        }
+        if (const char *dir = std::getenv("ANALYSIS_SAMPLE_CACHE"))
+            cfg.directory_ = dir;
+        return cfg;
+    }
+};
+
+// Columns of `df` that can be written out: the in-memory-only columns, such
+// as the muon candidates struct, the expression views and the widened
+// histogram copies, and `dropped` are left out.
+inline std::vector<std::string> persistentColumns(ROOT::RDF::RNode df, const std::vector<std::string> &dropped = {}) {
+    const auto &transient = VariableRegistry::transientColumns();
+    std::vector<std::string> columns;
+    for (const auto &column : df.GetColumnNames()) {
+        if (std::find(dropped.begin(), dropped.end(), column) == dropped.end() &&
+            std::find(transient.begin(), transient.end(), column) == transient.end() && !isExpressionView(column) &&
+            !isWidenedColumn(column))
+            columns.push_back(column);
+    }
+    return columns;
+}
+
+// Persists the processed, column-pruned events of each input file so that a
+// later run can skip the raw tree and the processor chain. Entries are keyed
+// by a hash of the input file identity, the processor chain signature with its
+// declared column definitions, the source digest of the build, and every
+// setting that changes which events or columns are written.
+class SampleCache {
+  public:
+    // Bump whenever the layout of cached files changes. Changes to the code
+    // that computes their content are covered by kSourceHash, and new
+    // derived columns by the chain signature.
+    static constexpr int kFormatVersion = 3;
+    static constexpr const char *kSourceHash = RAREXSEC_SOURCE_HASH;
+    static constexpr const char *kTreeName = "events";
+
+    explicit SampleCache(SampleCacheConfig config) : config_(std::move(config)) {
+        if (!config_.enabled())
+            return;
+        std::error_code ec;
+        std::filesystem::create_directories(config_.directory_, ec);
+        if (ec) {
+            log::warn("SampleCache", "Cannot create cache directory", config_.directory_, "(", ec.message(),
+                      "); caching disabled");
+            config_.directory_.clear();
+        }
+    }
+
+    bool enabled() const noexcept { return config_.enabled(); }
+
+    const SampleCacheConfig &config() const noexcept { return config_; }
+
+    // Location of the entry for `input_path` processed by a chain with the
+    // given signature. `selection` carries any truth filters or exclusions
+    // applied on top of the chain.
+    std::string entryPath(const std::string &dataset_id, const std::vector<std::string> &input_paths,
+                          const std::string &chain_signature, const std::string &selection) const {
+        std::uint64_t h = fnv1a("rarexsec-sample-cache");
+        h = fnv1a(std::to_string(kFormatVersion), h);
+        h = fnv1a(kSourceHash, h);
+        for (const auto &input_path : input_paths)
+            h = fnv1a(fileIdentity(input_path), h);
+        h = fnv1a(chain_signature, h);
+        h = fnv1a(selection, h);
+        h = fnv1a(config_.preselection_, h);
+        for (const auto &column : config_.dropped_columns_)
+            h = fnv1a(column, h);
+
+        char hex[17];
+        std::snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(h));
+        auto name = dataset_id.empty() ? std::filesystem::path(input_paths.front()).stem().string() : dataset_id;
+        return (std::filesystem::path(config_.directory_) / (name + "-" + hex + ".root")).string();
+    }
+
+    bool contains(const std::string &entry_path) const { return std::filesystem::exists(entry_path); }
+
+    ROOT::RDF::RNode open(const std::string &entry_path) const {
+        log::info("SampleCache::open", "Reading cached sample", entry_path);
+        return ROOT::RDataFrame(kTreeName, entry_path);
+    }
+
+    // Writes the processed node to the cache and returns a node reading it
+    // back. The snapshot goes to a temporary file that is renamed on success
+    // so that an interrupted run never leaves a truncated entry behind.
+    ROOT::RDF::RNode store(const std::string &entry_path, ROOT::RDF::RNode df) const {
+        if (!config_.preselection_.empty())
+            df = ExpressionCompiler::instance().filter(df, config_.preselection_);
+        if (!config_.write_)
+            return df;
+
+        const auto columns = persistentColumns(df, config_.dropped_columns_);
+
+        const auto tmp_path = entry_path + ".tmp";
+        log::info("SampleCache::store", "Caching", columns.size(), "columns to", entry_path);
+        try {
+            df.Snapshot(kTreeName, tmp_path, columns);
+        } catch (const std::exception &e) {
+            log::warn("SampleCache::store", "Snapshot failed:", e.what(), "- using the uncached sample");
+            std::error_code ec;
+            std::filesystem::remove(tmp_path, ec);
+            return df;
+        }
+
+        std::error_code ec;
+        std::filesystem::rename(tmp_path, entry_path, ec);
+        if (ec) {
+            log::warn("SampleCache::store", "Cannot finalise", entry_path, "(", ec.message(), ")");
+            return ROOT::RDataFrame(kTreeName, tmp_path);
+        }
+        return this->open(entry_path);
+    }
+
+    static std::uint64_t fnv1a(std::string_view data, std::uint64_t h = 14695981039346656037ULL) {
+        for (unsigned char c : data) {
+            h ^= c;
+            h *= 1099511628211ULL;
+        }
+        // Separator so that ("ab", "c") and ("a", "bc") hash differently.
+        h ^= 0xff;
+        h *= 1099511628211ULL;
+        return h;
+    }
+
+    // Canonical path, size and modification time; a rewritten input file
+    // invalidates every entry derived from it.
+    static std::string fileIdentity(const std::string &path) {
+        namespace fs = std::filesystem;
+        std::error_code ec;
+        const auto canonical = fs::weakly_canonical(path, ec);
+        std::string id = ec ? path : canonical.string();
+        const auto size = fs::file_size(path, ec);
+        id += ":" + std::to_string(ec ? 0 : size);
+        const auto mtime = fs::last_write_time(path, ec);
+        id += ":" + std::to_string(ec ? 0 : mtime.time_since_epoch().count());
+        return id;
+    }
+
+  private:
+    SampleCacheConfig config_;
+};
+
+}
+
+#endif
@@ -3,28 +3,86 @@
 
 #include <filesystem>
 #include <map>
+#include <memory>
+#include <optional>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "ROOT/RDataFrame.hxx"
+#include "RVersion.h"
+#include "TFile.h"
+#include "TTree.h"
 #include "nlohmann/json.hpp"
 
 #include <rarexsec/utils/Logger.h>
+#include <rarexsec/core/AnalysisKey.h>
+#include <rarexsec/data/ExpressionCompiler.h>
 #include <rarexsec/data/IEventProcessor.h>
+#include <rarexsec/data/SampleCache.h>
+#include <rarexsec/data/SampleInputs.h>
 #include <rarexsec/data/SampleTypes.h>
+#include <rarexsec/data/ShardSpec.h>
 #include <rarexsec/data/VariableRegistry.h>
 
 namespace analysis {
 
-inline ROOT::RDF::RNode buildBaseDataFrame(const std::string &base_dir, const std::string &relPath,
-                                           IEventProcessor &processor, SampleOrigin origin) {
-    auto path = base_dir + "/" + relPath;
-    ROOT::RDataFrame df("nuselection/EventSelectionFilter", path);
-    return processor.process(df, origin);
+inline constexpr const char *kEventTreeName = "nuselection/EventSelectionFilter";
+
+using EntryRange = std::pair<ULong64_t, ULong64_t>;
+
+// Entries in the event trees of `paths`, read from the file headers.
+inline ULong64_t countEntries(const std::vector<std::string> &paths) {
+    ULong64_t total = 0;
+    for (const auto &path : paths) {
+        std::unique_ptr<TFile> file{TFile::Open(path.c_str(), "READ")};
+        auto *tree = file && !file->IsZombie() ? file->Get<TTree>(kEventTreeName) : nullptr;
+        if (!tree)
+            log::fatal("countEntries", "Cannot read", kEventTreeName, "from", path);
+        total += static_cast<ULong64_t>(tree->GetEntries());
+    }
+    return total;
+}
+
+// Branch names of the event tree in `path`, read from the file header.
+inline std::vector<std::string> treeBranches(const std::string &path) {
+    std::unique_ptr<TFile> file{TFile::Open(path.c_str(), "READ")};
+    auto *tree = file && !file->IsZombie() ? file->Get<TTree>(kEventTreeName) : nullptr;
+    if (!tree) {
+        log::warn("treeBranches", "Cannot read", kEventTreeName, "from", path);
+        return {};
+    }
+    std::vector<std::string> names;
+    TIter next(tree->GetListOfBranches());
+    while (auto *branch = next())
+        names.emplace_back(branch->GetName());
+    return names;
+}
+
+// Several files are read as one chain; with implicit MT the entry ranges of
+// all files are scheduled across the workers together. An entry range keeps
+// the global chain entries [first, second) only. It is applied as a global
+// range of the dataset, so the event loop neither reads nor schedules the
+// clusters outside it, with or without implicit MT.
+inline ROOT::RDF::RNode buildBaseDataFrame(const std::vector<std::string> &paths, IEventProcessor &processor,
+                                           SampleOrigin origin, std::optional<EntryRange> entries = std::nullopt) {
+    if (!entries)
+        return processor.process(ROOT::RDataFrame(kEventTreeName, paths), origin);
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6, 30, 0)
+    namespace RDFX = ROOT::RDF::Experimental;
+    const auto [first, last] = *entries;
+    auto spec = RDFX::RDatasetSpec()
+                    .AddSample(RDFX::RSample("", kEventTreeName, paths))
+                    .WithGlobalRange({static_cast<Long64_t>(first), static_cast<Long64_t>(last)});
+    return processor.process(ROOT::RDataFrame(spec), origin);
+#else
+    log::fatal("buildBaseDataFrame", "Entry sharding needs ROOT 6.30; give every shard at least one file");
+    return processor.process(ROOT::RDataFrame(kEventTreeName, paths), origin);
+#endif
 }
 
 inline ROOT::RDF::RNode applyTruthFilters(ROOT::RDF::RNode df, const std::string &truth_filter) {
-    return truth_filter.empty() ? df : df.Filter(truth_filter);
+    return truth_filter.empty() ? df : ExpressionCompiler::instance().filter(df, truth_filter);
 }
 
 inline ROOT::RDF::RNode applyExclusionKeys(ROOT::RDF::RNode df, const std::vector<std::string> &truth_exclusions,
@@ -35,7 +93,7 @@ inline ROOT::RDF::RNode applyExclusionKeys(ROOT::RDF::RNode df, const std::vecto
             if (sample_json.at("sample_key").get<std::string>() == exclusion_key) {
                 if (sample_json.contains("truth_filter")) {
                     auto filter_str = sample_json.at("truth_filter").get<std::string>();
-                    df = df.Filter("!(" + filter_str + ")");
+                    df = ExpressionCompiler::instance().filter(df, "!(" + filter_str + ")");
                     found_key = true;
                     break;
                 }
@@ -53,52 +111,40 @@ class SampleDefinition {
     SampleKey sample_key_;
     SampleOrigin sample_origin_;
 
+    std::string dataset_id_;
     std::string rel_path_;
+    std::vector<InputFile> input_files_;
     std::string truth_filter_;
     std::vector<std::string> truth_exclusions_;
 
     double pot_{0.0};
     long triggers_{0};
 
+    ShardSpec shard_;
+
+    // Identity of everything the nominal and variation frames are built
+    // from: input files, processor chain, truth filters and shard slice.
+    // Filled while the frames are made, so it is declared before them.
+    std::string signature_;
+
     ROOT::RDF::RNode nominal_node_;
     std::map<SampleVariation, ROOT::RDF::RNode> variation_nodes_;
 
     SampleDefinition(const nlohmann::json &j, const nlohmann::json &all_samples_json, const std::string &base_dir,
-                     const VariableRegistry &var_reg, IEventProcessor &processor)
-        : sample_key_{j.at("sample_key").get<std::string>()},
-          sample_origin_{[&]() {
-              auto ts = j.at("sample_type").get<std::string>();
-              return (ts == "mc"     ? SampleOrigin::kMonteCarlo
-                      : ts == "data" ? SampleOrigin::kData
-                      : ts == "ext"  ? SampleOrigin::kExternal
-                      : ts == "dirt" ? SampleOrigin::kDirt
-                                      : SampleOrigin::kUnknown);
-          }()},
-          rel_path_{j.value("relative_path", "")},
-          truth_filter_{j.value("truth_filter", "")},
-          truth_exclusions_{j.value("exclusion_truth_filters", std::vector<std::string>{})},
-          pot_{j.value("pot", 0.0)},
-          triggers_{j.value("triggers", 0L)},
-          nominal_node_{makeDataFrame(base_dir, var_reg, processor, rel_path_, all_samples_json)} {
-        if (j.contains("detector_variations")) {
-            for (auto &dv : j.at("detector_variations")) {
-                SampleVariation dvt = this->convertDetVarType(dv.at("variation_type").get<std::string>());
-                var_paths_[dvt] = dv.at("relative_path").get<std::string>();
-            }
-        }
-        this->validateFiles(base_dir);
-        if (sample_origin_ == SampleOrigin::kMonteCarlo) {
-            for (auto &[dv, path] : var_paths_) {
-                variation_nodes_.emplace(dv, this->makeDataFrame(base_dir, var_reg, processor, path, all_samples_json));
-            }
-        }
-    }
+                     const VariableRegistry &var_reg, IEventProcessor &processor,
+                     const SampleCache *cache = nullptr, ShardSpec shard = {})
+        : SampleDefinition(j, all_samples_json, base_dir, var_reg, processor, cache, shard,
+                           SampleInputs::exposure(j)) {}
+
+    // Resolved input files of the nominal sample with their exposure, when
+    // the configuration lists it per file.
+    const std::vector<InputFile> &inputFiles() const noexcept { return input_files_; }
 
     bool isMc() const noexcept { return sample_origin_ == SampleOrigin::kMonteCarlo; }
     bool isData() const noexcept { return sample_origin_ == SampleOrigin::kData; }
     bool isExt() const noexcept { return sample_origin_ == SampleOrigin::kExternal; }
 
-    void validateFiles(const std::string &base_dir) const {
+    void validateFiles() const {
         if (sample_key_.str().empty())
             log::fatal("SampleDefinition::validateFiles", "empty sample_key_");
         if (sample_origin_ == SampleOrigin::kUnknown)
@@ -111,20 +157,61 @@ class SampleDefinition {
             log::fatal("SampleDefinition::validateFiles", "invalid triggers_ for Data", sample_key_.str());
         if (sample_origin_ != SampleOrigin::kData && rel_path_.empty())
             log::fatal("SampleDefinition::validateFiles", "missing path for", sample_key_.str());
-        if (!rel_path_.empty()) {
-            auto p = std::filesystem::path(base_dir) / rel_path_;
-            if (!std::filesystem::exists(p))
-                log::fatal("SampleDefinition::validateFiles", "missing file", p.string());
+        for (const auto &file : input_files_) {
+            if (!std::filesystem::exists(file.path))
+                log::fatal("SampleDefinition::validateFiles", "missing file", file.path);
         }
-        for (auto &[dv, rp] : var_paths_) {
-            auto vp = std::filesystem::path(base_dir) / rp;
-            if (!std::filesystem::exists(vp))
-                log::fatal("SampleDefinition::validateFiles", "missing variation", rp);
+        for (auto &[dv, files] : var_files_) {
+            if (files.empty())
+                log::fatal("SampleDefinition::validateFiles", "missing variation path for", sample_key_.str());
+            for (const auto &file : files) {
+                if (!std::filesystem::exists(file.path))
+                    log::fatal("SampleDefinition::validateFiles", "missing variation", file.path);
+            }
         }
     }
 
   private:
-    std::map<SampleVariation, std::string> var_paths_;
+    std::map<SampleVariation, std::vector<InputFile>> var_files_;
+    std::map<SampleVariation, std::string> var_dataset_ids_;
+
+    SampleDefinition(const nlohmann::json &j, const nlohmann::json &all_samples_json, const std::string &base_dir,
+                     const VariableRegistry &var_reg, IEventProcessor &processor, const SampleCache *cache,
+                     ShardSpec shard, std::pair<double, long> exposure)
+        : sample_key_{j.at("sample_key").get<std::string>()},
+          sample_origin_{[&]() {
+              auto ts = j.at("sample_type").get<std::string>();
+              return (ts == "mc"     ? SampleOrigin::kMonteCarlo
+                      : ts == "data" ? SampleOrigin::kData
+                      : ts == "ext"  ? SampleOrigin::kExternal
+                      : ts == "dirt" ? SampleOrigin::kDirt
+                                      : SampleOrigin::kUnknown);
+          }()},
+          dataset_id_{j.value("dataset_id", "")},
+          rel_path_{SampleInputs::describe(j)},
+          input_files_{SampleInputs::resolve(base_dir, j)},
+          truth_filter_{j.value("truth_filter", "")},
+          truth_exclusions_{j.value("exclusion_truth_filters", std::vector<std::string>{})},
+          pot_{exposure.first},
+          triggers_{exposure.second},
+          shard_{shard},
+          nominal_node_{makeDataFrame(base_dir, var_reg, processor, input_files_, dataset_id_, all_samples_json,
+                                      cache)} {
+        if (j.contains("detector_variations")) {
+            for (auto &dv : j.at("detector_variations")) {
+                SampleVariation dvt = this->convertDetVarType(dv.at("variation_type").get<std::string>());
+                var_files_[dvt] = SampleInputs::resolve(base_dir, dv);
+                var_dataset_ids_[dvt] = dv.value("dataset_id", "");
+            }
+        }
+        this->validateFiles();
+        if (sample_origin_ == SampleOrigin::kMonteCarlo) {
+            for (auto &[dv, files] : var_files_) {
+                variation_nodes_.emplace(dv, this->makeDataFrame(base_dir, var_reg, processor, files,
+                                                                 var_dataset_ids_[dv], all_samples_json, cache));
+            }
+        }
+    }
 
     SampleVariation convertDetVarType(const std::string &s) const {
         if (s == "cv")
@@ -151,12 +238,75 @@ class SampleDefinition {
         return SampleVariation::kUnknown;
     }
     ROOT::RDF::RNode makeDataFrame(const std::string &base_dir, const VariableRegistry &, IEventProcessor &processor,
-                                   const std::string &relPath, const nlohmann::json &all_samples_json) {
-        auto df = buildBaseDataFrame(base_dir, relPath, processor, sample_origin_);
+                                   const std::vector<InputFile> &files, const std::string &dataset_id,
+                                   const nlohmann::json &all_samples_json, const SampleCache *cache) {
+        std::vector<std::string> paths;
+        for (const auto &file : files)
+            paths.push_back(file.path);
+
+        std::optional<EntryRange> entries;
+        if (shard_.active() && !paths.empty())
+            entries = this->selectShard(paths);
+
+        auto selection = this->selectionSignature(all_samples_json);
+        if (entries)
+            selection += ";entries=" + std::to_string(entries->first) + "-" + std::to_string(entries->second);
+        signature_ += "[" + dataset_id;
+        for (const auto &path : paths)
+            signature_ += ";" + SampleCache::fileIdentity(path);
+        signature_ += ";" + processor.chainSignature() + ";" + selection;
+        if (cache && cache->enabled())
+            signature_ += ";preselection=" + cache->config().preselection_;
+        signature_ += "]";
+
+        std::string entry_path;
+        if (cache && cache->enabled() && !paths.empty()) {
+            entry_path = cache->entryPath(dataset_id, paths, processor.chainSignature(), selection);
+            if (cache->contains(entry_path))
+                return cache->open(entry_path);
+        }
+
+        if (paths.empty())
+            paths.push_back(base_dir + "/");
+        auto df = buildBaseDataFrame(paths, processor, sample_origin_, entries);
         df = applyTruthFilters(df, truth_filter_);
         df = applyExclusionKeys(df, truth_exclusions_, all_samples_json);
+        if (!entry_path.empty())
+            df = cache->store(entry_path, df);
         return df;
     }
+
+    // Narrows the inputs to this shard's part. With at least as many files as
+    // shards each shard reads a contiguous block of files; otherwise each
+    // shard reads a contiguous block of the global chain entries.
+    std::optional<EntryRange> selectShard(std::vector<std::string> &paths) const {
+        if (paths.size() >= shard_.count_) {
+            const auto [first, last] = shard_.block(paths.size());
+            paths = std::vector<std::string>(paths.begin() + first, paths.begin() + last);
+            log::debug("SampleDefinition::selectShard", sample_key_.str(), "shard", shard_.str(), "reads files",
+                       first, "to", last);
+            return std::nullopt;
+        }
+
+        const auto total = countEntries(paths);
+        const auto [first, last] = shard_.block(total);
+        log::debug("SampleDefinition::selectShard", sample_key_.str(), "shard", shard_.str(), "reads entries", first,
+                   "to", last, "of", total);
+        return EntryRange{first, last};
+    }
+
+    // Truth filters and exclusions are baked into cached samples.
+    std::string selectionSignature(const nlohmann::json &all_samples_json) const {
+        std::string sig = "origin=" + std::to_string(static_cast<unsigned>(sample_origin_)) + ";filter=" + truth_filter_;
+        for (const auto &exclusion_key : truth_exclusions_) {
+            sig += ";exclude=" + exclusion_key;
+            for (const auto &sample_json : all_samples_json) {
+                if (sample_json.at("sample_key").get<std::string>() == exclusion_key)
+                    sig += ":" + sample_json.value("truth_filter", "");
+            }
+        }
+        return sig;
+    }
 };
 
 }
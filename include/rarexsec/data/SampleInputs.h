@@ -0,0 +1,175 @@
+#ifndef SAMPLE_INPUTS_H
+#define SAMPLE_INPUTS_H
+
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#include <rarexsec/utils/Logger.h>
+
+namespace analysis {
+
+struct InputFile {
+    std::string path;
+    double pot{0.0};
+    long triggers{0};
+};
+
+// Input files of a sample or detector variation. `relative_path` is a file,
+// a glob over file names such as "run1/*.root", or a list of either; the
+// optional "files" array lists files with their own exposure:
+//   {"path": "run1/a.root", "pot": 1.2e19, "triggers": 0}
+// A sample-level "pot" or "triggers" takes precedence over the per-file sums.
+class SampleInputs {
+  public:
+    static std::vector<std::string> patterns(const nlohmann::json &j) {
+        auto out = relativePaths(j);
+        if (j.contains("files")) {
+            for (const auto &f : j.at("files"))
+                out.push_back(f.at("path").get<std::string>());
+        }
+        return out;
+    }
+
+    // Printable form of the inputs, used in messages.
+    static std::string describe(const nlohmann::json &j) {
+        std::string out;
+        for (const auto &p : patterns(j))
+            out += (out.empty() ? "" : ",") + p;
+        return out;
+    }
+
+    // Expands the patterns below `base_dir`. Plain paths are kept whether or
+    // not they exist so that validation can name them; globs that match
+    // nothing are fatal.
+    static std::vector<InputFile> resolve(const std::string &base_dir, const nlohmann::json &j) {
+        std::vector<InputFile> files;
+        for (const auto &pattern : relativePaths(j)) {
+            auto paths = expand(base_dir, pattern);
+            if (paths.empty())
+                log::fatal("SampleInputs::resolve", "No input files match",
+                           (std::filesystem::path(base_dir) / pattern).string());
+            for (auto &path : paths)
+                files.push_back({std::move(path), 0.0, 0});
+        }
+        if (j.contains("files")) {
+            for (const auto &f : j.at("files")) {
+                files.push_back({(std::filesystem::path(base_dir) / f.at("path").get<std::string>()).string(),
+                                 f.value("pot", 0.0), f.value("triggers", 0L)});
+            }
+        }
+        return files;
+    }
+
+    // POT and triggers of the sample: the sample-level values when given,
+    // otherwise the sums over "files". With `report`, sample-level values
+    // that disagree with the per-file sums are logged.
+    static std::pair<double, long> exposure(const nlohmann::json &j, bool report = true) {
+        double file_pot = 0.0;
+        long file_triggers = 0;
+        if (j.contains("files")) {
+            for (const auto &f : j.at("files")) {
+                file_pot += f.value("pot", 0.0);
+                file_triggers += f.value("triggers", 0L);
+            }
+        }
+
+        const double pot = j.contains("pot") ? j.at("pot").get<double>() : file_pot;
+        const long triggers = j.contains("triggers") ? j.at("triggers").get<long>() : file_triggers;
+        if (report && j.contains("pot") && file_pot > 0.0 && std::abs(pot - file_pot) > 1e-6 * pot)
+            log::warn("SampleInputs::exposure", "Sample pot", pot, "differs from the per-file sum", file_pot, "for",
+                      j.value("sample_key", describe(j)));
+        if (report && j.contains("triggers") && file_triggers > 0 && triggers != file_triggers)
+            log::warn("SampleInputs::exposure", "Sample triggers", triggers, "differ from the per-file sum",
+                      file_triggers, "for", j.value("sample_key", describe(j)));
+        return {pot, triggers};
+    }
+
+    static bool hasWildcard(const std::string &s) { return s.find_first_of("*?[") != std::string::npos; }
+
+    // Shell-style match of one path component: `*`, `?` and `[...]` sets.
+    static bool matches(const char *pattern, const char *name) {
+        for (; *pattern; ++pattern, ++name) {
+            if (*pattern == '*') {
+                for (;; ++name) {
+                    if (matches(pattern + 1, name))
+                        return true;
+                    if (!*name)
+                        return false;
+                }
+            }
+            if (!*name)
+                return false;
+            if (*pattern == '[') {
+                const char *p = pattern + 1;
+                const bool negate = *p == '!' || *p == '^';
+                if (negate)
+                    ++p;
+                bool found = false;
+                for (; *p && *p != ']'; ++p) {
+                    if (p[1] == '-' && p[2] && p[2] != ']') {
+                        found = found || (*name >= p[0] && *name <= p[2]);
+                        p += 2;
+                    } else {
+                        found = found || *name == *p;
+                    }
+                }
+                if (!*p || found == negate)
+                    return false;
+                pattern = p;
+            } else if (*pattern != '?' && *pattern != *name) {
+                return false;
+            }
+        }
+        return !*name;
+    }
+
+    // Files below `base_dir` matching `pattern`, sorted. Wildcards are allowed
+    // in the file name only, as with TChain::Add; a plain path is returned
+    // as is and a glob that matches nothing gives no files.
+    static std::vector<std::string> expand(const std::string &base_dir, const std::string &pattern) {
+        namespace fs = std::filesystem;
+        const auto full = fs::path(base_dir) / pattern;
+        if (!hasWildcard(pattern))
+            return {full.string()};
+
+        const auto dir = full.parent_path();
+        if (hasWildcard(dir.string()))
+            log::fatal("SampleInputs::expand", "Wildcards are only supported in file names:", pattern);
+
+        const auto name_pattern = full.filename().string();
+        std::vector<std::string> out;
+        std::error_code ec;
+        for (fs::directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec)) {
+            if (it->is_regular_file(ec) && matches(name_pattern.c_str(), it->path().filename().string().c_str()))
+                out.push_back(it->path().string());
+        }
+        std::sort(out.begin(), out.end());
+        return out;
+    }
+
+  private:
+    static std::vector<std::string> relativePaths(const nlohmann::json &j) {
+        std::vector<std::string> out;
+        if (!j.contains("relative_path"))
+            return out;
+        const auto &rel = j.at("relative_path");
+        if (rel.is_array()) {
+            for (const auto &p : rel)
+                out.push_back(p.get<std::string>());
+        } else if (!rel.get<std::string>().empty()) {
+            out.push_back(rel.get<std::string>());
+        }
+        return out;
+    }
+};
+
+}
+
+#endif
@@ -0,0 +1,81 @@
+#ifndef SHARD_SPEC_H
+#define SHARD_SPEC_H
+
+#include <cstddef>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include <nlohmann/json.hpp>
+
+#include <rarexsec/utils/Logger.h>
+
+namespace analysis {
+
+// Part of a sharded run: shard `index_` of `count_` processes a disjoint
+// slice of every sample, and the partial results are merged afterwards.
+struct ShardSpec {
+    unsigned index_{0};
+    unsigned count_{1};
+    // Implicit-MT pool size of the worker, 0 for the ROOT default.
+    unsigned threads_{0};
+
+    bool active() const noexcept { return count_ > 1; }
+
+    std::string str() const { return std::to_string(index_) + "/" + std::to_string(count_); }
+
+    // Contiguous block of `n` items owned by this shard; blocks of all shards
+    // cover [0, n) without overlap.
+    std::pair<std::size_t, std::size_t> block(std::size_t n) const {
+        return {n * index_ / count_, n * (index_ + 1) / count_};
+    }
+
+    // "index/count", as used by ANALYSIS_SHARD.
+    static ShardSpec parse(const std::string &s) {
+        ShardSpec spec;
+        const auto slash = s.find('/');
+        try {
+            if (slash == std::string::npos)
+                throw std::invalid_argument(s);
+            spec.index_ = static_cast<unsigned>(std::stoul(s.substr(0, slash)));
+            spec.count_ = static_cast<unsigned>(std::stoul(s.substr(slash + 1)));
+        } catch (const std::exception &) {
+            log::fatal("ShardSpec::parse", "Expected index/count, got", s);
+        }
+        spec.validate();
+        return spec;
+    }
+
+    // Reads the optional "shard" block of the samples catalog. The
+    // ANALYSIS_SHARD environment variable overrides it, so batch jobs can
+    // share one catalog.
+    static ShardSpec fromJson(const nlohmann::json &samples) {
+        ShardSpec spec;
+        if (samples.contains("shard")) {
+            const auto &j = samples.at("shard");
+            spec.index_ = j.value("index", 0u);
+            spec.count_ = j.value("count", 1u);
+            spec.threads_ = j.value("threads", 0u);
+            spec.validate();
+        }
+        if (const char *env = std::getenv("ANALYSIS_SHARD")) {
+            const auto threads = spec.threads_;
+            spec = parse(env);
+            spec.threads_ = threads;
+        }
+        return spec;
+    }
+
+    nlohmann::json toJson() const { return {{"index", index_}, {"count", count_}, {"threads", threads_}}; }
+
+  private:
+    void validate() const {
+        if (count_ == 0 || index_ >= count_)
+            log::fatal("ShardSpec::validate", "Invalid shard", str());
+    }
+};
+
+}
+
+#endif
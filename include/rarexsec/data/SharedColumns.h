@@ -0,0 +1,90 @@
+#ifndef SHARED_COLUMNS_H
+#define SHARED_COLUMNS_H
+
+#include <algorithm>
+#include <string>
+
+#include "ROOT/RDataFrame.hxx"
+#include "ROOT/RVec.hxx"
+
+#include <rarexsec/data/ColumnDependencies.h>
+#include <rarexsec/data/ExpressionCompiler.h>
+#include <rarexsec/data/SampleTypes.h>
+
+namespace analysis {
+
+// Definitions used by more than one processor of the chain. Each helper is a
+// no-op when an earlier processor already defined the column, so the chain
+// evaluates it once per event.
+
+inline bool isDerivedColumn(ROOT::RDF::RNode &df, const std::string &column) {
+  const auto defined = df.GetDefinedColumnNames();
+  return std::find(defined.begin(), defined.end(), column) != defined.end();
+}
+
+inline ROOT::RDF::RNode defineRecoFiducial(ROOT::RDF::RNode df) {
+  if (isDerivedColumn(df, "in_reco_fiducial"))
+    return df;
+  return ExpressionCompiler::instance().define(
+      df, "in_reco_fiducial",
+      "reco_neutrino_vertex_sce_x > 5 && "
+      "reco_neutrino_vertex_sce_x < 251 && "
+      "reco_neutrino_vertex_sce_y > -110 && "
+      "reco_neutrino_vertex_sce_y < 110 && "
+      "reco_neutrino_vertex_sce_z > 20 && "
+      "reco_neutrino_vertex_sce_z < 986 && "
+      "(reco_neutrino_vertex_sce_z < 675 || "
+      "reco_neutrino_vertex_sce_z > 775)");
+}
+
+inline ROOT::RDF::RNode definePfpGenerationCount(ROOT::RDF::RNode df,
+                                                 const std::string &column,
+                                                 unsigned generation) {
+  if (isDerivedColumn(df, column))
+    return df;
+  return df.Define(column,
+                   [generation](const ROOT::RVec<unsigned> &gens) {
+                     return ROOT::VecOps::Sum(gens == generation);
+                   },
+                   {"pfp_generations"});
+}
+
+// MC carries the trigger decision before and after the run 16880 change as
+// separate branches; other samples at most store it as an integer.
+inline ROOT::RDF::RNode defineSoftwareTrigger(ROOT::RDF::RNode df,
+                                             SampleOrigin st) {
+  if (isDerivedColumn(df, "software_trigger"))
+    return df;
+
+  const auto byRun = [](unsigned run, int pre, int post) {
+    return run < 16880 ? pre > 0 : post > 0;
+  };
+  if (st == SampleOrigin::kMonteCarlo) {
+    if (df.HasColumn("software_trigger_pre_ext"))
+      return df.Define("software_trigger", byRun,
+                       {"run", "software_trigger_pre_ext",
+                        "software_trigger_post_ext"});
+    if (df.HasColumn("software_trigger_pre"))
+      return df.Define("software_trigger", byRun,
+                       {"run", "software_trigger_pre",
+                        "software_trigger_post"});
+  }
+  if (df.HasColumn("software_trigger"))
+    return df.Redefine("software_trigger", "software_trigger != 0");
+  return df.Define("software_trigger", []() { return true; });
+}
+
+inline void declareSharedColumns(ColumnDependencyGraph &graph) {
+  graph.declare("in_reco_fiducial",
+                {"reco_neutrino_vertex_sce_x", "reco_neutrino_vertex_sce_y",
+                 "reco_neutrino_vertex_sce_z"});
+  graph.declare("n_pfps_gen2", {"pfp_generations"});
+  graph.declare("software_trigger",
+                {"run", "software_trigger_pre_ext",
+                 "software_trigger_post_ext", "software_trigger_pre",
+                 "software_trigger_post", "software_trigger"});
+}
+
+} // namespace analysis
+
+#endif
@@ -1,15 +1,116 @@
 #ifndef TRUTH_CHANNEL_PROCESSOR_H
 #define TRUTH_CHANNEL_PROCESSOR_H
 
+#include <array>
 #include <cmath>
-#include <iostream>
 #include <map>
+#include <memory>
 #include <mutex>
+#include <string>
+#include <vector>
 
+#include "ROOT/RDF/RActionImpl.hxx"
+#include "ROOT/RDataFrame.hxx"
+
+#include <rarexsec/data/ExpressionCompiler.h>
 #include <rarexsec/data/IEventProcessor.h>
+#include <rarexsec/utils/Logger.h>
 
 namespace analysis {
 
+// Frequencies of the GENIE interaction modes seen in the MC event loops.
+struct GenieModeStats {
+  std::map<int, long long> counts;
+
+  void merge(const GenieModeStats &other) {
+    for (const auto &[mode, n] : other.counts)
+      counts[mode] += n;
+  }
+
+  long long total() const {
+    long long n = 0;
+    for (const auto &kv : counts)
+      n += kv.second;
+    return n;
+  }
+
+  // Modes without a dedicated genie_int_mode value.
+  std::vector<int> uncategorised() const {
+    std::vector<int> modes;
+    for (const auto &kv : counts) {
+      if (kv.first != 0 && kv.first != 1 && kv.first != 2 && kv.first != 3 &&
+          kv.first != 10)
+        modes.push_back(kv.first);
+    }
+    return modes;
+  }
+
+  void report() const {
+    if (counts.empty())
+      return;
+    log::debug("GenieModeStats::report", "GENIE interaction mode frequencies:");
+    for (const auto &kv : counts)
+      log::debug("GenieModeStats::report", "  mode", kv.first, ":", kv.second);
+    for (int mode : this->uncategorised())
+      log::debug("GenieModeStats::report", "Uncategorised GENIE mode:", mode);
+  }
+};
+
+// RDataFrame action histogramming the GENIE modes, with one dense row per
+// processing slot. Each slot only touches its own row, so filling needs no
+// lock; rows are merged in Finalize. Being an action rather than part of a
+// column definition, it fills in exactly one event loop however many loops
+// later run over the same frame.
+class GenieModeCounter
+    : public ROOT::Detail::RDF::RActionImpl<GenieModeCounter> {
+public:
+  using Result_t = GenieModeStats;
+
+  static constexpr int kDenseModes = 128;
+
+  explicit GenieModeCounter(unsigned n_slots)
+      : result_(std::make_shared<Result_t>()), rows_(n_slots) {}
+
+  GenieModeCounter(GenieModeCounter &&) = default;
+  GenieModeCounter(const GenieModeCounter &) = delete;
+
+  std::shared_ptr<Result_t> GetResultPtr() const { return result_; }
+
+  void Initialize() {}
+
+  void InitTask(TTreeReader *, unsigned int) {}
+
+  void Exec(unsigned int slot, int mode) {
+    auto &row = rows_[slot];
+    if (mode >= 0 && mode < kDenseModes)
+      ++row.dense[mode];
+    else
+      ++row.sparse[mode];
+  }
+
+  void Finalize() {
+    for (const auto &row : rows_) {
+      for (int mode = 0; mode < kDenseModes; ++mode) {
+        if (row.dense[mode] != 0)
+          result_->counts[mode] += row.dense[mode];
+      }
+      for (const auto &[mode, n] : row.sparse)
+        result_->counts[mode] += n;
+    }
+  }
+
+  std::string GetActionName() { return "GenieModeCount"; }
+
+private:
+  struct alignas(64) Row {
+    std::array<long long, kDenseModes> dense{};
+    std::map<int, long long> sparse;
+  };
+
+  std::shared_ptr<Result_t> result_;
+  std::vector<Row> rows_;
+};
+
 class TruthChannelProcessor : public IEventProcessor {
 public:
   explicit TruthChannelProcessor() = default;
@@ -30,7 +131,54 @@ public:
     return next_ ? next_->process(chan_df, st) : chan_df;
   }
 
+  // Mode frequencies of every MC frame built by this processor whose first
+  // event loop has run.
+  GenieModeStats modeStats() const {
+    std::lock_guard<std::mutex> lock(counters_mutex_);
+    GenieModeStats out;
+    // Dereferencing needs a non-const handle; copies share the result.
+    for (auto counts : mode_counts_) {
+      if (counts.IsReady())
+        out.merge(*counts);
+    }
+    return out;
+  }
+
+  void declareColumns(ColumnDependencyGraph &graph) const override {
+    graph.declare("in_fiducial", {"neutrino_vertex_x", "neutrino_vertex_y",
+                                  "neutrino_vertex_z"});
+    graph.declare("mc_n_strange",
+                  {"count_kaon_plus", "count_kaon_minus", "count_kaon_zero",
+                   "count_lambda", "count_sigma_plus", "count_sigma_zero",
+                   "count_sigma_minus"});
+    graph.declare("mc_n_pion", {"count_pi_plus", "count_pi_minus"});
+    graph.declare("mc_n_proton", {"count_proton"});
+    graph.declare("genie_int_mode", {"interaction_mode"});
+    graph.declare("incl_channel",
+                  {"in_fiducial", "neutrino_pdg", "interaction_ccnc",
+                   "mc_n_strange", "mc_n_pion", "mc_n_proton"});
+    graph.declare("inclusive_strange_channels", {"incl_channel"});
+    graph.declare("excl_channel",
+                  {"in_fiducial", "neutrino_pdg", "interaction_ccnc",
+                   "mc_n_strange", "count_kaon_plus", "count_kaon_minus",
+                   "count_kaon_zero", "count_lambda", "count_sigma_plus",
+                   "count_sigma_zero", "count_sigma_minus"});
+    graph.declare("exclusive_strange_channels", {"excl_channel"});
+    graph.declare("channel_def",
+                  {"in_fiducial", "neutrino_pdg", "interaction_ccnc",
+                   "mc_n_strange", "mc_n_pion", "mc_n_proton",
+                   "count_pi_zero", "count_gamma"});
+    graph.declare("channel_definitions", {"channel_def"});
+    graph.declare("is_truth_signal", {"channel_def"});
+    graph.declare("pure_slice_signal",
+                  {"is_truth_signal", "neutrino_purity_from_pfp",
+                   "neutrino_completeness_from_pfp"});
+  }
+
 private:
+  mutable std::mutex counters_mutex_;
+  mutable std::vector<ROOT::RDF::RResultPtr<GenieModeStats>> mode_counts_;
+
   ROOT::RDF::RNode processNonMc(ROOT::RDF::RNode df, SampleOrigin st) const {
     auto mode_df = df.Define("genie_int_mode", []() { return -1; });
 
@@ -74,11 +222,11 @@ private:
   }
 
   ROOT::RDF::RNode defineCounts(ROOT::RDF::RNode df) const {
-    auto fid_df =
-        df.Define("in_fiducial",
-                  "(neutrino_vertex_x > 5 && neutrino_vertex_x < 251) &&"
-                  "(neutrino_vertex_y > -110 && neutrino_vertex_y < 110) &&"
-                  "(neutrino_vertex_z > 20 && neutrino_vertex_z < 986)");
+    auto fid_df = ExpressionCompiler::instance().define(
+        df, "in_fiducial",
+        "(neutrino_vertex_x > 5 && neutrino_vertex_x < 251) &&"
+        "(neutrino_vertex_y > -110 && neutrino_vertex_y < 110) &&"
+        "(neutrino_vertex_z > 20 && neutrino_vertex_z < 986)");
 
     auto strange_df = fid_df.Define(
         "mc_n_strange", "count_kaon_plus + count_kaon_minus + count_kaon_zero +"
@@ -90,30 +238,16 @@ private:
 
     auto proton_df = pion_df.Define("mc_n_proton", "count_proton");
 
+    auto counts = proton_df.Book<int>(
+        GenieModeCounter(proton_df.GetNSlots()), {"interaction_mode"});
+    {
+      std::lock_guard<std::mutex> lock(counters_mutex_);
+      mode_counts_.push_back(counts);
+    }
+
     auto mode_df = proton_df.Define(
         "genie_int_mode",
         [](int mode) {
-          struct ModeCounter {
-            std::map<int, long long> counts;
-            std::mutex mtx;
-            ~ModeCounter() {
-              std::cout << "[DEBUG] GENIE interaction mode frequencies:\n";
-              for (const auto &kv : counts) {
-                std::cout << "  mode " << kv.first << ": " << kv.second
-                          << std::endl;
-              }
-            }
-          };
-          static ModeCounter counter;
-          {
-            std::lock_guard<std::mutex> lock(counter.mtx);
-            counter.counts[mode]++;
-            if (counter.counts[mode] == 1 && mode != 0 && mode != 1 &&
-                mode != 2 && mode != 3 && mode != 10) {
-              std::cout << "[DEBUG] Uncategorised GENIE mode: " << mode
-                        << std::endl;
-            }
-          }
           switch (mode) {
           case 0:
             return 0;
@@ -57,6 +57,30 @@ public:
     return std::vector<std::string>(vars.begin(), vars.end());
   }
 
+  // Per-pixel image vectors. They dominate the ntuple size and are only read
+  // by the event displays.
+  static const std::vector<std::string> &heavyImageVariables() {
+    static const std::vector<std::string> v = {
+        "detector_image_u",       "detector_image_v",
+        "detector_image_w",       "semantic_image_u",
+        "semantic_image_v",       "semantic_image_w",
+        "event_detector_image_u", "event_detector_image_v",
+        "event_detector_image_w", "event_semantic_image_u",
+        "event_semantic_image_v", "event_semantic_image_w",
+        "event_adc_u",            "event_adc_v",
+        "event_adc_w"};
+
+    return v;
+  }
+
+  // Derived columns of in-memory types with no ROOT dictionary. They cannot
+  // be written by Snapshot.
+  static const std::vector<std::string> &transientColumns() {
+    static const std::vector<std::string> v = {"muon_candidates"};
+
+    return v;
+  }
+
 private:
   static std::unordered_set<std::string> collectBaseGroups() {
     std::unordered_set<std::string> vars{baseVariables().begin(),
@@ -2,21 +2,31 @@
 #define WEIGHT_PROCESSOR_H
 
 #include <cmath>
+#include <sstream>
+#include <string>
+#include <utility>
 
 #include <nlohmann/json.hpp>
 
 #include <rarexsec/utils/Logger.h>
 #include <rarexsec/data/IEventProcessor.h>
+#include <rarexsec/data/SampleInputs.h>
 #include <rarexsec/data/SampleTypes.h>
 
 namespace analysis {
 
 class WeightProcessor : public IEventProcessor {
   public:
+    // SampleDefinition reports inconsistent exposures; this copy stays quiet.
     WeightProcessor(const nlohmann::json &cfg, double total_run_pot,
                     long total_run_triggers)
-        : sample_pot_(cfg.value("pot", 0.0)),
-          sample_triggers_(cfg.value("triggers", 0L)),
+        : WeightProcessor(SampleInputs::exposure(cfg, false), total_run_pot,
+                          total_run_triggers) {}
+
+    WeightProcessor(std::pair<double, long> exposure, double total_run_pot,
+                    long total_run_triggers)
+        : sample_pot_(exposure.first),
+          sample_triggers_(exposure.second),
           total_run_pot_(total_run_pot),
           total_run_triggers_(total_run_triggers) {
         if (sample_pot_ <= 0.0 && sample_triggers_ <= 0L) {
@@ -70,6 +80,19 @@ class WeightProcessor : public IEventProcessor {
         return df;
     }
 
+    void declareColumns(ColumnDependencyGraph &graph) const override {
+        graph.declare("base_event_weight", {});
+        graph.declare("nominal_event_weight", {"base_event_weight", "weightSpline", "weightTune"});
+    }
+
+    std::string signature() const override {
+        std::ostringstream os;
+        os.precision(17);
+        os << IEventProcessor::signature() << "(" << sample_pot_ << "," << sample_triggers_ << ","
+           << total_run_pot_ << "," << total_run_triggers_ << ")";
+        return os.str();
+    }
+
   private:
     double sample_pot_;
     long sample_triggers_;
@@ -188,8 +188,8 @@ class SurvivalBuilder {
         pass_cols_ = std::move(p);
         return *this;
     }
-    SurvivalBuilder &reasons(std::vector<std::string> r) {
-        reason_cols_ = std::move(r);
+    SurvivalBuilder &selection(std::string c) {
+        selection_col_ = std::move(c);
         return *this;
     }
     SurvivalBuilder &name(std::string n) {
@@ -213,7 +213,7 @@ class SurvivalBuilder {
         return {{"truth_column", truth_column_},
                 {"stages", stages_},
                 {"pass_columns", pass_cols_},
-                {"reason_columns", reason_cols_},
+                {"selection_column", selection_col_},
                 {"plot_name", plot_name_},
                 {"x_label", x_label_},
                 {"y_label", y_label_},
@@ -224,7 +224,7 @@ class SurvivalBuilder {
     std::string truth_column_{"is_truth_signal"};
     std::vector<std::string> stages_{"Pre", "Flash/CRT", "FV", "#mu-ID", "Topology/MVA", "Final"};
     std::vector<std::string> pass_cols_{"pass_pre", "pass_flash", "pass_fv", "pass_mu", "pass_topo", "pass_final"};
-    std::vector<std::string> reason_cols_{"", "reason_flash", "reason_fv", "reason_mu", "reason_topo", "reason_final"};
+    std::string selection_col_{"numucc_selection"};
     std::string plot_name_{"signal_cutflow_survival"};
     std::string x_label_{"Cut Stage"};
     std::string y_label_{"Survival Probability (%)"};
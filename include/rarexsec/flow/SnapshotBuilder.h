@@ -20,11 +20,19 @@ class SnapshotBuilder {
         return *this;
     }
 
+    // Writes only the columns the analysis reads; ignored with columns().
+    SnapshotBuilder &requiredColumns(bool on = true) {
+        required_ = on;
+        return *this;
+    }
+
     nlohmann::json to_json() const {
         nlohmann::json j{{"selection_rule", selection_rule_},
                          {"output_directory", out_dir_}};
         if (!cols_.empty())
             j["columns"] = cols_;
+        if (required_)
+            j["required_columns"] = true;
         return j;
     }
 
@@ -32,6 +40,7 @@ class SnapshotBuilder {
     std::string selection_rule_;
     std::string out_dir_{"snapshots"};
     std::vector<std::string> cols_;
+    bool required_{false};
 };
 inline SnapshotBuilder snapshot() { return {}; }
 
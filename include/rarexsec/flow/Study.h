@@ -117,7 +117,34 @@ class Study {
         return *this;
     }
 
+    // Only report the input branches the study would read.
+    Study &dryRun() {
+        dry_run_ = true;
+        return *this;
+    }
+
+    // Analyse the samples in `n` local worker processes and merge their
+    // partial results.
+    Study &shards(unsigned n) {
+        shards_ = n;
+        return *this;
+    }
+
     void run(const std::string &out_root_path) const {
+        auto runner = this->makeRunner();
+        runner.setDryRun(dry_run_);
+        runner.setShards(shards_);
+        runner.run(this->loadSamples(), out_root_path);
+    }
+
+    // Re-renders the plots from the result of an earlier run() with the same
+    // `out_root_path`, without running the analysis again.
+    void replot(const std::string &out_root_path) const {
+        this->makeRunner().replot(this->loadSamples(), out_root_path);
+    }
+
+  private:
+    PipelineRunner makeRunner() const {
         PluginSpecList analysis_specs;
         PluginSpecList plot_specs;
 
@@ -220,6 +247,10 @@ class Study {
         unique(analysis_specs);
         unique(plot_specs);
 
+        return PipelineRunner(std::move(analysis_specs), std::move(plot_specs));
+    }
+
+    nlohmann::json loadSamples() const {
         std::ifstream in(samples_path_);
         nlohmann::json samples;
         in >> samples;
@@ -258,11 +289,9 @@ class Study {
             }
         }
 
-        PipelineRunner runner(std::move(analysis_specs), std::move(plot_specs));
-        runner.run(samples, out_root_path);
+        return samples;
     }
 
-  private:
     std::string defaultRegionKey() const {
         return regions_.empty() ? std::string{} : regions_.front().key;
     }
@@ -278,6 +307,8 @@ class Study {
     std::vector<nlohmann::json> snaps_;
     std::vector<nlohmann::json> displays_;
     bool mc_only_{false};
+    bool dry_run_{false};
+    unsigned shards_{1};
 };
 
 }
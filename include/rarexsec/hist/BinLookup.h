@@ -0,0 +1,134 @@
+#ifndef BIN_LOOKUP_H
+#define BIN_LOOKUP_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace analysis {
+
+// Bin index lookup for a fixed set of ascending edges. Underflow is folded into
+// the first bin and overflow (including NaN) into the last. Uniform edges are
+// resolved arithmetically. Non-uniform edges, as produced by the dynamic,
+// Bayesian-blocks and quadtree binnings, go through a table of equal-width
+// cells holding the first bin each cell overlaps, followed by a short scan.
+// Long edge arrays, and edges so skewed that some cell overlaps more than a
+// few bins, fall back to a branch-free binary search. Every path returns the
+// same bin as upper_bound on the edges.
+class BinLookup {
+  public:
+    BinLookup() = default;
+
+    explicit BinLookup(std::vector<double> edges) : edges_(std::move(edges)) {
+        n_ = edges_.size() > 1 ? static_cast<int>(edges_.size()) - 1 : 0;
+        if (n_ == 0)
+            return;
+        lo_ = edges_.front();
+        hi_ = edges_.back();
+        if (!std::isfinite(lo_) || !std::isfinite(hi_) || !(lo_ < hi_))
+            return;
+
+        const double width = (hi_ - lo_) / n_;
+        bool uniform = true;
+        for (int i = 0; i < n_ && uniform; ++i)
+            uniform = std::abs(edges_[i + 1] - edges_[i] - width) <= kUniformTolerance * width;
+        if (uniform) {
+            mode_ = Mode::kUniform;
+            inv_width_ = 1.0 / width;
+            return;
+        }
+        if (n_ > kMaxTableBins)
+            return;
+
+        const int cells = kCellsPerBin * n_;
+        const double cell_width = (hi_ - lo_) / cells;
+        table_.resize(cells);
+        for (int k = 0; k < cells; ++k)
+            table_[k] = search(edges_.data(), edges_.data() + edges_.size(), lo_ + k * cell_width);
+
+        // The scan walks every bin a cell overlaps; a cell spanning many bins
+        // would make it linear, so such edges keep the binary search.
+        int max_bins = n_ - table_.back();
+        for (int k = 0; k + 1 < cells; ++k)
+            max_bins = std::max(max_bins, table_[k + 1] - table_[k] + 1);
+        if (max_bins > kMaxBinsPerCell) {
+            table_.clear();
+            return;
+        }
+        mode_ = Mode::kTable;
+        inv_width_ = 1.0 / cell_width;
+    }
+
+    int size() const noexcept { return n_; }
+
+    const std::vector<double> &edges() const noexcept { return edges_; }
+
+    // Whether non-uniform edges are resolved through the cell table.
+    bool tabulated() const noexcept { return mode_ == Mode::kTable; }
+
+    int find(double x) const noexcept {
+        if (!(x < hi_))
+            return n_ - 1;
+        if (x < lo_)
+            return 0;
+
+        // The guess can be off by rounding or, for the table, by the bins
+        // inside one cell; the scans settle it against the edges themselves.
+        int b;
+        switch (mode_) {
+        case Mode::kUniform:
+            b = std::min(static_cast<int>((x - lo_) * inv_width_), n_ - 1);
+            break;
+        case Mode::kTable:
+            b = table_[std::min(static_cast<std::size_t>((x - lo_) * inv_width_), table_.size() - 1)];
+            break;
+        default:
+            return search(edges_.data(), edges_.data() + edges_.size(), x);
+        }
+        const double *e = edges_.data();
+        while (x < e[b])
+            --b;
+        while (x >= e[b + 1])
+            ++b;
+        return b;
+    }
+
+    // Folded bin over the edges [first, last), by a binary search whose only
+    // data-dependent choice is a conditional move.
+    static int search(const double *first, const double *last, double x) noexcept {
+        const int n = static_cast<int>(last - first) - 1;
+        if (!(x < *(last - 1)))
+            return n - 1;
+        const double *base = first;
+        std::ptrdiff_t len = last - first;
+        while (len > 1) {
+            const std::ptrdiff_t half = len / 2;
+            base = base[half] <= x ? base + half : base;
+            len -= half;
+        }
+        return static_cast<int>(base - first);
+    }
+
+  private:
+    enum class Mode : std::uint8_t { kUniform, kTable, kSearch };
+
+    static constexpr double kUniformTolerance = 1e-9;
+    static constexpr int kCellsPerBin = 4;
+    static constexpr int kMaxTableBins = 1024;
+    static constexpr int kMaxBinsPerCell = 4;
+
+    std::vector<double> edges_;
+    int n_{0};
+    double lo_{0};
+    double hi_{0};
+    double inv_width_{0};
+    Mode mode_{Mode::kSearch};
+    std::vector<int> table_;
+};
+
+}
+
+#endif
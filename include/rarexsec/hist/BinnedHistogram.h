@@ -8,6 +8,7 @@
 #include "TNamed.h"
 #include <Eigen/Dense>
 
+#include <rarexsec/hist/HistogramCounts.h>
 #include <rarexsec/hist/HistogramPolicy.h>
 #include <rarexsec/hist/HistogramUncertainty.h>
 
@@ -38,10 +39,10 @@ class BinnedHistogram : public TNamed, private TH1DRenderer {
                                           int ht = 0, TString tx = "") {
         int n = hist.GetNbinsX();
         std::vector<double> counts(n);
-        Eigen::VectorXd sh_vec = Eigen::VectorXd::Zero(n);
+        Eigen::VectorXd var = Eigen::VectorXd::Zero(n);
         for (int i = 1; i <= n; ++i) {
             counts[i - 1] = hist.GetBinContent(i);
-            sh_vec(i - 1) = hist.GetBinError(i);
+            var(i - 1) = hist.GetBinError(i) * hist.GetBinError(i);
         }
 
         // Include underflow and overflow contents so that events outside the
@@ -51,13 +52,28 @@ class BinnedHistogram : public TNamed, private TH1DRenderer {
         if (n > 0) {
             counts.front() += hist.GetBinContent(0);
             counts.back()  += hist.GetBinContent(n + 1);
-            sh_vec(0) = std::sqrt(sh_vec(0) * sh_vec(0) + hist.GetBinError(0) * hist.GetBinError(0));
-            sh_vec(n - 1) =
-                std::sqrt(sh_vec(n - 1) * sh_vec(n - 1) + hist.GetBinError(n + 1) * hist.GetBinError(n + 1));
+            var(0) += hist.GetBinError(0) * hist.GetBinError(0);
+            var(n - 1) += hist.GetBinError(n + 1) * hist.GetBinError(n + 1);
         }
 
-        Eigen::MatrixXd sh = sh_vec;
-        return BinnedHistogram(bn, counts, sh, nm, ti, cl, ht, tx);
+        return BinnedHistogram(HistogramUncertainty::fromVariance(bn, counts, var), nm, ti, cl, ht, tx);
+    }
+
+    // Builds a histogram from per-bin sums of weights and squared weights, as
+    // produced by the single-pass fill actions (which already fold under and
+    // overflow into the edge bins).
+    static BinnedHistogram createFromSums(const BinningDefinition &bn, const Eigen::VectorXd &sumw,
+                                          const Eigen::VectorXd &sumw2, TString nm = "hist", TString ti = "",
+                                          Color_t cl = kBlack, int ht = 0, TString tx = "") {
+        std::vector<double> counts(sumw.data(), sumw.data() + sumw.size());
+        return BinnedHistogram(HistogramUncertainty::fromVariance(bn, counts, sumw2.cwiseMax(0.0)), nm, ti, cl, ht,
+                               tx);
+    }
+
+    static BinnedHistogram createFromCounts(const BinningDefinition &bn, const HistogramCounts &counts,
+                                            TString nm = "hist", TString ti = "", Color_t cl = kBlack, int ht = 0,
+                                            TString tx = "") {
+        return createFromSums(bn, counts.sumw(), counts.sumw2(), nm, ti, cl, ht, tx);
     }
 
     BinnedHistogram &operator=(const BinnedHistogram &other) {
@@ -74,9 +90,37 @@ class BinnedHistogram : public TNamed, private TH1DRenderer {
     double getBinError(int i) const { return hist.err(i); }
     double getSum() const { return hist.sum(); }
     double getSumError() const { return hist.sumErr(); }
-    TMatrixDSym getCorrelationMatrix() const { return hist.corrMat(); }
+    CovarianceMatrix getCorrelationMatrix() const { return hist.corrMat(); }
+
+    void addCovariance(const CovarianceMatrix &cov_to_add) { hist.addCovariance(cov_to_add); }
 
-    void addCovariance(const TMatrixDSym &cov_to_add) { hist.addCovariance(cov_to_add); }
+    // In-place accumulation; the name and style of this histogram are kept.
+    BinnedHistogram &operator+=(const BinnedHistogram &o) {
+        hist += o.hist;
+        return *this;
+    }
+
+    BinnedHistogram &operator-=(const BinnedHistogram &o) {
+        hist -= o.hist;
+        return *this;
+    }
+
+    BinnedHistogram &operator*=(double s) {
+        hist *= s;
+        return *this;
+    }
+
+    BinnedHistogram &axpy(double a, const BinnedHistogram &o) {
+        hist.axpy(a, o.hist);
+        return *this;
+    }
+
+    template <typename SumW, typename SumW2>
+    BinnedHistogram &addSums(const BinningDefinition &bn, const Eigen::MatrixBase<SumW> &sumw,
+                             const Eigen::MatrixBase<SumW2> &sumw2) {
+        hist.addSums(bn, sumw, sumw2);
+        return *this;
+    }
 
     BinnedHistogram operator+(double s) const {
         auto tmp = *this;
@@ -86,7 +130,7 @@ class BinnedHistogram : public TNamed, private TH1DRenderer {
 
     BinnedHistogram operator*(double s) const {
         auto tmp = *this;
-        tmp.hist = hist * s;
+        tmp.hist *= s;
         return tmp;
     }
 
@@ -94,13 +138,13 @@ class BinnedHistogram : public TNamed, private TH1DRenderer {
 
     BinnedHistogram operator+(const BinnedHistogram &o) const {
         auto tmp = *this;
-        tmp.hist = hist + o.hist;
+        tmp.hist += o.hist;
         return tmp;
     }
 
     BinnedHistogram operator-(const BinnedHistogram &o) const {
         auto tmp = *this;
-        tmp.hist = hist - o.hist;
+        tmp.hist -= o.hist;
         return tmp;
     }
 
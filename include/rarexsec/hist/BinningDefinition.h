@@ -8,6 +8,7 @@
 
 #include <rarexsec/utils/Logger.h>
 #include <rarexsec/core/AnalysisKey.h>
+#include <rarexsec/hist/BinLookup.h>
 
 namespace analysis {
 
@@ -39,6 +40,17 @@ class BinningDefinition {
         return ROOT::RDF::TH1DModel(getVariable().c_str(), getTexLabel().c_str(), getBinNumber(), getEdges().data());
     }
 
+    // Underflow is folded into the first bin and overflow (including NaN) into
+    // the last, matching BinnedHistogram::createFromTH1D.
+    // Fills that repeat the lookup should hold a BinLookup instead.
+    static int findFoldedBin(const double *first, const double *last, double x) {
+        return BinLookup::search(first, last, x);
+    }
+
+    static int findFoldedBin(const std::vector<double> &edges, double x) {
+        return findFoldedBin(edges.data(), edges.data() + edges.size(), x);
+    }
+
   private:
     std::vector<double> edges_;
     BranchExpression branch_;
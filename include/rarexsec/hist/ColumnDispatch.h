@@ -0,0 +1,161 @@
+#ifndef COLUMN_DISPATCH_H
+#define COLUMN_DISPATCH_H
+
+#include <string>
+#include <type_traits>
+
+#include "ROOT/RDataFrame.hxx"
+#include "ROOT/RVec.hxx"
+
+namespace analysis {
+
+template <typename T> struct ColumnTag {
+    using type = T;
+};
+
+template <typename T> struct IsRVec : std::false_type {};
+template <typename T> struct IsRVec<ROOT::RVec<T>> : std::true_type {};
+
+// Custom RDataFrame actions are booked with explicit column types, so map the
+// type name reported by GetColumnType onto the scalar and vector types that
+// appear in our ntuples and derived columns. Vector columns are filled once per
+// element, matching the behaviour of Histo1D.
+template <typename F> bool dispatchValueColumn(const std::string &type, F &&f) {
+    if (type == "double" || type == "Double_t") {
+        f(ColumnTag<double>{});
+    } else if (type == "float" || type == "Float_t") {
+        f(ColumnTag<float>{});
+    } else if (type == "int" || type == "Int_t") {
+        f(ColumnTag<int>{});
+    } else if (type == "unsigned int" || type == "UInt_t") {
+        f(ColumnTag<unsigned int>{});
+    } else if (type == "Long64_t" || type == "long long") {
+        f(ColumnTag<long long>{});
+    } else if (type == "ULong64_t" || type == "unsigned long long") {
+        f(ColumnTag<unsigned long long>{});
+    } else if (type == "bool" || type == "Bool_t") {
+        f(ColumnTag<bool>{});
+    } else if (type == "ROOT::VecOps::RVec<double>") {
+        f(ColumnTag<ROOT::RVec<double>>{});
+    } else if (type == "ROOT::VecOps::RVec<float>") {
+        f(ColumnTag<ROOT::RVec<float>>{});
+    } else if (type == "ROOT::VecOps::RVec<int>") {
+        f(ColumnTag<ROOT::RVec<int>>{});
+    } else if (type == "ROOT::VecOps::RVec<unsigned int>") {
+        f(ColumnTag<ROOT::RVec<unsigned int>>{});
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Event weights are double or float.
+template <typename F> bool dispatchWeightColumn(const std::string &type, F &&f) {
+    if (type == "double" || type == "Double_t") {
+        f(ColumnTag<double>{});
+    } else if (type == "float" || type == "Float_t") {
+        f(ColumnTag<float>{});
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Universe weight vectors are stored as float, double or (fixed point)
+// unsigned short depending on the generator.
+template <typename F> bool dispatchWeightVectorColumn(const std::string &type, F &&f) {
+    if (type == "ROOT::VecOps::RVec<float>") {
+        f(ColumnTag<float>{});
+    } else if (type == "ROOT::VecOps::RVec<double>") {
+        f(ColumnTag<double>{});
+    } else if (type == "ROOT::VecOps::RVec<unsigned short>") {
+        f(ColumnTag<unsigned short>{});
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Every arithmetic type Histo1D accepts, under its C++ and ROOT names.
+template <typename F> bool dispatchArithmeticColumn(const std::string &type, F &&f) {
+    if (type == "double" || type == "Double_t") {
+        f(ColumnTag<double>{});
+    } else if (type == "float" || type == "Float_t") {
+        f(ColumnTag<float>{});
+    } else if (type == "bool" || type == "Bool_t") {
+        f(ColumnTag<bool>{});
+    } else if (type == "char" || type == "Char_t") {
+        f(ColumnTag<char>{});
+    } else if (type == "signed char") {
+        f(ColumnTag<signed char>{});
+    } else if (type == "unsigned char" || type == "UChar_t") {
+        f(ColumnTag<unsigned char>{});
+    } else if (type == "short" || type == "Short_t") {
+        f(ColumnTag<short>{});
+    } else if (type == "unsigned short" || type == "UShort_t") {
+        f(ColumnTag<unsigned short>{});
+    } else if (type == "int" || type == "Int_t") {
+        f(ColumnTag<int>{});
+    } else if (type == "unsigned int" || type == "UInt_t") {
+        f(ColumnTag<unsigned int>{});
+    } else if (type == "long" || type == "Long_t") {
+        f(ColumnTag<long>{});
+    } else if (type == "unsigned long" || type == "ULong_t") {
+        f(ColumnTag<unsigned long>{});
+    } else if (type == "long long" || type == "Long64_t") {
+        f(ColumnTag<long long>{});
+    } else if (type == "unsigned long long" || type == "ULong64_t") {
+        f(ColumnTag<unsigned long long>{});
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Prefix of the widened copies defined by widenColumn. Like the expression
+// views they exist only for booking and are never written.
+inline constexpr const char *kWidenedPrefix = "_widened_";
+
+inline bool isWidenedColumn(const std::string &column) { return column.rfind(kWidenedPrefix, 0) == 0; }
+
+// Columns outside the dispatch tables above are widened to double, or to
+// RVec<double> for vector columns, so that the typed actions still accept
+// every arithmetic column Histo1D did. The conversion is defined on `node`
+// and the column to book is returned; a column that is already dispatched,
+// or is not arithmetic, is returned unchanged.
+inline std::string widenColumn(ROOT::RDF::RNode &node, const std::string &column, bool dispatched) {
+    if (dispatched)
+        return column;
+    const auto type = node.GetColumnType(column);
+    const std::string widened = kWidenedPrefix + column;
+    if (node.HasColumn(widened))
+        return widened;
+
+    static const std::string rvec_prefix = "ROOT::VecOps::RVec<";
+    const bool is_vector = type.size() > rvec_prefix.size() + 1 &&
+                           type.compare(0, rvec_prefix.size(), rvec_prefix) == 0 && type.back() == '>';
+    const auto element = is_vector ? type.substr(rvec_prefix.size(), type.size() - rvec_prefix.size() - 1) : type;
+    const bool arithmetic = dispatchArithmeticColumn(element, [&](auto tag) {
+        using T = typename decltype(tag)::type;
+        if (is_vector) {
+            node = node.Define(
+                widened, [](const ROOT::RVec<T> &v) { return ROOT::RVec<double>(v.begin(), v.end()); }, {column});
+        } else {
+            node = node.Define(widened, [](T v) { return static_cast<double>(v); }, {column});
+        }
+    });
+    return arithmetic ? widened : column;
+}
+
+template <typename T, typename F> inline void forEachColumnValue(const T &value, F &&f) {
+    if constexpr (IsRVec<T>::value) {
+        for (const auto &v : value)
+            f(static_cast<double>(v));
+    } else {
+        f(static_cast<double>(value));
+    }
+}
+
+}
+
+#endif
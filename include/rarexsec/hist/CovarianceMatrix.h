@@ -0,0 +1,184 @@
+#ifndef COVARIANCE_MATRIX_H
+#define COVARIANCE_MATRIX_H
+
+#include <algorithm>
+#include <cmath>
+#include <optional>
+#include <utility>
+
+#include "TMatrixDSym.h"
+#include <Eigen/Dense>
+
+#include <rarexsec/utils/Logger.h>
+
+namespace analysis {
+
+// Symmetric bin-by-bin covariance kept in packed storage: the lower triangle,
+// column by column, n(n+1)/2 values. The diagonal and the Cholesky factor are
+// computed on first use and cached until the matrix changes; the caches make
+// const access unsafe to share between threads. TMatrixDSym copies are made
+// only where ROOT needs them, e.g. for plotting.
+class CovarianceMatrix {
+  public:
+    CovarianceMatrix() = default;
+
+    explicit CovarianceMatrix(int n) : n_(n), packed_(Eigen::VectorXd::Zero(packedSize(n))) {}
+
+    // Takes the lower triangle of a dense symmetric matrix.
+    explicit CovarianceMatrix(const Eigen::MatrixXd &dense) : CovarianceMatrix(static_cast<int>(dense.rows())) {
+        if (dense.rows() != dense.cols())
+            log::fatal("CovarianceMatrix::CovarianceMatrix", "Matrix is not square");
+        Eigen::Index k = 0;
+        for (int j = 0; j < n_; ++j) {
+            packed_.segment(k, n_ - j) = dense.col(j).tail(n_ - j);
+            k += n_ - j;
+        }
+    }
+
+    static CovarianceMatrix fromTMatrixDSym(const TMatrixDSym &m) {
+        CovarianceMatrix out(m.GetNrows());
+        for (int j = 0; j < out.n_; ++j)
+            for (int i = j; i < out.n_; ++i)
+                out.packed_(index(out.n_, i, j)) = m(i, j);
+        return out;
+    }
+
+    int size() const noexcept { return n_; }
+    bool empty() const noexcept { return n_ == 0; }
+
+    double operator()(int i, int j) const { return i >= j ? packed_(index(n_, i, j)) : packed_(index(n_, j, i)); }
+
+    void set(int i, int j, double value) {
+        packed_(i >= j ? index(n_, i, j) : index(n_, j, i)) = value;
+        this->invalidate();
+    }
+
+    // Lower triangle, column by column.
+    const Eigen::VectorXd &packed() const noexcept { return packed_; }
+
+    static CovarianceMatrix fromPacked(int n, Eigen::VectorXd packed) {
+        if (packed.size() != packedSize(n))
+            log::fatal("CovarianceMatrix::fromPacked", "Expected", packedSize(n), "values, got", packed.size());
+        CovarianceMatrix out;
+        out.n_ = n;
+        out.packed_ = std::move(packed);
+        return out;
+    }
+
+    Eigen::MatrixXd dense() const {
+        Eigen::MatrixXd out(n_, n_);
+        Eigen::Index k = 0;
+        for (int j = 0; j < n_; ++j) {
+            out.col(j).tail(n_ - j) = packed_.segment(k, n_ - j);
+            out.row(j).tail(n_ - j) = packed_.segment(k, n_ - j).transpose();
+            k += n_ - j;
+        }
+        return out;
+    }
+
+    const Eigen::VectorXd &diagonal() const {
+        if (!diagonal_) {
+            Eigen::VectorXd d(n_);
+            for (int i = 0; i < n_; ++i)
+                d(i) = packed_(index(n_, i, i));
+            diagonal_ = std::move(d);
+        }
+        return *diagonal_;
+    }
+
+    double error(int i) const {
+        const double v = this->diagonal()(i);
+        return v > 0 ? std::sqrt(v) : 0;
+    }
+
+    // Lower factor L with L L^T equal to the matrix. A matrix that is not
+    // positive definite is first projected onto the nearest positive
+    // semi-definite one by clipping its negative eigenvalues.
+    const Eigen::MatrixXd &cholesky() const {
+        if (!cholesky_) {
+            const Eigen::MatrixXd cov = this->dense();
+            Eigen::LLT<Eigen::MatrixXd> llt(cov);
+            if (llt.info() == Eigen::NumericalIssue) {
+                Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> es(cov);
+                const Eigen::VectorXd evals = es.eigenvalues().cwiseMax(0.0);
+                llt.compute(es.eigenvectors() * evals.asDiagonal() * es.eigenvectors().transpose());
+            }
+            cholesky_ = Eigen::MatrixXd(llt.matrixL());
+        }
+        return *cholesky_;
+    }
+
+    // Correlations from the cached diagonal, O(n^2).
+    CovarianceMatrix correlation() const {
+        const Eigen::VectorXd &d = this->diagonal();
+        Eigen::VectorXd err(n_);
+        for (int i = 0; i < n_; ++i)
+            err(i) = d(i) > 0 ? std::sqrt(d(i)) : 0;
+        CovarianceMatrix out(n_);
+        Eigen::Index k = 0;
+        for (int j = 0; j < n_; ++j) {
+            for (int i = j; i < n_; ++i, ++k) {
+                const double norm = err(i) * err(j);
+                out.packed_(k) = norm > 1e-12 ? packed_(k) / norm : (i == j ? 1 : 0);
+            }
+        }
+        return out;
+    }
+
+    CovarianceMatrix &operator+=(const CovarianceMatrix &other) {
+        if (other.empty())
+            return *this;
+        if (this->empty()) {
+            *this = other;
+            return *this;
+        }
+        if (n_ != other.n_)
+            log::fatal("CovarianceMatrix::operator+=", "Size mismatch:", n_, "vs", other.n_);
+        packed_ += other.packed_;
+        this->invalidate();
+        return *this;
+    }
+
+    CovarianceMatrix operator+(const CovarianceMatrix &other) const {
+        auto tmp = *this;
+        tmp += other;
+        return tmp;
+    }
+
+    // Non-finite entries are set to zero.
+    void sanitise() {
+        packed_ = packed_.unaryExpr([](double v) { return std::isfinite(v) ? v : 0.0; });
+        this->invalidate();
+    }
+
+    TMatrixDSym toTMatrixDSym() const {
+        TMatrixDSym out(n_);
+        if (n_ == 0)
+            return out;
+        const Eigen::MatrixXd full = this->dense();
+        std::copy(full.data(), full.data() + full.size(), out.GetMatrixArray());
+        return out;
+    }
+
+    static Eigen::Index packedSize(int n) { return static_cast<Eigen::Index>(n) * (n + 1) / 2; }
+
+  private:
+    // Position of (i, j), i >= j, in the packed lower triangle.
+    static Eigen::Index index(int n, int i, int j) {
+        return static_cast<Eigen::Index>(j) * (2 * n - j + 1) / 2 + (i - j);
+    }
+
+    void invalidate() {
+        diagonal_.reset();
+        cholesky_.reset();
+    }
+
+    int n_{0};
+    Eigen::VectorXd packed_;
+    mutable std::optional<Eigen::VectorXd> diagonal_;
+    mutable std::optional<Eigen::MatrixXd> cholesky_;
+};
+
+}
+
+#endif
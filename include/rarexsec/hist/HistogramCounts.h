@@ -0,0 +1,84 @@
+#ifndef HISTOGRAM_COUNTS_H
+#define HISTOGRAM_COUNTS_H
+
+#include <algorithm>
+#include <vector>
+
+#include <Eigen/Dense>
+
+#include <rarexsec/hist/BinningDefinition.h>
+#include <rarexsec/utils/Logger.h>
+
+namespace analysis {
+
+// Plain histogram for the compute path: bin edges, sums of weights and sums
+// of squared weights in one contiguous buffer, with no ROOT object behind it.
+// Under and overflow are folded into the edge bins on fill. Results are turned
+// into a BinnedHistogram only when they reach the analysis result, and into a
+// TH1D only when drawn.
+class HistogramCounts {
+  public:
+    HistogramCounts() = default;
+
+    explicit HistogramCounts(const std::vector<double> &edges)
+        : n_(edges.size() > 1 ? static_cast<int>(edges.size()) - 1 : 0), data_(3 * n_ + 1, 0.0) {
+        if (n_ == 0)
+            log::fatal("HistogramCounts::HistogramCounts", "At least two bin edges are required");
+        std::copy(edges.begin(), edges.end(), data_.begin());
+    }
+
+    // Counts from per-bin sums, e.g. one row of a universe matrix.
+    template <typename SumW, typename SumW2>
+    static HistogramCounts fromSums(const std::vector<double> &edges, const Eigen::MatrixBase<SumW> &sumw,
+                                    const Eigen::MatrixBase<SumW2> &sumw2) {
+        HistogramCounts out(edges);
+        if (sumw.size() != out.n_ || sumw2.size() != out.n_)
+            log::fatal("HistogramCounts::fromSums", "Expected", out.n_, "bins, got", sumw.size(), "and",
+                       sumw2.size());
+        for (int i = 0; i < out.n_; ++i) {
+            out.data_[out.n_ + 1 + i] = sumw(i);
+            out.data_[2 * out.n_ + 1 + i] = sumw2(i);
+        }
+        return out;
+    }
+
+    int size() const noexcept { return n_; }
+    bool empty() const noexcept { return n_ == 0; }
+
+    const double *edges() const noexcept { return data_.data(); }
+
+    Eigen::Map<const Eigen::VectorXd> sumw() const { return {data_.data() + n_ + 1, n_}; }
+    Eigen::Map<const Eigen::VectorXd> sumw2() const { return {data_.data() + 2 * n_ + 1, n_}; }
+
+    void fill(double x, double w) {
+        this->fillBin(BinningDefinition::findFoldedBin(this->edges(), this->edges() + n_ + 1, x), w);
+    }
+
+    // For fills whose bin comes from a shared BinLookup.
+    void fillBin(int bin, double w) {
+        data_[n_ + 1 + bin] += w;
+        data_[2 * n_ + 1 + bin] += w * w;
+    }
+
+    HistogramCounts &operator+=(const HistogramCounts &other) {
+        if (other.empty())
+            return *this;
+        if (this->empty()) {
+            *this = other;
+            return *this;
+        }
+        if (n_ != other.n_)
+            log::fatal("HistogramCounts::operator+=", "Bin count mismatch:", n_, "vs", other.n_);
+        for (int i = n_ + 1; i < 3 * n_ + 1; ++i)
+            data_[i] += other.data_[i];
+        return *this;
+    }
+
+  private:
+    int n_{0};
+    std::vector<double> data_;
+};
+
+}
+
+#endif
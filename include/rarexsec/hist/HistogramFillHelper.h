@@ -0,0 +1,94 @@
+#ifndef HISTOGRAM_FILL_HELPER_H
+#define HISTOGRAM_FILL_HELPER_H
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "ROOT/RDF/RActionImpl.hxx"
+#include "ROOT/RDataFrame.hxx"
+#include "ROOT/RVec.hxx"
+
+#include <rarexsec/hist/BinLookup.h>
+#include <rarexsec/hist/BinningDefinition.h>
+#include <rarexsec/hist/ColumnDispatch.h>
+#include <rarexsec/hist/HistogramCounts.h>
+#include <rarexsec/utils/Logger.h>
+
+namespace analysis {
+
+// RDataFrame action filling a HistogramCounts in place of Histo1D, so that no
+// TH1D is created or registered per booked histogram. Each slot fills its own
+// copy and the copies are summed in Finalize.
+template <typename Value, typename Weight>
+class HistogramFillHelper : public ROOT::Detail::RDF::RActionImpl<HistogramFillHelper<Value, Weight>> {
+  public:
+    using Result_t = HistogramCounts;
+
+    HistogramFillHelper(const std::vector<double> &edges, unsigned n_slots)
+        : lookup_(edges), result_(std::make_shared<Result_t>(edges)), slot_counts_(n_slots, *result_) {}
+
+    HistogramFillHelper(HistogramFillHelper &&) = default;
+    HistogramFillHelper(const HistogramFillHelper &) = delete;
+
+    std::shared_ptr<Result_t> GetResultPtr() const { return result_; }
+
+    void Initialize() {}
+
+    void InitTask(TTreeReader *, unsigned int) {}
+
+    void Exec(unsigned int slot, const Value &value, const Weight &weight) {
+        auto &counts = slot_counts_[slot];
+        const double w = static_cast<double>(weight);
+        forEachColumnValue(value, [&](double x) { counts.fillBin(lookup_.find(x), w); });
+    }
+
+    void Finalize() {
+        for (const auto &counts : slot_counts_)
+            *result_ += counts;
+    }
+
+    std::string GetActionName() { return "HistogramFill"; }
+
+  private:
+    BinLookup lookup_;
+    std::shared_ptr<Result_t> result_;
+    std::vector<Result_t> slot_counts_;
+};
+
+// Books the binned variable weighted by `weight_column`.
+inline ROOT::RDF::RResultPtr<HistogramCounts> bookHistogramCounts(ROOT::RDF::RNode dataframe,
+                                                                  const BinningDefinition &binning,
+                                                                  const std::string &weight_column) {
+    const auto none = [](auto) {};
+    const auto &name = binning.getVariable();
+    const auto variable = widenColumn(dataframe, name, dispatchValueColumn(dataframe.GetColumnType(name), none));
+    const auto weight = widenColumn(dataframe, weight_column,
+                                    dispatchWeightColumn(dataframe.GetColumnType(weight_column), none));
+    const auto value_type = dataframe.GetColumnType(variable);
+    const auto weight_type = dataframe.GetColumnType(weight);
+    const auto n_slots = dataframe.GetNSlots();
+
+    ROOT::RDF::RResultPtr<HistogramCounts> future;
+    bool booked = false;
+    dispatchValueColumn(value_type, [&](auto value_tag) {
+        using Value = typename decltype(value_tag)::type;
+        dispatchWeightColumn(weight_type, [&](auto weight_tag) {
+            using Weight = typename decltype(weight_tag)::type;
+            future = dataframe.Book<Value, Weight>(HistogramFillHelper<Value, Weight>(binning.getEdges(), n_slots),
+                                                   {variable, weight});
+            booked = true;
+        });
+    });
+
+    if (!booked) {
+        log::fatal("bookHistogramCounts", "Unsupported column types for", name, "(", value_type, "),", weight_column,
+                   "(", weight_type, ")");
+    }
+    return future;
+}
+
+}
+
+#endif
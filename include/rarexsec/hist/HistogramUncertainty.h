@@ -1,36 +1,55 @@
 #ifndef HISTOGRAM_UNCERTAINTY_H
 #define HISTOGRAM_UNCERTAINTY_H
 
+#include <algorithm>
 #include <cmath>
 #include <numeric>
 #include <vector>
 
-#include "TMatrixDSym.h"
 #include <Eigen/Dense>
 
 #include <rarexsec/utils/Logger.h>
 #include <rarexsec/hist/BinningDefinition.h>
+#include <rarexsec/hist/CovarianceMatrix.h>
 
 namespace analysis {
 
+// Bin counts with their uncertainty, held in one of two forms. Statistical
+// uncertainties are kept as per-bin variances (sums of squared weights), so
+// that accumulating histograms is a plain add and the square root is only
+// taken when an error is read. Correlated uncertainties, such as a combined
+// systematic band, are kept as a matrix of shifts whose row norms are the bin
+// errors. At most one of `variance` and `shifts` is non-empty.
 class HistogramUncertainty {
   public:
     BinningDefinition binning;
     std::vector<double> counts;
     Eigen::MatrixXd shifts;
+    Eigen::VectorXd variance;
 
     HistogramUncertainty() = default;
     HistogramUncertainty(const BinningDefinition &b, const std::vector<double> &c, const Eigen::MatrixXd &s);
 
+    // Counts with statistical variances `v`.
+    static HistogramUncertainty fromVariance(const BinningDefinition &b, const std::vector<double> &c,
+                                             const Eigen::VectorXd &v);
+
     std::size_t size() const { return binning.getBinNumber(); }
     double count(int i) const { return counts.at(i); }
     double err(int i) const;
+    double var(int i) const;
     double sum() const;
     double sumErr() const;
-    TMatrixDSym covariance() const;
-    TMatrixDSym corrMat() const;
+    CovarianceMatrix covariance() const;
+    CovarianceMatrix corrMat() const;
+
+    void addCovariance(const CovarianceMatrix &cov_to_add);
+
+    // Drops every uncertainty; counts are kept.
+    void clearErrors();
 
-    void addCovariance(const TMatrixDSym &cov_to_add);
+    // Sets the count and the uncertainty of bin `i` to zero.
+    void clearBin(int i);
 
     HistogramUncertainty operator+(double s) const;
     HistogramUncertainty operator*(double s) const;
@@ -39,7 +58,26 @@ class HistogramUncertainty {
     HistogramUncertainty operator*(const HistogramUncertainty &o) const;
     HistogramUncertainty operator/(const HistogramUncertainty &o) const;
 
+    // In-place forms of the above: counts and variances are updated directly,
+    // without copying the histogram or its binning.
+    HistogramUncertainty &operator+=(const HistogramUncertainty &o) { return this->axpy(1.0, o); }
+    HistogramUncertainty &operator-=(const HistogramUncertainty &o) { return this->axpy(-1.0, o); }
+    HistogramUncertainty &operator*=(double s);
+
+    // this += a * o
+    HistogramUncertainty &axpy(double a, const HistogramUncertainty &o);
+
+    // Adds per-bin sums of weights and squared weights, as filled by the
+    // stratified fill helper. An empty histogram takes the binning `b`.
+    template <typename SumW, typename SumW2>
+    HistogramUncertainty &addSums(const BinningDefinition &b, const Eigen::MatrixBase<SumW> &sumw,
+                                  const Eigen::MatrixBase<SumW2> &sumw2);
+
     friend HistogramUncertainty operator*(double s, const HistogramUncertainty &h) { return h * s; }
+
+  private:
+    // Moves the uncertainty into `variance`, dropping correlations.
+    void collapseToVariance();
 };
 
 inline HistogramUncertainty::HistogramUncertainty(const BinningDefinition &b, const std::vector<double> &c,
@@ -51,10 +89,26 @@ inline HistogramUncertainty::HistogramUncertainty(const BinningDefinition &b, co
         log::fatal("HistogramUncertainty::HistogramUncertainty", "Dimension mismatch");
 }
 
-inline double HistogramUncertainty::err(int i) const {
-    if (i < 0 || i >= shifts.rows())
+inline HistogramUncertainty HistogramUncertainty::fromVariance(const BinningDefinition &b,
+                                                               const std::vector<double> &c,
+                                                               const Eigen::VectorXd &v) {
+    HistogramUncertainty out(b, c, Eigen::MatrixXd(c.size(), 0));
+    if (v.size() != static_cast<int>(c.size()))
+        log::fatal("HistogramUncertainty::fromVariance", "Dimension mismatch");
+    out.variance = v;
+    return out;
+}
+
+inline double HistogramUncertainty::var(int i) const {
+    if (i < 0 || i >= static_cast<int>(counts.size()))
         return 0;
-    double v = shifts.row(i).squaredNorm();
+    if (variance.size() != 0)
+        return std::max(variance(i), 0.0);
+    return shifts.cols() != 0 ? shifts.row(i).squaredNorm() : 0.0;
+}
+
+inline double HistogramUncertainty::err(int i) const {
+    const double v = this->var(i);
     return v > 0 ? std::sqrt(v) : 0;
 }
 
@@ -62,75 +116,65 @@ inline double HistogramUncertainty::sum() const { return std::accumulate(counts.
 
 inline double HistogramUncertainty::sumErr() const {
     int n = this->size();
-    if (n == 0 || shifts.size() == 0)
+    if (n == 0)
         return 0;
-    if (shifts.cols() == 1) {
-        double var = shifts.col(0).squaredNorm();
-        return var > 0 ? std::sqrt(var) : 0;
+    double var = 0;
+    if (variance.size() != 0) {
+        var = variance.cwiseMax(0.0).sum();
+    } else if (shifts.cols() == 1) {
+        var = shifts.col(0).squaredNorm();
+    } else if (shifts.cols() > 1) {
+        Eigen::VectorXd ones = Eigen::VectorXd::Ones(n);
+        var = (shifts.transpose() * ones).squaredNorm();
     }
-    Eigen::VectorXd ones = Eigen::VectorXd::Ones(n);
-    double var = (shifts.transpose() * ones).squaredNorm();
     return var > 0 ? std::sqrt(var) : 0;
 }
 
-inline TMatrixDSym HistogramUncertainty::covariance() const {
-    int n = this->size();
-    TMatrixDSym out(n);
-    out.Zero();
-    if (shifts.size() == 0)
+inline CovarianceMatrix HistogramUncertainty::covariance() const {
+    const int n = this->size();
+    if (variance.size() != 0 || shifts.cols() == 1) {
+        CovarianceMatrix out(n);
+        for (int i = 0; i < n; ++i)
+            out.set(i, i, this->var(i));
         return out;
-    Eigen::MatrixXd cov;
-    if (shifts.cols() == 1) {
-        cov = shifts.col(0).array().square().matrix().asDiagonal();
-    } else {
-        cov = shifts * shifts.transpose();
     }
-    for (int i = 0; i < n; ++i) {
-        for (int j = 0; j <= i; ++j) {
-            double val = cov(i, j);
-            out(i, j) = val;
-            out(j, i) = val;
-        }
-    }
-    return out;
+    if (shifts.size() == 0)
+        return CovarianceMatrix(n);
+    Eigen::MatrixXd cov = Eigen::MatrixXd::Zero(n, n);
+    cov.selfadjointView<Eigen::Lower>().rankUpdate(shifts);
+    return CovarianceMatrix(cov);
 }
 
-inline TMatrixDSym HistogramUncertainty::corrMat() const {
-    int n = this->size();
-    TMatrixDSym cov = this->covariance();
-    TMatrixDSym out(n);
-    for (int i = 0; i < n; ++i) {
-        for (int j = 0; j < n; ++j) {
-            double d = this->err(i) * this->err(j);
-            out(i, j) = d > 1e-12 ? cov(i, j) / d : (i == j ? 1 : 0);
-        }
-    }
-    return out;
+inline CovarianceMatrix HistogramUncertainty::corrMat() const { return this->covariance().correlation(); }
+
+// The combined covariance is carried as its Cholesky factor, so the bin
+// errors remain the row norms of the shifts.
+inline void HistogramUncertainty::addCovariance(const CovarianceMatrix &cov_to_add) {
+    shifts = (this->covariance() + cov_to_add).cholesky();
+    variance.resize(0);
 }
 
-inline void HistogramUncertainty::addCovariance(const TMatrixDSym &cov_to_add) {
-    int n = this->size();
-    Eigen::MatrixXd cov_e(n, n);
-    for (int i = 0; i < n; ++i)
-        for (int j = 0; j < n; ++j)
-            cov_e(i, j) = cov_to_add(i, j);
-    Eigen::MatrixXd base_cov;
-    if (shifts.cols() == 1) {
-        base_cov = shifts.col(0).array().square().matrix().asDiagonal();
-    } else {
-        base_cov = shifts * shifts.transpose();
-    }
-    Eigen::MatrixXd cov = base_cov + cov_e;
-    Eigen::LLT<Eigen::MatrixXd> llt(cov);
-    if (llt.info() == Eigen::NumericalIssue) {
-        Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> es(cov);
-        Eigen::VectorXd evals = es.eigenvalues().cwiseMax(0.0);
-        Eigen::MatrixXd cov_psd = es.eigenvectors() * evals.asDiagonal() * es.eigenvectors().transpose();
-        Eigen::LLT<Eigen::MatrixXd> llt_psd(cov_psd);
-        shifts = llt_psd.matrixL();
-    } else {
-        shifts = llt.matrixL();
-    }
+inline void HistogramUncertainty::collapseToVariance() {
+    if (variance.size() == static_cast<int>(counts.size()))
+        return;
+    Eigen::VectorXd v(counts.size());
+    for (int i = 0; i < v.size(); ++i)
+        v(i) = this->var(i);
+    variance = std::move(v);
+    shifts.resize(counts.size(), 0);
+}
+
+inline void HistogramUncertainty::clearErrors() {
+    shifts.resize(counts.size(), 0);
+    variance.resize(0);
+}
+
+inline void HistogramUncertainty::clearBin(int i) {
+    counts.at(i) = 0.0;
+    if (variance.size() != 0)
+        variance(i) = 0.0;
+    if (shifts.cols() != 0)
+        shifts.row(i).setZero();
 }
 
 inline HistogramUncertainty HistogramUncertainty::operator+(double s) const {
@@ -142,67 +186,82 @@ inline HistogramUncertainty HistogramUncertainty::operator+(double s) const {
 
 inline HistogramUncertainty HistogramUncertainty::operator*(double s) const {
     auto tmp = *this;
-    for (auto &v : tmp.counts)
-        v *= s;
-    tmp.shifts *= s;
+    tmp *= s;
     return tmp;
 }
 
 inline HistogramUncertainty HistogramUncertainty::operator+(const HistogramUncertainty &o) const {
-    if (this->size() <= 0)
-        return o;
-    if (o.size() <= 0)
-        return *this;
-    if (this->size() != o.size()) {
-        log::fatal("HistogramUncertainty::operator+", "Attempting to add histograms with different numbers of bins.");
-    }
     auto tmp = *this;
-    int n = this->size();
-    for (int i = 0; i < n; ++i) {
-        tmp.counts[i] += o.counts[i];
-    }
-    if (shifts.rows() != o.shifts.rows()) {
-        log::error("HistogramUncertainty::operator+", "Shifts matrix dimension mismatch: ", shifts.rows(), " vs ",
-                   o.shifts.rows());
-        return HistogramUncertainty();
-    }
-    Eigen::VectorXd errs(n);
-    for (int i = 0; i < n; ++i) {
-        double e1 = this->err(i);
-        double e2 = o.err(i);
-        errs(i) = std::sqrt(e1 * e1 + e2 * e2);
-    }
-    tmp.shifts = errs;
+    tmp += o;
     return tmp;
 }
 
 inline HistogramUncertainty HistogramUncertainty::operator-(const HistogramUncertainty &o) const {
-    if (this->size() <= 0)
-        return o * -1.0;
+    auto tmp = *this;
+    tmp -= o;
+    return tmp;
+}
+
+inline HistogramUncertainty &HistogramUncertainty::operator*=(double s) {
+    for (auto &v : counts)
+        v *= s;
+    shifts *= s;
+    variance *= s * s;
+    return *this;
+}
+
+inline HistogramUncertainty &HistogramUncertainty::axpy(double a, const HistogramUncertainty &o) {
     if (o.size() <= 0)
         return *this;
+    if (this->size() <= 0) {
+        *this = o;
+        if (a != 1.0)
+            *this *= a;
+        return *this;
+    }
     if (this->size() != o.size()) {
-        log::fatal("HistogramUncertainty::operator-", "Attempting to subtract histograms with different numbers "
-                                                      "of bins.");
+        log::fatal("HistogramUncertainty::axpy", "Attempting to add histograms with different numbers of bins.");
     }
-    auto tmp = *this;
-    int n = this->size();
-    for (int i = 0; i < n; ++i) {
-        tmp.counts[i] -= o.counts[i];
+    const int n = this->size();
+    for (int i = 0; i < n; ++i)
+        counts[i] += a * o.counts[i];
+
+    // Correlated shifts are collapsed to their variances, as the sum carries
+    // statistical uncertainties only.
+    this->collapseToVariance();
+    const double a2 = a * a;
+    if (o.variance.size() != 0) {
+        variance += a2 * o.variance;
+    } else {
+        for (int i = 0; i < n; ++i)
+            variance(i) += a2 * o.var(i);
     }
-    if (shifts.rows() != o.shifts.rows()) {
-        log::error("HistogramUncertainty::operator-", "Shifts matrix dimension mismatch: ", shifts.rows(), " vs ",
-                   o.shifts.rows());
-        return HistogramUncertainty();
+    return *this;
+}
+
+template <typename SumW, typename SumW2>
+HistogramUncertainty &HistogramUncertainty::addSums(const BinningDefinition &b, const Eigen::MatrixBase<SumW> &sumw,
+                                                    const Eigen::MatrixBase<SumW2> &sumw2) {
+    const int n = static_cast<int>(sumw.size());
+    if (this->size() <= 0) {
+        std::vector<double> c(n);
+        Eigen::VectorXd v(n);
+        for (int i = 0; i < n; ++i) {
+            c[i] = sumw(i);
+            v(i) = std::max(sumw2(i), 0.0);
+        }
+        *this = fromVariance(b, c, v);
+        return *this;
     }
-    Eigen::VectorXd errs(n);
+    if (static_cast<int>(this->size()) != n || sumw2.size() != n) {
+        log::fatal("HistogramUncertainty::addSums", "Attempting to add sums with different numbers of bins.");
+    }
+    this->collapseToVariance();
     for (int i = 0; i < n; ++i) {
-        double e1 = this->err(i);
-        double e2 = o.err(i);
-        errs(i) = std::sqrt(e1 * e1 + e2 * e2);
+        counts[i] += sumw(i);
+        variance(i) += std::max(sumw2(i), 0.0);
     }
-    tmp.shifts = errs;
-    return tmp;
+    return *this;
 }
 
 inline HistogramUncertainty HistogramUncertainty::operator*(const HistogramUncertainty &o) const {
@@ -214,17 +273,15 @@ inline HistogramUncertainty HistogramUncertainty::operator*(const HistogramUncer
     }
     auto tmp = *this;
     int n = this->size();
-    tmp.shifts = Eigen::VectorXd::Zero(n);
+    tmp.shifts.resize(n, 0);
+    tmp.variance = Eigen::VectorXd::Zero(n);
     for (int i = 0; i < n; ++i) {
         tmp.counts[i] *= o.counts[i];
         double v1 = counts[i];
         double v2 = o.counts[i];
-        double e1 = this->err(i);
-        double e2 = o.err(i);
-        double rel1 = v1 != 0 ? e1 / v1 : 0;
-        double rel2 = v2 != 0 ? e2 / v2 : 0;
-        double er = std::abs(tmp.counts[i]) * std::sqrt(rel1 * rel1 + rel2 * rel2);
-        tmp.shifts(i) = er;
+        double rel1 = v1 != 0 ? this->var(i) / (v1 * v1) : 0;
+        double rel2 = v2 != 0 ? o.var(i) / (v2 * v2) : 0;
+        tmp.variance(i) = tmp.counts[i] * tmp.counts[i] * (rel1 + rel2);
     }
     return tmp;
 }
@@ -238,21 +295,18 @@ inline HistogramUncertainty HistogramUncertainty::operator/(const HistogramUncer
     }
     auto tmp = *this;
     int n = this->size();
-    tmp.shifts = Eigen::VectorXd::Zero(n);
+    tmp.shifts.resize(n, 0);
+    tmp.variance = Eigen::VectorXd::Zero(n);
     for (int i = 0; i < n; ++i) {
         if (o.counts[i] != 0) {
             tmp.counts[i] /= o.counts[i];
             double v1 = counts[i];
             double v2 = o.counts[i];
-            double e1 = this->err(i);
-            double e2 = o.err(i);
-            double rel1 = v1 != 0 ? e1 / v1 : 0;
-            double rel2 = v2 != 0 ? e2 / v2 : 0;
-            double er = std::abs(tmp.counts[i]) * std::sqrt(rel1 * rel1 + rel2 * rel2);
-            tmp.shifts(i) = er;
+            double rel1 = v1 != 0 ? this->var(i) / (v1 * v1) : 0;
+            double rel2 = v2 != 0 ? o.var(i) / (v2 * v2) : 0;
+            tmp.variance(i) = tmp.counts[i] * tmp.counts[i] * (rel1 + rel2);
         } else {
             tmp.counts[i] = 0;
-            tmp.shifts(i) = 0;
         }
     }
     return tmp;
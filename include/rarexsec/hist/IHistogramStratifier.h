@@ -14,6 +14,8 @@
 #include <rarexsec/utils/Logger.h>
 #include <rarexsec/hist/BinnedHistogram.h>
 #include <rarexsec/hist/BinningDefinition.h>
+#include <rarexsec/hist/ColumnDispatch.h>
+#include <rarexsec/hist/StratifiedFillHelper.h>
 #include <rarexsec/core/AnalysisKey.h>
 #include <rarexsec/hist/StratifierRegistry.h>
 
@@ -23,29 +25,50 @@ class IHistogramStratifier {
   public:
     virtual ~IHistogramStratifier() = default;
 
-    std::unordered_map<StratumKey, ROOT::RDF::RResultPtr<TH1D>> stratifyHist(ROOT::RDF::RNode dataframe,
-                                                                             const BinningDefinition &binning,
-                                                                             const ROOT::RDF::TH1DModel &hist_model,
-                                                                             const std::string &weight_column) const {
+    // Books a single action that fills every stratum of the scheme in one pass.
+    StratifiedFuture stratifyHist(ROOT::RDF::RNode dataframe, const BinningDefinition &binning,
+                                  const std::string &weight_column) const {
         analysis::log::info("IHistogramStratifier::stratifyHist", "Starting stratifiying histograms...");
-        std::unordered_map<StratumKey, ROOT::RDF::RResultPtr<TH1D>> strat_futurs;
-        auto df_with_filters = dataframe;
+        StratifiedFuture future;
+        future.keys = this->getRegistryKeys();
 
-        for (const auto &key : this->getRegistryKeys()) {
-            std::string stratum_key_str = key.str();
-            std::replace(stratum_key_str.begin(), stratum_key_str.end(), '-', 'n');
-            std::string filter_col_name = "pass_" + this->getSchemeName() + "_" + stratum_key_str;
+        const auto none = [](auto) {};
+        const auto &name = binning.getVariable();
+        const auto variable =
+            widenColumn(dataframe, name, dispatchValueColumn(dataframe.GetColumnType(name), none));
+        const auto weight = widenColumn(dataframe, weight_column,
+                                        dispatchWeightColumn(dataframe.GetColumnType(weight_column), none));
+        const auto &scheme = this->getSchemeName();
+        const auto value_type = dataframe.GetColumnType(variable);
+        const auto scheme_type = dataframe.GetColumnType(scheme);
+        const auto weight_type = dataframe.GetColumnType(weight);
+        const auto n_slots = dataframe.GetNSlots();
 
-            df_with_filters = this->defineFilterColumn(df_with_filters, std::stoi(key.str()), filter_col_name);
-            strat_futurs[key] =
-                df_with_filters.Filter(filter_col_name).Histo1D(hist_model, binning.getVariable(), weight_column);
+        bool booked = false;
+        dispatchValueColumn(value_type, [&](auto value_tag) {
+            using Value = typename decltype(value_tag)::type;
+            dispatchStratumColumn(scheme_type, [&](auto scheme_tag) {
+                using Scheme = typename decltype(scheme_tag)::type;
+                dispatchWeightColumn(weight_type, [&](auto weight_tag) {
+                    using Weight = typename decltype(weight_tag)::type;
+                    future.counts = dataframe.Book<Value, Scheme, Weight>(
+                        StratifiedFillHelper<Value, Scheme, Weight>(binning.getEdges(), this->stratumIndex(),
+                                                                    n_slots),
+                        {variable, scheme, weight});
+                    booked = true;
+                });
+            });
+        });
+
+        if (!booked) {
+            log::fatal("IHistogramStratifier::stratifyHist", "Unsupported column types for", name, "(",
+                       value_type, "),", scheme, "(", scheme_type, "),", weight_column, "(", weight_type, ")");
         }
-        return strat_futurs;
+        return future;
     }
 
   protected:
-    virtual ROOT::RDF::RNode defineFilterColumn(ROOT::RDF::RNode dataframe, int key,
-                                                const std::string &new_column_name) const = 0;
+    virtual StratumIndex stratumIndex() const = 0;
 
     virtual const std::string &getSchemeName() const = 0;
     virtual const StratifierRegistry &getRegistry() const = 0;
@@ -16,11 +16,8 @@ class ScalarStratifier : public IHistogramStratifier {
         : stratifier_key_(key), stratifier_registry_(registry) {}
 
   protected:
-    ROOT::RDF::RNode defineFilterColumn(ROOT::RDF::RNode dataframe, int key,
-                                        const std::string &new_column_name) const override {
-        std::string filter_expression = this->getSchemeName() + " == " + std::to_string(key);
-
-        return dataframe.Define(new_column_name, filter_expression);
+    StratumIndex stratumIndex() const override {
+        return StratumIndex(stratifier_registry_.getAllStratumIntKeysForScheme(this->getSchemeName()));
     }
 
     const std::string &getSchemeName() const override { return stratifier_key_.str(); }
@@ -0,0 +1,160 @@
+#ifndef STRATIFIED_FILL_HELPER_H
+#define STRATIFIED_FILL_HELPER_H
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "ROOT/RDF/RActionImpl.hxx"
+#include "ROOT/RDataFrame.hxx"
+#include "ROOT/RVec.hxx"
+#include <Eigen/Dense>
+
+#include <rarexsec/core/AnalysisKey.h>
+#include <rarexsec/hist/BinLookup.h>
+#include <rarexsec/hist/BinningDefinition.h>
+#include <rarexsec/hist/ColumnDispatch.h>
+#include <rarexsec/hist/StratifierRegistry.h>
+
+namespace analysis {
+
+// Per-stratum sums of weights and squared weights, one row per stratum.
+struct StratifiedCounts {
+    Eigen::MatrixXd sumw;
+    Eigen::MatrixXd sumw2;
+};
+
+struct StratifiedFuture {
+    std::vector<StratumKey> keys;
+    ROOT::RDF::RResultPtr<StratifiedCounts> counts;
+};
+
+// Maps a stratifier value onto dense row indices. Scalar schemes use a flat
+// table over the key range; vector schemes test each stratum with the
+// registered predicate since an event may belong to several strata.
+class StratumIndex {
+  public:
+    StratumIndex(std::vector<int> keys, VectorFilterPredicate predicate = nullptr)
+        : keys_(std::move(keys)), predicate_(std::move(predicate)) {
+        if (keys_.empty())
+            return;
+        const auto [lo, hi] = std::minmax_element(keys_.begin(), keys_.end());
+        if (static_cast<long long>(*hi) - *lo < kMaxTableSpan) {
+            offset_ = *lo;
+            table_.assign(static_cast<std::size_t>(*hi - *lo + 1), -1);
+            for (std::size_t i = 0; i < keys_.size(); ++i)
+                table_[keys_[i] - offset_] = static_cast<int>(i);
+        }
+    }
+
+    std::size_t size() const { return keys_.size(); }
+
+    const std::vector<int> &keys() const { return keys_; }
+
+    int find(long long value) const {
+        if (!table_.empty()) {
+            const long long i = value - offset_;
+            return i >= 0 && i < static_cast<long long>(table_.size()) ? table_[i] : -1;
+        }
+        auto it = std::find(keys_.begin(), keys_.end(), value);
+        return it != keys_.end() ? static_cast<int>(it - keys_.begin()) : -1;
+    }
+
+    template <typename F> void forEach(const ROOT::RVec<int> &values, F &&f) const {
+        for (std::size_t i = 0; i < keys_.size(); ++i) {
+            if (predicate_(values, keys_[i]))
+                f(static_cast<int>(i));
+        }
+    }
+
+  private:
+    static constexpr long long kMaxTableSpan = 1 << 12;
+
+    std::vector<int> keys_;
+    VectorFilterPredicate predicate_;
+    std::vector<int> table_;
+    int offset_{0};
+};
+
+// RDataFrame action that reads the stratifier column once per event and fills
+// every stratum of a variable in a single pass, replacing one Filter and
+// Histo1D per stratum. Under and overflow are folded into the edge bins.
+template <typename Value, typename Scheme, typename Weight>
+class StratifiedFillHelper : public ROOT::Detail::RDF::RActionImpl<StratifiedFillHelper<Value, Scheme, Weight>> {
+  public:
+    using Result_t = StratifiedCounts;
+
+    StratifiedFillHelper(std::vector<double> edges, StratumIndex index, unsigned n_slots)
+        : lookup_(std::move(edges)), index_(std::move(index)), result_(std::make_shared<Result_t>()) {
+        const auto n_strata = static_cast<Eigen::Index>(index_.size());
+        const auto n_bins = static_cast<Eigen::Index>(lookup_.size());
+        result_->sumw = Eigen::MatrixXd::Zero(n_strata, n_bins);
+        result_->sumw2 = Eigen::MatrixXd::Zero(n_strata, n_bins);
+        slot_counts_.assign(n_slots, *result_);
+    }
+
+    StratifiedFillHelper(StratifiedFillHelper &&) = default;
+    StratifiedFillHelper(const StratifiedFillHelper &) = delete;
+
+    std::shared_ptr<Result_t> GetResultPtr() const { return result_; }
+
+    void Initialize() {}
+
+    void InitTask(TTreeReader *, unsigned int) {}
+
+    void Exec(unsigned int slot, const Value &value, const Scheme &scheme, const Weight &weight) {
+        auto &counts = slot_counts_[slot];
+        const double w = static_cast<double>(weight);
+        const auto fill = [&](int stratum) {
+            forEachColumnValue(value, [&](double x) {
+                const int bin = lookup_.find(x);
+                counts.sumw(stratum, bin) += w;
+                counts.sumw2(stratum, bin) += w * w;
+            });
+        };
+
+        if constexpr (IsRVec<Scheme>::value) {
+            index_.forEach(scheme, fill);
+        } else {
+            const int stratum = index_.find(static_cast<long long>(scheme));
+            if (stratum >= 0)
+                fill(stratum);
+        }
+    }
+
+    void Finalize() {
+        for (const auto &counts : slot_counts_) {
+            result_->sumw += counts.sumw;
+            result_->sumw2 += counts.sumw2;
+        }
+    }
+
+    std::string GetActionName() { return "StratifiedFill"; }
+
+  private:
+    BinLookup lookup_;
+    StratumIndex index_;
+    std::shared_ptr<Result_t> result_;
+    std::vector<Result_t> slot_counts_;
+};
+
+// Stratifier columns are plain integer channels or vectors of PDG-like codes.
+template <typename F> bool dispatchStratumColumn(const std::string &type, F &&f) {
+    if (type == "int" || type == "Int_t") {
+        f(ColumnTag<int>{});
+    } else if (type == "unsigned int" || type == "UInt_t") {
+        f(ColumnTag<unsigned int>{});
+    } else if (type == "ROOT::VecOps::RVec<int>") {
+        f(ColumnTag<ROOT::RVec<int>>{});
+    } else {
+        return false;
+    }
+    return true;
+}
+
+}
+
+#endif
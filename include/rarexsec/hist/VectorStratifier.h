@@ -20,17 +20,9 @@ class VectorStratifier : public IHistogramStratifier {
         : strat_key_(key), strat_registry_(registry) {}
 
   protected:
-    ROOT::RDF::RNode defineFilterColumn(ROOT::RDF::RNode dataframe, int key,
-                                        const std::string &new_column_name) const override {
-        std::vector<std::string> columns = {this->getSchemeName()};
-
-        return dataframe.Define(
-            new_column_name,
-            [this, key](const ROOT::RVec<int> &branch_values) {
-                auto predicate = this->strat_registry_.findPredicate(this->strat_key_);
-                return predicate(branch_values, key);
-            },
-            columns);
+    StratumIndex stratumIndex() const override {
+        return StratumIndex(strat_registry_.getAllStratumIntKeysForScheme(this->getSchemeName()),
+                            strat_registry_.findPredicate(strat_key_));
     }
 
     const std::string &getSchemeName() const override { return strat_key_.str(); }
@@ -296,12 +296,12 @@ class StackedHistogramPlot : public IHistogramPlot {
         mc_stack_->SetMinimum(use_log_y_ ? 0.1 : 0.0);
 
         if (total_mc_hist_) {
-            TMatrixDSym total_syst_cov = variable_result_.total_covariance_;
+            const auto &total_syst_cov = variable_result_.total_covariance_;
 
             for (int i = 1; i <= total_mc_hist_->GetNbinsX(); ++i) {
                 double stat_err = total_mc_hist_->GetBinError(i);
-                double syst_err = (i - 1 < total_syst_cov.GetNrows())
-                                      ? std::sqrt(total_syst_cov(i - 1, i - 1))
+                double syst_err = (i - 1 < total_syst_cov.size())
+                                      ? total_syst_cov.error(i - 1)
                                       : 0.0;
                 double total_err =
                     std::sqrt(stat_err * stat_err + syst_err * syst_err);
@@ -44,7 +44,7 @@ class SystematicBreakdownPlot : public IHistogramPlot {
 
         std::vector<double> bin_totals(nbins, 0.0);
         for (const auto &[key, cov] : variable_result_.covariance_matrices_) {
-            const int n = cov.GetNrows();
+            const int n = cov.size();
             for (int i = 0; i < nbins && i < n; ++i) {
                 double val = cov(i, i);
                 if (std::isfinite(val)) {
@@ -73,7 +73,7 @@ class SystematicBreakdownPlot : public IHistogramPlot {
         int colour = kRed + colour_offset;
         for (const auto &[key, cov] : variable_result_.covariance_matrices_) {
             TH1D *hist = new TH1D(key.str().c_str(), "", nbins, edges.data());
-            const int n = cov.GetNrows();
+            const int n = cov.size();
             for (int i = 0; i < nbins && i < n; ++i) {
                 double val = cov(i, i);
                 if (std::isfinite(val)) {
@@ -10,6 +10,13 @@ class IPlotPlugin {
     virtual ~IPlotPlugin() = default;
 
     virtual void onPlot(const AnalysisResult &result) = 0;
+
+    // Whether onPlot reads events through the data loader. Plots of the
+    // result alone are rendered without building any sample frame.
+    virtual bool readsEvents() const { return false; }
+
+    // Whether onPlot has to run with implicit MT off.
+    virtual bool singleThreaded() const { return false; }
 };
 
 }
@@ -1,21 +1,34 @@
 #pragma once
 
 #include <algorithm>
+#include <cstdlib>
+#include <exception>
+#include <filesystem>
 #include <fstream>
+#include <iostream>
 #include <memory>
 #include <string>
+#include <thread>
 #include <unordered_map>
 #include <utility>
 #include <vector>
 
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
 #include <ROOT/RDataFrame.hxx>
 #include <nlohmann/json.hpp>
 
 #include <rarexsec/core/AnalysisResult.h>
+#include <rarexsec/core/AnalysisResultIO.h>
 #include <rarexsec/core/AnalysisRunner.h>
+#include <rarexsec/core/ResultCache.h>
 #include <rarexsec/data/AnalysisDataLoader.h>
 #include <rarexsec/data/RunConfigLoader.h>
 #include <rarexsec/data/RunConfigRegistry.h>
+#include <rarexsec/data/SampleCache.h>
+#include <rarexsec/data/ShardSpec.h>
 #include <rarexsec/data/VariableRegistry.h>
 #include <rarexsec/hist/HistogramFactory.h>
 #include <rarexsec/plug/PluginAliases.h>
@@ -32,7 +45,10 @@ inline AnalysisResult processBeamline(RunConfigRegistry &run_config_registry,
                                       const std::string &beam,
                                       const nlohmann::json &runs,
                                       const PluginSpecList &analysis_specs,
-                                      const PluginSpecList &syst_specs) {
+                                      const PluginSpecList &syst_specs,
+                                      const SampleCacheConfig &cache_config,
+                                      const ResultCacheConfig &result_cache,
+                                      const ShardSpec &shard, bool dry_run) {
   std::vector<std::string> periods;
   periods.reserve(runs.size());
   for (auto const &[period, _] : runs.items())
@@ -48,11 +64,14 @@ inline AnalysisResult processBeamline(RunConfigRegistry &run_config_registry,
         std::make_unique<SystematicsProcessor>(variable_registry);
   }
   AnalysisDataLoader data_loader(run_config_registry, variable_registry, beam,
-                                 periods, ntuple_dir, true);
+                                 periods, ntuple_dir, true, cache_config,
+                                 shard);
   auto histogram_factory = std::make_unique<HistogramFactory>();
 
   AnalysisRunner runner(data_loader, std::move(histogram_factory),
                         *systematics_processor, analysis_specs, syst_specs);
+  runner.setDryRun(dry_run);
+  runner.setResultCache(result_cache);
   auto result = runner.run();
 
   for (auto &kv : result.regions()) {
@@ -73,8 +92,10 @@ inline void aggregateResults(AnalysisResult &result,
 
 inline AnalysisResult runAnalysis(const nlohmann::json &samples,
                                   const PluginSpecList &analysis_specs,
-                                  const PluginSpecList &syst_specs) {
-  ROOT::EnableImplicitMT();
+                                  const PluginSpecList &syst_specs,
+                                  bool dry_run = false) {
+  const auto shard = ShardSpec::fromJson(samples);
+  ROOT::EnableImplicitMT(shard.threads_);
   auto threads = ROOT::GetThreadPoolSize();
   if (threads > 1) {
     log::info("analysis::runAnalysis",
@@ -92,6 +113,10 @@ inline AnalysisResult runAnalysis(const nlohmann::json &samples,
 
   RunConfigRegistry run_config_registry;
   RunConfigLoader::loadFromJson(samples, run_config_registry);
+  const auto cache_config = SampleCacheConfig::fromJson(samples);
+  const auto result_cache = ResultCacheConfig::fromJson(samples);
+  if (shard.active())
+    log::info("analysis::runAnalysis", "Processing shard", shard.str());
 
   AnalysisResult result;
   for (auto const &[beam, runs] : samples.at("beamlines").items()) {
@@ -99,18 +124,130 @@ inline AnalysisResult runAnalysis(const nlohmann::json &samples,
       continue;
     auto beamline_result =
         processBeamline(run_config_registry, ntuple_dir, beam, runs,
-                        analysis_specs, syst_specs);
+                        analysis_specs, syst_specs, cache_config,
+                        result_cache, shard, dry_run);
     aggregateResults(result, beamline_result);
   }
 
   return result;
 }
 
+inline std::string shardPath(const std::string &output_path,
+                             const ShardSpec &shard) {
+  const std::string base = AnalysisResultIO::resultPath(
+      output_path.empty() ? std::string{"analysis_result"} : output_path);
+  return base + ".shard" + std::to_string(shard.index_) + "of" +
+         std::to_string(shard.count_);
+}
+
+inline AnalysisResult mergeShards(const std::vector<std::string> &paths) {
+  std::vector<AnalysisResult> parts;
+  parts.reserve(paths.size());
+  for (const auto &path : paths)
+    parts.push_back(AnalysisResultIO::read(path));
+  log::info("analysis::mergeShards", "Merging", parts.size(),
+            "partial results");
+  return AnalysisResult::merge(std::move(parts));
+}
+
+// Runs every shard in a forked worker process sharing out the cores, then
+// merges the partial results. The caller must not have started the ROOT
+// thread pool, since threads do not survive fork().
+inline AnalysisResult runShards(const nlohmann::json &samples,
+                                const PluginSpecList &analysis_specs,
+                                const PluginSpecList &syst_specs,
+                                unsigned count,
+                                const std::string &output_path) {
+  const unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+  std::vector<std::pair<pid_t, std::string>> workers;
+  for (unsigned index = 0; index < count; ++index) {
+    const ShardSpec shard{index, count, std::max(1u, cores / count)};
+    auto path = shardPath(output_path, shard);
+    auto shard_samples = samples;
+    shard_samples["shard"] = shard.toJson();
+
+    std::cout.flush();
+    std::cerr.flush();
+    const pid_t pid = fork();
+    if (pid < 0)
+      log::fatal("analysis::runShards", "Cannot start worker for shard",
+                 shard.str());
+    if (pid == 0) {
+      int status = EXIT_SUCCESS;
+      try {
+        AnalysisResultIO::write(
+            runAnalysis(shard_samples, analysis_specs, syst_specs), path);
+      } catch (const std::exception &e) {
+        log::error("analysis::runShards", "Shard", shard.str(), "failed:",
+                   e.what());
+        status = EXIT_FAILURE;
+      }
+      std::cout.flush();
+      std::cerr.flush();
+      _exit(status);
+    }
+    log::info("analysis::runShards", "Started worker", pid, "for shard",
+              shard.str());
+    workers.emplace_back(pid, std::move(path));
+  }
+
+  bool failed = false;
+  std::vector<std::string> paths;
+  for (const auto &[pid, path] : workers) {
+    int status = 0;
+    if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) ||
+        WEXITSTATUS(status) != EXIT_SUCCESS) {
+      log::error("analysis::runShards", "Worker", pid, "failed");
+      failed = true;
+    }
+    paths.push_back(path);
+  }
+  if (failed)
+    log::fatal("analysis::runShards", "Sharded run incomplete");
+
+  auto result = mergeShards(paths);
+  for (const auto &path : paths) {
+    std::error_code ec;
+    std::filesystem::remove(path, ec);
+  }
+  return result;
+}
+
+struct PlotNeeds {
+  bool reads_events{false};
+  bool single_threaded{false};
+};
+
+// Asks each plot plugin what it needs before any sample is loaded. The
+// plugins are built without a data loader, which their constructors only
+// store.
+inline PlotNeeds plotNeeds(const PluginSpecList &plot_specs) {
+  PlotNeeds needs;
+  PlotPluginHost host;
+  for (auto const &spec : plot_specs)
+    host.add(spec.id, spec.args);
+  host.forEach([&needs](IPlotPlugin &plugin) {
+    needs.reads_events = needs.reads_events || plugin.readsEvents();
+    needs.single_threaded = needs.single_threaded || plugin.singleThreaded();
+  });
+  return needs;
+}
+
+inline void plotResult(const PluginSpecList &plot_specs,
+                       const AnalysisResult &result,
+                       AnalysisDataLoader *data_loader = nullptr) {
+  PlotPluginHost p_host(data_loader);
+  for (auto const &spec : plot_specs)
+    p_host.add(spec.id, spec.args);
+  p_host.forEach([&](IPlotPlugin &pl) { pl.onPlot(result); });
+}
+
 inline void plotBeamline(RunConfigRegistry &run_config_registry,
                          const std::string &ntuple_dir, const std::string &beam,
                          const nlohmann::json &runs,
                          const PluginSpecList &plot_specs,
-                         const AnalysisResult &beam_result) {
+                         const AnalysisResult &beam_result,
+                         const SampleCacheConfig &cache_config) {
   std::vector<std::string> periods;
   periods.reserve(runs.size());
   for (auto const &[period, _] : runs.items())
@@ -118,21 +255,36 @@ inline void plotBeamline(RunConfigRegistry &run_config_registry,
 
   VariableRegistry variable_registry;
   AnalysisDataLoader data_loader(run_config_registry, variable_registry, beam,
-                                 periods, ntuple_dir, true);
-
-  PlotPluginHost p_host(&data_loader);
-  for (auto const &spec : plot_specs)
-    p_host.add(spec.id, spec.args);
-
-  p_host.forEach([&](IPlotPlugin &pl) { pl.onPlot(beam_result); });
+                                 periods, ntuple_dir, true, cache_config);
+  plotResult(plot_specs, beam_result, &data_loader);
 }
 
 inline void runPlotting(const nlohmann::json &samples,
                         const PluginSpecList &plot_specs,
                         const AnalysisResult &result) {
-  bool requires_single_thread = std::any_of(
-      plot_specs.begin(), plot_specs.end(),
-      [](const PluginSpec &spec) { return spec.id == "EventDisplayPlugin"; });
+  if (plot_specs.empty())
+    return;
+
+  // Plots of the result alone neither need the ntuples nor a thread pool.
+  const auto needs = plotNeeds(plot_specs);
+  auto result_map = result.resultsByBeam();
+  if (!needs.reads_events) {
+    bool plotted = false;
+    for (auto const &[beam, runs] : samples.at("beamlines").items()) {
+      auto it = result_map.find(beam);
+      if (beam == "numi_ext" || it == result_map.end())
+        continue;
+      plotResult(plot_specs, it->second);
+      plotted = true;
+    }
+    if (!plotted)
+      plotResult(plot_specs, result);
+    log::info("analysis::runPlotting",
+              "Plotting routine terminated nominally.");
+    return;
+  }
+
+  const bool requires_single_thread = needs.single_threaded;
 
   if (requires_single_thread) {
     ROOT::DisableImplicitMT();
@@ -156,8 +308,12 @@ inline void runPlotting(const nlohmann::json &samples,
 
   RunConfigRegistry run_config_registry;
   RunConfigLoader::loadFromJson(samples, run_config_registry);
+  // Cached samples drop the image vectors, so event displays read the
+  // original ntuples.
+  const auto cache_config = requires_single_thread
+                                ? SampleCacheConfig{}
+                                : SampleCacheConfig::fromJson(samples);
 
-  auto result_map = result.resultsByBeam();
   bool plotted = false;
   for (auto const &[beam, runs] : samples.at("beamlines").items()) {
     if (beam == "numi_ext")
@@ -165,17 +321,13 @@ inline void runPlotting(const nlohmann::json &samples,
     auto it = result_map.find(beam);
     if (it != result_map.end()) {
       plotBeamline(run_config_registry, ntuple_dir, beam, runs, plot_specs,
-                   it->second);
+                   it->second, cache_config);
       plotted = true;
     }
   }
 
-  if (!plotted) {
-    PlotPluginHost p_host; // No data loader context available
-    for (auto const &spec : plot_specs)
-      p_host.add(spec.id, spec.args);
-    p_host.forEach([&](IPlotPlugin &pl) { pl.onPlot(result); });
-  }
+  if (!plotted)
+    plotResult(plot_specs, result); // No data loader context available
 
   log::info("analysis::runPlotting", "Plotting routine terminated nominally.");
 }
@@ -196,17 +348,69 @@ public:
         systematics_specs_(std::move(systematics_specs)) {}
 
   // Execute the analysis and plotting for the provided samples
-  // configuration. The analysis result is written to \p output_path and
-  // returned to the caller.
+  // configuration. The analysis result is returned to the caller and
+  // written next to \p output_path, with the extension replaced by
+  // AnalysisResultIO::kExtension.
+  //
+  // When the configuration or ANALYSIS_SHARD names a shard, only that
+  // shard is analysed and its partial result is written next to
+  // \p output_path for a later merge(); nothing is plotted.
   inline AnalysisResult run(const nlohmann::json &samples,
-                            const std::string /*&output_path*/) const {
+                            const std::string &output_path) const {
+    const auto shard = ShardSpec::fromJson(samples);
+    if (shard.active() && !dry_run_) {
+      auto partial = detail::runAnalysis(samples, analysis_specs_,
+                                         systematics_specs_);
+      AnalysisResultIO::write(partial, detail::shardPath(output_path, shard));
+      return partial;
+    }
+
+    auto result = shards_ > 1 && !dry_run_
+                      ? detail::runShards(samples, analysis_specs_,
+                                          systematics_specs_, shards_,
+                                          output_path)
+                      : detail::runAnalysis(samples, analysis_specs_,
+                                            systematics_specs_, dry_run_);
+    if (dry_run_)
+      return result;
+    if (!output_path.empty()) {
+      const auto result_path = AnalysisResultIO::resultPath(output_path);
+      AnalysisResultIO::write(result, result_path);
+      log::info("PipelineRunner::run", "Analysis result written to",
+                result_path);
+    }
+    detail::runPlotting(samples, plot_specs_, result);
+    return result;
+  }
+
+  // Plot-only rerun: renders the plots from the result an earlier
+  // run() with the same \p output_path wrote, without running the analysis.
+  inline AnalysisResult replot(const nlohmann::json &samples,
+                               const std::string &output_path) const {
     auto result =
-        detail::runAnalysis(samples, analysis_specs_, systematics_specs_);
-    // result.saveToFile(output_path.c_str());
+        AnalysisResultIO::read(AnalysisResultIO::resultPath(output_path));
     detail::runPlotting(samples, plot_specs_, result);
     return result;
   }
 
+  // Merges the partial results written by shard jobs and plots the merged
+  // result.
+  inline AnalysisResult merge(const nlohmann::json &samples,
+                              const std::vector<std::string> &partial_paths)
+      const {
+    auto result = detail::mergeShards(partial_paths);
+    detail::runPlotting(samples, plot_specs_, result);
+    return result;
+  }
+
+  // Report the input branches each beamline needs instead of running the
+  // event loops and plots.
+  void setDryRun(bool dry_run) { dry_run_ = dry_run; }
+
+  // Split every sample into \p shards parts, each analysed by a local
+  // worker process; the partial results are merged before plotting.
+  void setShards(unsigned shards) { shards_ = std::max(1u, shards); }
+
   // Convenience overload that reads the samples configuration from a JSON
   // file located at \p samples_path before executing the pipeline.
   inline AnalysisResult run(const std::string &samples_path,
@@ -223,6 +427,8 @@ private:
   PluginSpecList analysis_specs_;
   PluginSpecList plot_specs_;
   PluginSpecList systematics_specs_;
+  bool dry_run_{false};
+  unsigned shards_{1};
 };
 
 } // namespace analysis
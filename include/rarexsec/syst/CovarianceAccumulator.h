@@ -0,0 +1,73 @@
+#ifndef COVARIANCE_ACCUMULATOR_H
+#define COVARIANCE_ACCUMULATOR_H
+
+#include <algorithm>
+
+#include <Eigen/Dense>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_reduce.h>
+
+namespace analysis {
+
+// How the outer products of the variation deltas are summed. Single
+// precision halves the memory traffic of the rank update; the sum is
+// converted to double once at the end.
+struct CovarianceOptions {
+    bool single_precision{false};
+    // Splits the variations into blocks whose partial sums are reduced in
+    // parallel; only worth it for hundreds of variations.
+    bool parallel{false};
+    Eigen::Index block_rows{64};
+};
+
+// Covariance sum_k d_k d_k^T * scale of the rows d_k of a dense
+// (variations x bins) delta matrix, computed as one symmetric rank update
+// of the lower triangle.
+class CovarianceAccumulator {
+  public:
+    static Eigen::MatrixXd compute(const Eigen::MatrixXd &deltas, double scale = 1.0,
+                                   const CovarianceOptions &options = {}) {
+        Eigen::MatrixXd cov = options.single_precision
+                                  ? accumulate<float>(deltas.cast<float>(), options).cast<double>()
+                                  : accumulate<double>(deltas, options);
+        cov.triangularView<Eigen::StrictlyUpper>() = cov.transpose();
+        return cov * scale;
+    }
+
+  private:
+    template <typename Scalar>
+    using Matrix = Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic>;
+
+    template <typename Scalar>
+    static Matrix<Scalar> accumulate(const Matrix<Scalar> &deltas, const CovarianceOptions &options) {
+        const Eigen::Index n_rows = deltas.rows();
+        const Eigen::Index n_bins = deltas.cols();
+        const Matrix<Scalar> zero = Matrix<Scalar>::Zero(n_bins, n_bins);
+        const auto update = [&](Matrix<Scalar> &sum, Eigen::Index first, Eigen::Index last) {
+            sum.template selfadjointView<Eigen::Lower>().rankUpdate(
+                deltas.middleRows(first, last - first).transpose());
+        };
+
+        if (!options.parallel || n_rows <= options.block_rows) {
+            Matrix<Scalar> sum = zero;
+            if (n_rows > 0)
+                update(sum, 0, n_rows);
+            return sum;
+        }
+
+        return tbb::parallel_reduce(
+            tbb::blocked_range<Eigen::Index>(0, n_rows, std::max<Eigen::Index>(1, options.block_rows)), zero,
+            [&](const tbb::blocked_range<Eigen::Index> &r, Matrix<Scalar> sum) {
+                update(sum, r.begin(), r.end());
+                return sum;
+            },
+            [](Matrix<Scalar> a, const Matrix<Scalar> &b) {
+                a.template triangularView<Eigen::Lower>() += b;
+                return a;
+            });
+    }
+};
+
+}
+
+#endif
@@ -3,11 +3,10 @@
 
 #include <rarexsec/utils/Logger.h>
 #include <rarexsec/hist/BinnedHistogram.h>
+#include <rarexsec/syst/CovarianceAccumulator.h>
 #include <rarexsec/syst/SystematicStrategy.h>
 #include <cmath>
 #include <optional>
-#include <tbb/blocked_range.h>
-#include <tbb/parallel_for.h>
 
 namespace analysis {
 
@@ -17,41 +16,41 @@ class DetectorSystematicStrategy : public SystematicStrategy {
 
     const std::string &getName() const override { return identifier_; }
 
+    void setCovarianceOptions(CovarianceOptions options) { covariance_options_ = options; }
+
     void bookVariations(const SampleKey &, ROOT::RDF::RNode &, const BinningDefinition &, const ROOT::RDF::TH1DModel &,
                         SystematicFutures &) override {}
 
-    TMatrixDSym computeCovariance(VariableResult &result, SystematicFutures &) override {
+    void evaluate(const VariableResult &result, SystematicFutures &, SystematicOutput &out) const override {
         const auto &nominal_hist = result.total_mc_hist_;
         const int n_bins = nominal_hist.getNumberOfBins();
 
-        TMatrixDSym total_detvar_cov(n_bins);
-        total_detvar_cov.Zero();
+        out.covariance_ = CovarianceMatrix(n_bins);
 
-        log::debug("DetectorSystematicStrategy::computeCovariance", "Raw detvar histograms:",
+        log::debug("DetectorSystematicStrategy::evaluate", "Raw detvar histograms:",
                    result.raw_detvar_hists_.size());
 
         if (result.raw_detvar_hists_.empty()) {
-            log::info("DetectorSystematicStrategy::computeCovariance",
+            log::info("DetectorSystematicStrategy::evaluate",
                       "No detector variation samples found. Skipping detector systematics.");
-            return total_detvar_cov;
+            return;
         }
 
         auto total_detvar_hists = aggregateVariations(result);
         if (total_detvar_hists.size() <= 1) {
-            log::warn("DetectorSystematicStrategy::computeCovariance",
+            log::warn("DetectorSystematicStrategy::evaluate",
                       "No detector variations beyond CV found. Skipping detector systematics.");
-            return total_detvar_cov;
+            return;
         }
         auto h_det_cv_opt = sanitiseCvHistogram(total_detvar_hists);
-        if (!h_det_cv_opt) return total_detvar_cov;
+        if (!h_det_cv_opt) return;
 
         auto h_det_cv = *h_det_cv_opt;
-        projectVariations(result, nominal_hist, h_det_cv, total_detvar_hists);
-        total_detvar_cov = accumulateCovariance(result, n_bins);
+        projectVariations(out, nominal_hist, h_det_cv, total_detvar_hists);
+        out.covariance_ = accumulateCovariance(out, n_bins);
 
-        log::debug("DetectorSystematicStrategy::computeCovariance", "Computed detector covariance with",
+        log::debug("DetectorSystematicStrategy::evaluate", "Computed detector covariance with",
                    total_detvar_hists.size() - 1, "variations");
-        return total_detvar_cov;
     }
 
     std::map<SystematicKey, BinnedHistogram> getVariedHistograms(const BinningDefinition &,
@@ -60,25 +59,25 @@ class DetectorSystematicStrategy : public SystematicStrategy {
     }
 
   private:
-    std::map<SampleVariation, BinnedHistogram> aggregateVariations(const VariableResult &result) {
+    std::map<SampleVariation, BinnedHistogram> aggregateVariations(const VariableResult &result) const {
         std::map<SampleVariation, BinnedHistogram> total_detvar_hists;
 
         for (const auto &[sample_key, variations] : result.raw_detvar_hists_) {
-            log::debug("DetectorSystematicStrategy::computeCovariance", "Aggregating sample", sample_key.str());
+            log::debug("DetectorSystematicStrategy::evaluate", "Aggregating sample", sample_key.str());
             for (const auto &[variation, hist] : variations) {
-                log::debug("DetectorSystematicStrategy::computeCovariance", "--> variation",
+                log::debug("DetectorSystematicStrategy::evaluate", "--> variation",
                            variationToKey(variation));
                 auto [it, inserted] = total_detvar_hists.try_emplace(variation, hist);
-                if (!inserted) it->second = it->second + hist;
+                if (!inserted) it->second += hist;
             }
         }
         return total_detvar_hists;
     }
 
-    std::optional<BinnedHistogram> sanitiseCvHistogram(std::map<SampleVariation, BinnedHistogram> &total_detvar_hists) {
+    std::optional<BinnedHistogram> sanitiseCvHistogram(std::map<SampleVariation, BinnedHistogram> &total_detvar_hists) const {
         auto it = total_detvar_hists.find(SampleVariation::kCV);
         if (it == total_detvar_hists.end()) {
-            log::warn("DetectorSystematicStrategy::computeCovariance",
+            log::warn("DetectorSystematicStrategy::evaluate",
                       "No detector variation CV histogram found. Skipping.");
             return std::nullopt;
         }
@@ -88,8 +87,7 @@ class DetectorSystematicStrategy : public SystematicStrategy {
         for (int i = 0; i < n_cv_bins; ++i) {
             const double cv = h_det_cv.getBinContent(i);
             if (!std::isfinite(cv) || cv == 0.0) {
-                h_det_cv.hist.counts[i] = 0.0;
-                h_det_cv.hist.shifts.row(i).setZero();
+                h_det_cv.hist.clearBin(i);
             }
         }
 
@@ -97,58 +95,45 @@ class DetectorSystematicStrategy : public SystematicStrategy {
         return h_det_cv;
     }
 
-    void projectVariations(VariableResult &result, const BinnedHistogram &nominal_hist, const BinnedHistogram &h_det_cv,
-                           const std::map<SampleVariation, BinnedHistogram> &total_detvar_hists) {
+    void projectVariations(SystematicOutput &out, const BinnedHistogram &nominal_hist, const BinnedHistogram &h_det_cv,
+                           const std::map<SampleVariation, BinnedHistogram> &total_detvar_hists) const {
         for (const auto &[var_key, h_det_k] : total_detvar_hists) {
             if (var_key == SampleVariation::kCV) continue;
 
-            log::debug("DetectorSystematicStrategy::computeCovariance", "Projecting variation",
+            log::debug("DetectorSystematicStrategy::evaluate", "Projecting variation",
                        variationToKey(var_key));
 
             auto transfer_ratio = h_det_k / h_det_cv;
             const int n_tr_bins = transfer_ratio.getNumberOfBins();
             for (int i = 0; i < n_tr_bins; ++i) {
                 if (!std::isfinite(transfer_ratio.getBinContent(i))) {
-                    transfer_ratio.hist.counts[i] = 0.0;
-                    transfer_ratio.hist.shifts.row(i).setZero();
+                    transfer_ratio.hist.clearBin(i);
                 }
             }
 
             const auto h_proj_k = transfer_ratio * nominal_hist;
             const auto delta = h_proj_k - nominal_hist;
             const SystematicKey syst_key(variationToKey(var_key));
-            result.transfer_ratio_hists_[syst_key] = transfer_ratio;
-            result.variation_hists_[syst_key] = h_proj_k;
-            result.delta_hists_[syst_key] = delta;
-            for (int i = 0; i < delta.getNumberOfBins(); ++i) {
-                log::debug("DetectorSystematicStrategy::projectVariations",
-                           variationToKey(var_key), "bin", i,
-                           "delta", delta.getBinContent(i));
-            }
+            out.transfer_ratio_hists_[syst_key] = transfer_ratio;
+            out.variation_hists_[syst_key] = h_proj_k;
+            out.delta_hists_[syst_key] = delta;
         }
     }
 
-    TMatrixDSym accumulateCovariance(const VariableResult &result, int n_bins) {
-        TMatrixDSym total_detvar_cov(n_bins);
-
-        total_detvar_cov.Zero();
-
-        for (const auto &[var_key, delta] : result.delta_hists_) {
-            TMatrixDSym cov_k(n_bins);
-            tbb::parallel_for(tbb::blocked_range<int>(0, n_bins),
-                              [&](const tbb::blocked_range<int> &r) {
-                for (int i = r.begin(); i != r.end(); ++i) {
-                    for (int j = 0; j < n_bins; ++j) {
-                        cov_k(i, j) = delta.getBinContent(i) * delta.getBinContent(j);
-                    }
-                }
-            });
-            total_detvar_cov += cov_k;
+    // One row per variation; the covariance is their summed outer product.
+    CovarianceMatrix accumulateCovariance(const SystematicOutput &out, int n_bins) const {
+        Eigen::MatrixXd deltas(static_cast<Eigen::Index>(out.delta_hists_.size()), n_bins);
+        Eigen::Index row = 0;
+        for (const auto &[var_key, delta] : out.delta_hists_) {
+            for (int i = 0; i < n_bins; ++i)
+                deltas(row, i) = delta.getBinContent(i);
+            ++row;
         }
-        return total_detvar_cov;
+        return CovarianceMatrix(CovarianceAccumulator::compute(deltas, 1.0, covariance_options_));
     }
 
     std::string identifier_;
+    CovarianceOptions covariance_options_;
 };
 
 }
@@ -6,25 +6,39 @@
 #include <map>
 #include <string>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include "ROOT/RDataFrame.hxx"
 #include "TH1D.h"
-#include <TMatrixDSym.h>
+#include <Eigen/Dense>
 
 #include <rarexsec/core/VariableResult.h>
 #include <rarexsec/hist/BinnedHistogram.h>
 #include <rarexsec/hist/BinningDefinition.h>
+#include <rarexsec/hist/CovarianceMatrix.h>
+#include <rarexsec/hist/HistogramFillHelper.h>
 #include <rarexsec/core/AnalysisKey.h>
 #include <rarexsec/data/SampleTypes.h>
 
 namespace analysis {
 
 using VariationFutures =
-    std::unordered_map<SystematicKey, std::map<SampleKey, ROOT::RDF::RResultPtr<TH1D>>>;
+    std::unordered_map<SystematicKey, std::map<SampleKey, ROOT::RDF::RResultPtr<HistogramCounts>>>;
+
+using UniverseFutures =
+    std::unordered_map<SystematicKey, std::map<SampleKey, ROOT::RDF::RResultPtr<Eigen::MatrixXd>>>;
 
 struct SystematicFutures {
     VariationFutures variations;
+    UniverseFutures universes;
+
+    bool empty() const { return variations.empty() && universes.empty(); }
+
+    void clear() {
+        variations.clear();
+        universes.clear();
+    }
 };
 
 struct UniverseDef {
@@ -39,6 +53,29 @@ struct KnobDef {
     std::string dn_column_;
 };
 
+// What one strategy produces for a variable. Each strategy fills its own
+// output, so strategies can be evaluated concurrently and the outputs merged
+// into the result in a fixed order afterwards.
+struct SystematicOutput {
+    CovarianceMatrix covariance_;
+    std::map<SystematicKey, BinnedHistogram> variation_hists_;
+    std::map<SystematicKey, BinnedHistogram> transfer_ratio_hists_;
+    std::map<SystematicKey, BinnedHistogram> delta_hists_;
+    std::map<SystematicKey, std::vector<HistogramCounts>> universe_projected_hists_;
+
+    // Moves the histograms into `result`; the covariance stays here.
+    void moveHistogramsInto(VariableResult &result) {
+        for (auto &[key, hist] : variation_hists_)
+            result.variation_hists_.insert_or_assign(key, std::move(hist));
+        for (auto &[key, hist] : transfer_ratio_hists_)
+            result.transfer_ratio_hists_.insert_or_assign(key, std::move(hist));
+        for (auto &[key, hist] : delta_hists_)
+            result.delta_hists_.insert_or_assign(key, std::move(hist));
+        for (auto &[key, hists] : universe_projected_hists_)
+            result.universe_projected_hists_.insert_or_assign(key, std::move(hists));
+    }
+};
+
 class SystematicStrategy {
   public:
     virtual ~SystematicStrategy() = default;
@@ -48,7 +85,18 @@ class SystematicStrategy {
     virtual void bookVariations(const SampleKey &sample_key, ROOT::RDF::RNode &rnode, const BinningDefinition &binning,
                                 const ROOT::RDF::TH1DModel &model, SystematicFutures &futures) = 0;
 
-    virtual TMatrixDSym computeCovariance(VariableResult &result, SystematicFutures &futures) = 0;
+    // Reads the filled inputs and writes only to `out`; must be safe to call
+    // concurrently with other strategies on the same result. The futures
+    // must already have been filled.
+    virtual void evaluate(const VariableResult &result, SystematicFutures &futures, SystematicOutput &out) const = 0;
+
+    // Evaluates on its own and stores the histograms in `result`.
+    CovarianceMatrix computeCovariance(VariableResult &result, SystematicFutures &futures) const {
+        SystematicOutput out;
+        this->evaluate(result, futures, out);
+        out.moveHistogramsInto(result);
+        return std::move(out.covariance_);
+    }
 
     virtual std::map<SystematicKey, BinnedHistogram> getVariedHistograms(const BinningDefinition &bin,
                                                                          SystematicFutures &futures) = 0;
@@ -7,15 +7,14 @@
 #include <memory>
 #include <mutex>
 #include <string>
-#include <tbb/blocked_range.h>
 #include <tbb/parallel_for.h>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
-#include <TMatrixDSym.h>
-
 #include <rarexsec/data/VariableRegistry.h>
 #include <rarexsec/hist/BinnedHistogram.h>
+#include <rarexsec/hist/CovarianceMatrix.h>
 #include <rarexsec/syst/SystematicStrategy.h>
 #include <rarexsec/utils/Logger.h>
 
@@ -62,23 +61,71 @@ public:
 
   bool storeUniverseHists() const { return store_universe_hists_; }
 
+  // Strategies and variation definitions in booking order; part of the key
+  // of cached results.
+  std::string signature() const {
+    std::string sig;
+    for (const auto &strategy : systematic_strategies_)
+      sig += "strategy=" + strategy->getName() + ";";
+    for (const auto &knob : knob_definitions_)
+      sig += "knob=" + knob.name_ + ":" + knob.up_column_ + ":" +
+             knob.dn_column_ + ";";
+    for (const auto &universe : universe_definitions_)
+      sig += "universe=" + universe.name_ + ":" + universe.vector_name_ + ":" +
+             std::to_string(universe.n_universes_) + ";";
+    return sig;
+  }
+
+  // Futures of the samples `keep` accepts, so that their contribution can be
+  // collected on its own.
+  template <typename Predicate>
+  static SystematicFutures selectSamples(const SystematicFutures &futures,
+                                         Predicate keep) {
+    SystematicFutures out;
+    for (const auto &[key, samples] : futures.variations) {
+      for (const auto &[sample_key, future] : samples) {
+        if (keep(sample_key))
+          out.variations[key].emplace(sample_key, future);
+      }
+    }
+    for (const auto &[key, samples] : futures.universes) {
+      for (const auto &[sample_key, future] : samples) {
+        if (keep(sample_key))
+          out.universes[key].emplace(sample_key, future);
+      }
+    }
+    return out;
+  }
+
   void bookSystematics(const SampleKey &sample_key, ROOT::RDF::RNode &rnode,
                        const BinningDefinition &binning,
                        const ROOT::RDF::TH1DModel &model) {
+    bookSystematics(sample_key, rnode, binning, model, systematic_futures_);
+  }
+
+  // Books into caller-owned futures so that several variables can be
+  // registered before a single event loop is triggered.
+  void bookSystematics(const SampleKey &sample_key, ROOT::RDF::RNode &rnode,
+                       const BinningDefinition &binning,
+                       const ROOT::RDF::TH1DModel &model,
+                       SystematicFutures &futures) {
     log::debug("SystematicsProcessor::bookSystematics",
                "Booking variations for sample", sample_key.str());
     for (const auto &strategy : systematic_strategies_) {
       log::debug("SystematicsProcessor::bookSystematics", "-> Strategy",
                  strategy->getName());
-      strategy->bookVariations(sample_key, rnode, binning, model,
-                               systematic_futures_);
+      strategy->bookVariations(sample_key, rnode, binning, model, futures);
     }
     log::debug("SystematicsProcessor::bookSystematics",
                "Completed booking for sample", sample_key.str());
   }
 
   void processSystematics(VariableResult &result) {
-    if (!hasSystematics() && result.raw_detvar_hists_.empty()) {
+    processSystematics(result, systematic_futures_);
+  }
+
+  void processSystematics(VariableResult &result, SystematicFutures &futures) {
+    if (futures.empty() && result.raw_detvar_hists_.empty()) {
       log::info("SystematicsProcessor::processSystematics",
                 "No systematics found. Using statistical uncertainties only.");
       combineCovariances(result);
@@ -87,43 +134,79 @@ public:
 
     log::debug("SystematicsProcessor::processSystematics",
                "Commencing covariance calculations");
-    for (const auto &strategy : systematic_strategies_) {
-      VariableResult local_result = result;
-      SystematicKey key{strategy->getName()};
+    // A future read for the first time would run the event loop from a
+    // worker thread, so every result is fetched before the strategies run.
+    SystematicsProcessor::materialise(futures);
+
+    // Strategies read the result and write only to their own output, so
+    // they run concurrently; outputs are merged in strategy order.
+    const auto &strategies = systematic_strategies_;
+    std::vector<SystematicOutput> outputs(strategies.size());
+    const VariableResult &inputs = result;
+    tbb::parallel_for(std::size_t{0}, strategies.size(), [&](std::size_t i) {
       log::debug("SystematicsProcessor::processSystematics",
-                 "Computing covariance for", key.str());
-      auto cov = strategy->computeCovariance(local_result, systematic_futures_);
-      sanitiseMatrix(cov);
+                 "Computing covariance for", strategies[i]->getName());
+      strategies[i]->evaluate(inputs, futures, outputs[i]);
+      outputs[i].covariance_.sanitise();
+    });
+
+    for (std::size_t i = 0; i < strategies.size(); ++i) {
+      SystematicKey key{strategies[i]->getName()};
+      auto &out = outputs[i];
       log::debug("SystematicsProcessor::processSystematics", key.str(),
-                 "matrix size", cov.GetNrows(), "x", cov.GetNcols());
-      result.covariance_matrices_.insert_or_assign(key, cov);
+                 "matrix size", out.covariance_.size(), "x",
+                 out.covariance_.size());
+      out.moveHistogramsInto(result);
+      result.covariance_matrices_.insert_or_assign(std::move(key),
+                                                   std::move(out.covariance_));
     }
     combineCovariances(result);
     log::debug("SystematicsProcessor::processSystematics",
                "Covariance calculation complete");
   }
 
-  void clearFutures() { systematic_futures_.variations.clear(); }
-
-  bool hasSystematics() const {
-    return !systematic_futures_.variations.empty();
+  // Stores the filled variations in the result, summed over samples, so
+  // that partial results can be merged and covariances computed later
+  // without the futures.
+  static void collectSystematics(VariableResult &result,
+                                 SystematicFutures &futures) {
+    for (auto &[key, samples] : futures.variations) {
+      for (auto &[sample_key, future] : samples) {
+        if (const auto *counts = future.GetPtr())
+          result.variation_hists_[key].addSums(result.binning_, counts->sumw(),
+                                               counts->sumw2());
+      }
+    }
+    for (auto &[key, samples] : futures.universes) {
+      for (auto &[sample_key, future] : samples) {
+        const auto *counts = future.GetPtr();
+        if (!counts)
+          continue;
+        auto [it, inserted] = result.universe_counts_.try_emplace(key, *counts);
+        if (!inserted &&
+            !VariableResult::addUniverseCounts(it->second, *counts)) {
+          log::warn("SystematicsProcessor::collectSystematics", key.str(),
+                    "skipping sample", sample_key.str(),
+                    "with mismatched universe matrix");
+        }
+      }
+    }
   }
 
+  void clearFutures() { systematic_futures_.clear(); }
+
+  bool hasSystematics() const { return !systematic_futures_.empty(); }
+
 private:
-  static void sanitiseMatrix(TMatrixDSym &m) {
-    const int rows = m.GetNrows();
-    const int cols = m.GetNcols();
-    tbb::parallel_for(tbb::blocked_range<int>(0, rows),
-                      [&](const tbb::blocked_range<int> &r) {
-                        for (int i = r.begin(); i != r.end(); ++i) {
-                          const int max_col = std::min(i + 1, cols);
-                          for (int j = 0; j < max_col; ++j) {
-                            double &val = m(i, j);
-                            if (!std::isfinite(val))
-                              val = 0.0;
-                          }
-                        }
-                      });
+  static void materialise(SystematicFutures &futures) {
+    for (auto &[key, samples] : futures.variations) {
+      for (auto &[sample_key, future] : samples)
+        future.GetPtr();
+    }
+    for (auto &[key, samples] : futures.universes) {
+      for (auto &[sample_key, future] : samples)
+        future.GetPtr();
+    }
   }
 
   static void combineCovariances(VariableResult &result) {
@@ -131,31 +214,29 @@ private:
     if (n_bins <= 0)
       return;
 
-    result.total_covariance_.ResizeTo(n_bins, n_bins);
     result.total_covariance_ = result.total_mc_hist_.hist.covariance();
 
     log::debug("SystematicsProcessor::combineCovariances",
                "Combining covariance matrices");
     for (const auto &[name, cov_matrix] : result.covariance_matrices_) {
-      if (cov_matrix.GetNrows() == n_bins) {
-        TMatrixDSym cov = cov_matrix;
-        SystematicsProcessor::sanitiseMatrix(cov);
+      if (cov_matrix.size() == n_bins) {
+        CovarianceMatrix cov = cov_matrix;
+        cov.sanitise();
         log::debug("SystematicsProcessor::combineCovariances", "Adding matrix",
                    name.str());
         result.total_covariance_ += cov;
       } else {
         log::warn("SystematicsProcessor::combineCovariances",
                   "Skipping systematic", name.str(),
-                  "due to incompatible matrix size (", cov_matrix.GetNrows(),
-                  "x", cov_matrix.GetNcols(), "vs expected", n_bins, "x",
-                  n_bins, ")");
+                  "due to incompatible matrix size (", cov_matrix.size(), "x",
+                  cov_matrix.size(), "vs expected", n_bins, "x", n_bins, ")");
       }
     }
 
-    SystematicsProcessor::sanitiseMatrix(result.total_covariance_);
+    result.total_covariance_.sanitise();
 
     result.nominal_with_band_ = result.total_mc_hist_;
-    result.nominal_with_band_.hist.shifts.resize(n_bins, 0);
+    result.nominal_with_band_.hist.clearErrors();
     result.nominal_with_band_.addCovariance(result.total_covariance_);
   }
 
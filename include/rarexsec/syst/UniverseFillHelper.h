@@ -0,0 +1,113 @@
+#ifndef UNIVERSE_FILL_HELPER_H
+#define UNIVERSE_FILL_HELPER_H
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "ROOT/RDF/RActionImpl.hxx"
+#include "ROOT/RDataFrame.hxx"
+#include "ROOT/RVec.hxx"
+#include <Eigen/Dense>
+
+#include <rarexsec/hist/BinLookup.h>
+#include <rarexsec/hist/BinningDefinition.h>
+#include <rarexsec/hist/ColumnDispatch.h>
+#include <rarexsec/utils/Logger.h>
+
+namespace analysis {
+
+// RDataFrame action that fills every universe of a multisim weight vector in a
+// single pass. The central value is computed once per event and each filled
+// value adds the vector of universe ratios to one column of a per-slot
+// (n_universes x n_bins) matrix. The slots are summed in Finalize. Universes
+// beyond the shortest weight vector seen are not filled for every event and
+// are dropped from the result.
+template <typename Value, typename Weight>
+class UniverseFillHelper : public ROOT::Detail::RDF::RActionImpl<UniverseFillHelper<Value, Weight>> {
+  public:
+    using Result_t = Eigen::MatrixXd;
+
+    UniverseFillHelper(std::vector<double> edges, unsigned n_universes, unsigned n_slots, std::string identifier)
+        : lookup_(std::move(edges)), n_universes_(n_universes), identifier_(std::move(identifier)),
+          result_(std::make_shared<Result_t>(Result_t::Zero(n_universes, lookup_.size()))),
+          slot_counts_(n_slots, Result_t::Zero(n_universes, lookup_.size())),
+          slot_ratios_(n_slots, Eigen::VectorXd::Ones(n_universes)), slot_filled_(n_slots, n_universes) {}
+
+    UniverseFillHelper(UniverseFillHelper &&) = default;
+    UniverseFillHelper(const UniverseFillHelper &) = delete;
+
+    std::shared_ptr<Result_t> GetResultPtr() const { return result_; }
+
+    void Initialize() {}
+
+    void InitTask(TTreeReader *, unsigned int) {}
+
+    void Exec(unsigned int slot, const Value &value, const ROOT::RVec<Weight> &weights) {
+        auto &ratios = slot_ratios_[slot];
+        this->computeRatios(weights, ratios);
+        if (!weights.empty())
+            slot_filled_[slot] = std::min<unsigned>(slot_filled_[slot], weights.size());
+
+        auto &counts = slot_counts_[slot];
+        forEachColumnValue(value, [&](double x) { counts.col(lookup_.find(x)) += ratios; });
+    }
+
+    void Finalize() {
+        for (const auto &counts : slot_counts_)
+            *result_ += counts;
+        const unsigned filled = *std::min_element(slot_filled_.begin(), slot_filled_.end());
+        if (filled < n_universes_) {
+            log::warn("UniverseFillHelper::Finalize", identifier_, "weight vectors hold only", filled, "of",
+                      n_universes_, "universes; keeping", filled);
+            result_->conservativeResize(filled, Eigen::NoChange);
+        }
+    }
+
+    std::string GetActionName() { return "UniverseFill"; }
+
+  private:
+    void computeRatios(const ROOT::RVec<Weight> &weights, Eigen::VectorXd &ratios) const {
+        ratios.setOnes();
+        if (weights.empty())
+            return;
+
+        double central = 0.0;
+        for (const auto &w : weights)
+            central += w;
+        central /= static_cast<double>(weights.size());
+        if (central == 0.0) {
+            log::warn("UniverseFillHelper::Exec", identifier_, "central weight is zero");
+            return;
+        }
+
+        const double inv_central = 1.0 / central;
+        const unsigned n = std::min<unsigned>(n_universes_, weights.size());
+        for (unsigned u = 0; u < n; ++u)
+            ratios(u) = static_cast<double>(weights[u]) * inv_central;
+
+        if ((ratios.head(n).array().abs() > 1e3).any()) {
+            for (unsigned u = 0; u < n; ++u) {
+                if (std::abs(ratios(u)) > 1e3) {
+                    log::warn("UniverseFillHelper::Exec", identifier_, "extreme universe weight", "universe", u,
+                              "weight", static_cast<double>(weights[u]), "central", central, "ratio", ratios(u));
+                }
+            }
+        }
+    }
+
+    BinLookup lookup_;
+    unsigned n_universes_;
+    std::string identifier_;
+    std::shared_ptr<Result_t> result_;
+    std::vector<Result_t> slot_counts_;
+    std::vector<Eigen::VectorXd> slot_ratios_;
+    std::vector<unsigned> slot_filled_;
+};
+
+}
+
+#endif
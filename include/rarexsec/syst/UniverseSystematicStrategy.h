@@ -10,11 +10,13 @@
 #include <vector>
 
 #include <ROOT/RVec.hxx>
-#include <TMatrixDSym.h>
 
 #include <rarexsec/hist/BinnedHistogram.h>
+#include <rarexsec/hist/ColumnDispatch.h>
 #include <rarexsec/utils/Logger.h>
+#include <rarexsec/syst/CovarianceAccumulator.h>
 #include <rarexsec/syst/SystematicStrategy.h>
+#include <rarexsec/syst/UniverseFillHelper.h>
 
 namespace analysis {
 
@@ -32,9 +34,13 @@ public:
   void setUniverseCount(unsigned n) { n_universes_ = n; }
   unsigned getUniverseCount() const { return n_universes_; }
 
+  void setCovarianceOptions(CovarianceOptions options) {
+    covariance_options_ = options;
+  }
+
   void bookVariations(const SampleKey &sample_key, ROOT::RDF::RNode &rnode,
                       const BinningDefinition &binning,
-                      const ROOT::RDF::TH1DModel &model,
+                      const ROOT::RDF::TH1DModel &,
                       SystematicFutures &futures) override {
     log::debug("UniverseSystematicStrategy::bookVariations", identifier_,
                "sample", sample_key.str(), "universes", n_universes_);
@@ -47,183 +53,118 @@ public:
       return;
     }
 
-    auto col_type = rnode.GetColumnType(vector_name_);
-    for (unsigned u = 0; u < n_universes_; ++u) {
-      const SystematicKey uni_key(identifier_ + "_u" + std::to_string(u));
-      const auto uni_weight_name = "_uni_w_" + std::to_string(u);
-
-      // Determine the column type and dispatch to a typed lambda. ROOT's
-      // RDataFrame cannot handle a generic lambda (with templated
-      // arguments) in Define, so provide explicit overloads for the
-      // numeric vector types we expect.
-      if (col_type == "ROOT::VecOps::RVec<float>") {
-        auto weight = [u, this](const ROOT::RVec<float> &weights) {
-          if (weights.empty()) {
-            return 1.0;
-          }
-
-          double central = 0.0;
-          for (const auto &w : weights)
-            central += w;
-          central /= static_cast<double>(weights.size());
-          if (central == 0.0) {
-            log::warn("UniverseSystematicStrategy::bookVariations", identifier_,
-                      "central weight is zero");
-            return 1.0;
-          }
-
-          const double central_first = static_cast<double>(weights.front());
-          if (std::abs(central_first - central) >
-              1e-6 * std::max(1.0, std::abs(central_first))) {
-            log::debug("UniverseSystematicStrategy::bookVariations", identifier_,
-                       "central weight differs from first element", "first",
-                       central_first, "mean", central);
-          }
-
-          if (u < weights.size()) {
-            const double w = static_cast<double>(weights[u]);
-            const double ratio = w / central;
-            if (std::abs(ratio) > 1e3) {
-              log::warn("UniverseSystematicStrategy::bookVariations", identifier_,
-                        "extreme universe weight", "universe", u, "weight", w,
-                        "central", central, "ratio", ratio);
-            }
-            return ratio;
-          }
-          return 1.0;
-        };
-        auto node = rnode.Define(uni_weight_name, weight, {vector_name_});
-        futures.variations[uni_key][sample_key] =
-            node.Histo1D(model, binning.getVariable(), uni_weight_name);
-      } else if (col_type == "ROOT::VecOps::RVec<double>") {
-        auto weight = [u, this](const ROOT::RVec<double> &weights) {
-          if (weights.empty()) {
-            return 1.0;
-          }
-
-          double central = 0.0;
-          for (const auto &w : weights)
-            central += w;
-          central /= static_cast<double>(weights.size());
-          if (central == 0.0) {
-            log::warn("UniverseSystematicStrategy::bookVariations", identifier_,
-                      "central weight is zero");
-            return 1.0;
-          }
-
-          const double central_first = static_cast<double>(weights.front());
-          if (std::abs(central_first - central) >
-              1e-6 * std::max(1.0, std::abs(central_first))) {
-            log::debug("UniverseSystematicStrategy::bookVariations", identifier_,
-                       "central weight differs from first element", "first",
-                       central_first, "mean", central);
-          }
-
-          if (u < weights.size()) {
-            const double w = static_cast<double>(weights[u]);
-            const double ratio = w / central;
-            if (std::abs(ratio) > 1e3) {
-              log::warn("UniverseSystematicStrategy::bookVariations", identifier_,
-                        "extreme universe weight", "universe", u, "weight", w,
-                        "central", central, "ratio", ratio);
-            }
-            return ratio;
-          }
-          return 1.0;
-        };
-        auto node = rnode.Define(uni_weight_name, weight, {vector_name_});
-        futures.variations[uni_key][sample_key] =
-            node.Histo1D(model, binning.getVariable(), uni_weight_name);
-      } else if (col_type == "ROOT::VecOps::RVec<unsigned short>") {
-        auto weight = [u, this](const ROOT::RVec<unsigned short> &weights) {
-          if (weights.empty()) {
-            return 1.0;
-          }
-
-          double central = 0.0;
-          for (const auto &w : weights)
-            central += w;
-          central /= static_cast<double>(weights.size());
-          if (central == 0.0) {
-            log::warn("UniverseSystematicStrategy::bookVariations", identifier_,
-                      "central weight is zero");
-            return 1.0;
-          }
-
-          const double central_first = static_cast<double>(weights.front());
-          if (std::abs(central_first - central) >
-              1e-6 * std::max(1.0, std::abs(central_first))) {
-            log::debug("UniverseSystematicStrategy::bookVariations", identifier_,
-                       "central weight differs from first element", "first",
-                       central_first, "mean", central);
-          }
-
-          if (u < weights.size()) {
-            const double w = static_cast<double>(weights[u]);
-            const double ratio = w / central;
-            if (std::abs(ratio) > 1e3) {
-              log::warn("UniverseSystematicStrategy::bookVariations", identifier_,
-                        "extreme universe weight", "universe", u, "weight", w,
-                        "central", central, "ratio", ratio);
-            }
-            return ratio;
-          }
-          return 1.0;
-        };
-        auto node = rnode.Define(uni_weight_name, weight, {vector_name_});
-        futures.variations[uni_key][sample_key] =
-            node.Histo1D(model, binning.getVariable(), uni_weight_name);
-      } else {
-        throw std::runtime_error("Unsupported weight vector type: " +
-                                 std::string(col_type));
-      }
+    // All universes are filled by one action per sample, so the weight
+    // vector is read and its central value computed once per event.
+    ROOT::RDF::RNode node = rnode;
+    const auto variable = widenColumn(
+        node, binning.getVariable(),
+        dispatchValueColumn(node.GetColumnType(binning.getVariable()),
+                            [](auto) {}));
+    const auto value_type = node.GetColumnType(variable);
+    const auto weight_type = node.GetColumnType(vector_name_);
+    const auto n_slots = node.GetNSlots();
+    bool booked = false;
+    const bool known_value = dispatchValueColumn(value_type, [&](auto value_tag) {
+      using Value = typename decltype(value_tag)::type;
+      booked = dispatchWeightVectorColumn(weight_type, [&](auto weight_tag) {
+        using Weight = typename decltype(weight_tag)::type;
+        UniverseFillHelper<Value, Weight> helper(binning.getEdges(), n_universes_,
+                                                 n_slots, identifier_);
+        futures.universes[SystematicKey{identifier_}][sample_key] =
+            node.Book<Value, ROOT::RVec<Weight>>(std::move(helper),
+                                                 {variable, vector_name_});
+      });
+    });
+
+    if (!known_value) {
+      throw std::runtime_error("Unsupported variable type: " +
+                               std::string(value_type));
+    }
+    if (!booked) {
+      throw std::runtime_error("Unsupported weight vector type: " +
+                               std::string(weight_type));
     }
   }
 
-  TMatrixDSym computeCovariance(VariableResult &result,
-                                SystematicFutures &futures) override {
+  void evaluate(const VariableResult &result, SystematicFutures &futures,
+                SystematicOutput &out) const override {
     const auto &nominal_hist = result.total_mc_hist_;
     const auto &binning = result.binning_;
     const int n = nominal_hist.getNumberOfBins();
-    TMatrixDSym cov(n);
-    cov.Zero();
 
-    std::vector<BinnedHistogram> stored_hists;
-    log::debug("UniverseSystematicStrategy::computeCovariance", identifier_,
+    // Without futures, e.g. on merged partial results, the universe counts
+    // stored in the result are used.
+    const SystematicKey key{identifier_};
+    auto it = futures.universes.find(key);
+    auto stored = result.universe_counts_.find(key);
+    if ((it == futures.universes.end() &&
+         stored == result.universe_counts_.end()) ||
+        n_universes_ == 0) {
+      log::warn("UniverseSystematicStrategy::evaluate",
+                "No universes booked for", identifier_);
+      out.covariance_ = CovarianceMatrix(n);
+      return;
+    }
+
+    log::debug("UniverseSystematicStrategy::evaluate", identifier_,
                "processing", n_universes_, "universes");
-    unsigned processed_universes = 0;
-    for (unsigned u = 0; u < n_universes_; ++u) {
-      const SystematicKey uni_key(identifier_ + "_u" + std::to_string(u));
-      if (!futures.variations.count(uni_key)) {
-        log::warn("UniverseSystematicStrategy::computeCovariance",
-                  "Missing universe", u, "for", identifier_);
-        continue;
+    // Samples whose weight vectors are shorter than configured fill fewer
+    // universes; only the universes filled everywhere are kept.
+    Eigen::MatrixXd universes = Eigen::MatrixXd::Zero(n_universes_, n);
+    if (it != futures.universes.end()) {
+      for (auto &[sample_key, future] : it->second) {
+        const auto *counts = future.GetPtr();
+        if (!counts)
+          continue;
+        if (counts->rows() > universes.rows() ||
+            !VariableResult::addUniverseCounts(universes, *counts)) {
+          log::warn("UniverseSystematicStrategy::evaluate",
+                    identifier_, "skipping sample", sample_key.str(),
+                    "with mismatched universe matrix");
+        }
       }
+    } else if (stored->second.rows() <= universes.rows() &&
+               stored->second.cols() == universes.cols()) {
+      universes = stored->second;
+    } else {
+      log::warn("UniverseSystematicStrategy::evaluate", identifier_,
+                "ignoring mismatched stored universe matrix");
+    }
 
-      auto h_universe = buildUniverseHistogram(binning, n, uni_key, futures);
-      updateCovarianceMatrix(cov, nominal_hist, h_universe);
+    Eigen::RowVectorXd nominal(n);
+    for (int i = 0; i < n; ++i)
+      nominal(i) = nominal_hist.getBinContent(i);
+    const Eigen::MatrixXd deltas = universes.rowwise() - nominal;
 
-      ++processed_universes;
-      storeUniverseHistogram(stored_hists, std::move(h_universe));
+    if ((deltas.array().abs() > 1e5).any()) {
+      log::warn("UniverseSystematicStrategy::evaluate", identifier_,
+                "large bin delta", "max",
+                deltas.array().abs().maxCoeff());
     }
 
-    const double n_universes = static_cast<double>(processed_universes);
-    for (int i = 0; i < n; ++i) {
-      for (int j = 0; j <= i; ++j) {
-        const double val = n_universes == 0 ? 0 : cov(i, j) / n_universes;
-        cov(i, j) = val;
-        cov(j, i) = val;
-      }
+    const Eigen::Index n_filled = universes.rows();
+    if (n_filled == 0) {
+      log::warn("UniverseSystematicStrategy::evaluate", identifier_,
+                "no universe was filled");
+      out.covariance_ = CovarianceMatrix(n);
+      return;
     }
-
-    if (store_universe_hists_ && !stored_hists.empty()) {
-      result.universe_projected_hists_[SystematicKey{identifier_}] =
-          std::move(stored_hists);
+    const Eigen::MatrixXd cov = CovarianceAccumulator::compute(
+        deltas, 1.0 / static_cast<double>(n_filled), covariance_options_);
+
+    if (store_universe_hists_) {
+      std::vector<HistogramCounts> stored_hists;
+      stored_hists.reserve(n_filled);
+      const Eigen::VectorXd no_sumw2 = Eigen::VectorXd::Zero(n);
+      for (Eigen::Index u = 0; u < n_filled; ++u)
+        stored_hists.push_back(HistogramCounts::fromSums(
+            binning.getEdges(), universes.row(u), no_sumw2));
+      out.universe_projected_hists_[key] = std::move(stored_hists);
     }
 
-    log::debug("UniverseSystematicStrategy::computeCovariance", identifier_,
-               "covariance calculated with", processed_universes, "universes");
-    return cov;
+    log::debug("UniverseSystematicStrategy::evaluate", identifier_,
+               "covariance calculated with", n_filled, "universes");
+    out.covariance_ = CovarianceMatrix(cov);
   }
 
   std::map<SystematicKey, BinnedHistogram>
@@ -233,55 +174,11 @@ public:
   }
 
 private:
-  BinnedHistogram buildUniverseHistogram(const BinningDefinition &binning,
-                                         int n, const SystematicKey &key,
-                                         SystematicFutures &futures) {
-    Eigen::VectorXd shifts = Eigen::VectorXd::Zero(n);
-    Eigen::MatrixXd shifts_mat = shifts;
-    BinnedHistogram h_universe(binning, std::vector<double>(n, 0.0),
-                               shifts_mat);
-
-    for (auto &[sample_key, future] : futures.variations.at(key)) {
-      if (future.GetPtr()) {
-        h_universe = h_universe +
-                     BinnedHistogram::createFromTH1D(binning, *future.GetPtr());
-      }
-    }
-    return h_universe;
-  }
-
-  void updateCovarianceMatrix(TMatrixDSym &cov,
-                              const BinnedHistogram &nominal_hist,
-                              const BinnedHistogram &h_universe) {
-    const int n = nominal_hist.getNumberOfBins();
-    for (int i = 0; i < n; ++i) {
-      const double di =
-          h_universe.getBinContent(i) - nominal_hist.getBinContent(i);
-      log::debug("UniverseSystematicStrategy::updateCovarianceMatrix",
-                 identifier_, "bin", i, "delta", di);
-      if (std::abs(di) > 1e5) {
-        log::warn("UniverseSystematicStrategy::updateCovarianceMatrix", identifier_,
-                  "large bin delta", "bin", i, "delta", di,
-                  "nominal", nominal_hist.getBinContent(i));
-      }
-      for (int j = 0; j <= i; ++j) {
-        const double dj =
-            h_universe.getBinContent(j) - nominal_hist.getBinContent(j);
-        cov(i, j) += di * dj;
-      }
-    }
-  }
-
-  void storeUniverseHistogram(std::vector<BinnedHistogram> &stored_hists,
-                              BinnedHistogram &&h_universe) {
-    if (store_universe_hists_)
-      stored_hists.push_back(std::move(h_universe));
-  }
-
   std::string identifier_;
   std::string vector_name_;
   unsigned n_universes_;
   bool store_universe_hists_;
+  CovarianceOptions covariance_options_;
 };
 
 } // namespace analysis
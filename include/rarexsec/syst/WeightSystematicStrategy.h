@@ -4,10 +4,10 @@
 #include <rarexsec/hist/BinnedHistogram.h>
 #include <rarexsec/syst/SystematicStrategy.h>
 #include <rarexsec/utils/Logger.h>
-#include <TMatrixDSym.h>
 #include <cmath>
 #include <map>
 #include <string>
+#include <utility>
 #include <vector>
 
 namespace analysis {
@@ -23,7 +23,7 @@ public:
 
   void bookVariations(const SampleKey &sample_key, ROOT::RDF::RNode &rnode,
                       const BinningDefinition &binning,
-                      const ROOT::RDF::TH1DModel &model,
+                      const ROOT::RDF::TH1DModel &,
                       SystematicFutures &futures) override {
     log::debug("WeightSystematicStrategy::bookVariations", identifier_,
                "sample", sample_key.str());
@@ -36,27 +36,28 @@ public:
     const SystematicKey up_key{identifier_ + "_up"};
     const SystematicKey dn_key{identifier_ + "_dn"};
     futures.variations[up_key][sample_key] =
-        rnode.Histo1D(model, binning.getVariable(), up_column_);
+        bookHistogramCounts(rnode, binning, up_column_);
     futures.variations[dn_key][sample_key] =
-        rnode.Histo1D(model, binning.getVariable(), dn_column_);
+        bookHistogramCounts(rnode, binning, dn_column_);
   }
 
-  TMatrixDSym computeCovariance(VariableResult &result,
-                                SystematicFutures &futures) override {
+  void evaluate(const VariableResult &result, SystematicFutures &futures,
+                SystematicOutput &out) const override {
     const auto &nominal_hist = result.total_mc_hist_;
     const auto &binning = result.binning_;
     const int n = nominal_hist.getNumberOfBins();
-    TMatrixDSym cov(n);
-    cov.Zero();
+    CovarianceMatrix cov(n);
 
     const SystematicKey up_key{identifier_ + "_up"};
     const SystematicKey dn_key{identifier_ + "_dn"};
 
-    const auto hu = accumulateVariation(binning, n, up_key, futures, "up");
-    const auto hd = accumulateVariation(binning, n, dn_key, futures, "down");
+    const auto hu =
+        accumulateVariation(result, binning, n, up_key, futures, "up");
+    const auto hd =
+        accumulateVariation(result, binning, n, dn_key, futures, "down");
 
-    result.variation_hists_[up_key] = hu;
-    result.variation_hists_[dn_key] = hd;
+    out.variation_hists_[up_key] = hu;
+    out.variation_hists_[dn_key] = hd;
 
     std::vector<double> diff_up(n), diff_dn(n);
     for (int i = 0; i < n; ++i) {
@@ -67,26 +68,25 @@ public:
       diff_dn[i] = dn - nominal;
 
       if (std::abs(up - dn) < 1e-6) {
-        log::warn("WeightSystematicStrategy::computeCovariance", identifier_,
+        log::warn("WeightSystematicStrategy::evaluate", identifier_,
                   "identical up and down variations in bin", i);
       }
       if (nominal == 0.0 && (std::abs(up) > 1e-6 || std::abs(dn) > 1e-6)) {
-        log::warn("WeightSystematicStrategy::computeCovariance", identifier_,
+        log::warn("WeightSystematicStrategy::evaluate", identifier_,
                   "non-zero variation in bin", i, "with zero nominal content");
       }
 
-      log::debug("WeightSystematicStrategy::computeCovariance", identifier_,
+      log::debug("WeightSystematicStrategy::evaluate", identifier_,
                  "bin", i, "diff_up", diff_up[i], "diff_down", diff_dn[i]);
       for (int j = 0; j <= i; ++j) {
         const double val =
             0.5 * (diff_up[i] * diff_up[j] + diff_dn[i] * diff_dn[j]);
-        cov(i, j) = val;
-        cov(j, i) = val;
+        cov.set(i, j, val);
       }
     }
-    log::debug("WeightSystematicStrategy::computeCovariance", identifier_,
+    log::debug("WeightSystematicStrategy::evaluate", identifier_,
                "covariance calculated");
-    return cov;
+    out.covariance_ = std::move(cov);
   }
 
   std::map<SystematicKey, BinnedHistogram>
@@ -96,7 +96,10 @@ public:
   }
 
 private:
-  BinnedHistogram accumulateVariation(const BinningDefinition &binning, int n,
+  // Without futures, e.g. on merged partial results, the variation stored
+  // in the result is used.
+  BinnedHistogram accumulateVariation(const VariableResult &result,
+                                      const BinningDefinition &binning, int n,
                                       const SystematicKey &key,
                                       SystematicFutures &futures,
                                       const std::string &direction) const {
@@ -104,18 +107,20 @@ private:
     Eigen::MatrixXd shifts_mat = shifts;
     BinnedHistogram hist(binning, std::vector<double>(n, 0.0), shifts_mat);
     if (!futures.variations.count(key)) {
-      log::warn("WeightSystematicStrategy::computeCovariance", "Missing",
+      auto stored = result.variation_hists_.find(key);
+      if (stored != result.variation_hists_.end() &&
+          stored->second.getNumberOfBins() == n)
+        return stored->second;
+      log::warn("WeightSystematicStrategy::evaluate", "Missing",
                 direction, "variation for", identifier_);
       return hist;
     }
 
-    log::debug("WeightSystematicStrategy::computeCovariance", "Accumulating",
+    log::debug("WeightSystematicStrategy::evaluate", "Accumulating",
                direction, "variations for", identifier_);
     for (auto &[sample_key, future] : futures.variations.at(key)) {
-      if (future.GetPtr()) {
-        hist =
-            hist + BinnedHistogram::createFromTH1D(binning, *future.GetPtr());
-      }
+      if (const auto *counts = future.GetPtr())
+        hist.addSums(binning, counts->sumw(), counts->sumw2());
     }
     return hist;
   }
@@ -25,12 +25,25 @@ public:
     CutFlowCalculator<AnalysisDataLoader> calculator(*loader_, *definition_);
     auto& mutable_results = const_cast<AnalysisResult&>(results);
     auto& regions = mutable_results.regions();
+    using Calculator = CutFlowCalculator<AnalysisDataLoader>;
+    std::vector<std::pair<RegionHandle, Calculator::PendingCutFlow>> pending;
+    std::vector<ROOT::RDF::RResultHandle> handles;
     for (const auto& region_handle : definition_->regions()) {
       auto it = regions.find(region_handle.key_);
-      if (it != regions.end()) {
-        calculator.compute(region_handle, it->second);
+      // Already tallied in the batched event loop of AnalysisRunner
+      if (it != regions.end() && it->second.cutFlow().empty()) {
+        pending.emplace_back(region_handle, calculator.book(region_handle));
+        Calculator::collectHandles(pending.back().second, handles);
       }
     }
+    if (pending.empty()) {
+      return;
+    }
+    ROOT::RDF::RunGraphs(handles);
+    for (auto& [region_handle, cut_flow] : pending) {
+      calculator.finalise(region_handle, cut_flow,
+                          regions.at(region_handle.key_));
+    }
   }
 
 private:
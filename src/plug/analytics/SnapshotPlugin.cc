@@ -18,6 +18,8 @@ class SnapshotPlugin : public IAnalysisPlugin {
         SelectionQuery selection;
         std::string output_directory{"snapshots"};
         std::vector<std::string> columns;
+        // Write the columns the analysis reads instead of every column.
+        bool required_columns{false};
     };
 
     SnapshotPlugin(const PluginArgs &args, AnalysisDataLoader *loader) : loader_(loader) {
@@ -32,6 +34,7 @@ class SnapshotPlugin : public IAnalysisPlugin {
             if (scfg.contains("columns")) {
                 sc.columns = scfg.at("columns").get<std::vector<std::string>>();
             }
+            sc.required_columns = scfg.value("required_columns", false);
             configs_.push_back(std::move(sc));
         }
     }
@@ -64,7 +67,8 @@ class SnapshotPlugin : public IAnalysisPlugin {
             std::string file =
                 cfg.output_directory + "/" + beam + "_" + period_tag + "_" + cfg.selection_rule + "_snapshot.root";
             log::info("SnapshotPlugin::onFinalisation", "Creating snapshot:", file);
-            loader_->snapshot(cfg.selection, file, cfg.columns);
+            const bool required = cfg.required_columns && cfg.columns.empty();
+            loader_->snapshot(cfg.selection, file, required ? loader_->requiredColumns() : cfg.columns);
         }
     }
 
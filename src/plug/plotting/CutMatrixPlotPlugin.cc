@@ -51,6 +51,8 @@ class CutMatrixPlotPlugin : public IPlotPlugin {
         }
     }
 
+    bool readsEvents() const override { return true; }
+
     void onPlot(const AnalysisResult &result) override {
         if (!loader_) {
             log::error("CutMatrixPlotPlugin::onPlot", "No AnalysisDataLoader context provided");
@@ -93,6 +93,9 @@ public:
     }
   }
 
+  bool readsEvents() const override { return true; }
+  bool singleThreaded() const override { return true; }
+
   void onPlot(const AnalysisResult &) override {
 #if defined(R__HAS_IMPLICITMT)
     if (ROOT::IsImplicitMTEnabled() && ROOT::GetThreadPoolSize() <= 1) {
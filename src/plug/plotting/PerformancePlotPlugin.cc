@@ -63,6 +63,8 @@ class PerformancePlotPlugin : public IPlotPlugin {
         }
     }
 
+    bool readsEvents() const override { return true; }
+
     void onPlot(const AnalysisResult &) override {
         if (!loader_) {
             log::error("PerformancePlotPlugin::onPlot", "No AnalysisDataLoader context provided");
@@ -1,5 +1,6 @@
 #include <algorithm>
 #include <cmath>
+#include <cstdint>
 #include <map>
 #include <mutex>
 #include <stdexcept>
@@ -7,6 +8,7 @@
 #include <vector>
 
 #include <rarexsec/data/AnalysisDataLoader.h>
+#include <rarexsec/data/NuMuCCSelectionProcessor.h>
 #include <rarexsec/data/VariableRegistry.h>
 #include <rarexsec/data/SampleTypes.h>
 #include <rarexsec/plot/SignalCutFlowPlot.h>
@@ -22,7 +24,9 @@ public:
   struct PlotConfig {
     std::vector<std::string> stages;
     std::vector<std::string> pass_columns;
-    std::vector<std::string> reason_columns;
+    // Packed pass bits and failure codes; stage i of the pass columns is
+    // decoded from stage i of this word.
+    std::string selection_column{NuMuCCSelectionProcessor::kSelectionColumn};
     std::string truth_column;
     std::string plot_name;
     std::string x_label{"Cut Stage"};
@@ -44,8 +48,9 @@ public:
       PlotConfig pc;
       pc.stages = p.at("stages").get<std::vector<std::string>>();
       pc.pass_columns = p.at("pass_columns").get<std::vector<std::string>>();
-      pc.reason_columns =
-          p.at("reason_columns").get<std::vector<std::string>>();
+      pc.selection_column = p.value(
+          "selection_column",
+          std::string{NuMuCCSelectionProcessor::kSelectionColumn});
       pc.truth_column = p.at("truth_column").get<std::string>();
       pc.plot_name =
           p.value("plot_name", std::string{"signal_cutflow_survival"});
@@ -61,13 +66,15 @@ public:
       pc.band_color = p.value("band_color", kGray);
       pc.band_alpha = p.value("band_alpha", 0.3);
       if (pc.stages.size() != pc.pass_columns.size() ||
-          pc.reason_columns.size() != pc.pass_columns.size())
+          pc.pass_columns.size() != kNuMuCCStageCount)
         throw std::runtime_error(
             "SignalCutFlowPlotPlugin configuration size mismatch");
       plots_.push_back(std::move(pc));
     }
   }
 
+  bool readsEvents() const override { return true; }
+
   void onPlot(const AnalysisResult &) override {
     if (!loader_) {
       log::error("SignalCutFlowPlotPlugin::onPlot",
@@ -98,15 +105,14 @@ private:
     std::vector<double> cum_counts(pc.stages.size(), 0.0);
     std::vector<double> cum_counts_w2(pc.stages.size(), 0.0);
     std::vector<double> cum_counts_all(pc.stages.size(), 0.0);
-    std::vector<std::map<std::string, double>> loss_reason(pc.stages.size());
+    std::vector<std::map<NuMuCCReason, double>> loss_reason(pc.stages.size());
     std::mutex m;
 
     std::vector<std::string> cols;
     cols.push_back(pc.truth_column);
     for (auto const &c : pc.pass_columns)
       cols.push_back(c);
-    for (size_t i = 1; i < pc.reason_columns.size(); ++i)
-      cols.push_back(pc.reason_columns[i]);
+    cols.push_back(pc.selection_column);
     cols.push_back(pc.weight_column);
 
     for (auto const &[skey, sample] : loader_->getSampleFrames()) {
@@ -117,9 +123,7 @@ private:
         df = df.Define(pc.truth_column.c_str(), "false");
       }
       auto lam = [&](bool is_sig, bool p0, bool p1, bool p2, bool p3, bool p4,
-                     bool p5, const std::string &r1, const std::string &r2,
-                     const std::string &r3, const std::string &r4,
-                     const std::string &r5, double weight) {
+                     bool p5, std::uint32_t selection, double weight) {
         std::lock_guard<std::mutex> lock(m);
         Ntot += weight;
         bool pass[6] = {p0, p1, p2, p3, p4, p5};
@@ -148,13 +152,8 @@ private:
           }
         }
         if (first_fail > 0) {
-          const std::string &reason = (first_fail == 1)   ? r1
-                                      : (first_fail == 2) ? r2
-                                      : (first_fail == 3) ? r3
-                                      : (first_fail == 4) ? r4
-                                                          : r5;
-          std::string key = reason.empty() ? "unspecified" : reason;
-          loss_reason[first_fail][key] += weight;
+          const auto reason = NuMuCCSelectionWord::reason(selection, first_fail);
+          loss_reason[first_fail][reason] += weight;
         }
       };
       df.Foreach(lam, cols);
@@ -187,7 +186,9 @@ private:
         total += c;
         if (c > top_count) {
           top_count = c;
-          top_reason = r;
+          top_reason = r == NuMuCCReason::kNone
+                           ? "unspecified"
+                           : NuMuCCSelectionWord::reasonName(r);
         }
       }
       losses[i] = {top_reason, top_count, total};
@@ -0,0 +1,118 @@
+#include <rarexsec/hist/BinLookup.h>
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <Eigen/Dense>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <vector>
+
+using namespace analysis;
+
+namespace {
+// Folded upper_bound, the behaviour every lookup path must reproduce
+int reference(const std::vector<double> &edges, double x) {
+  const int n = static_cast<int>(edges.size()) - 1;
+  if (!(x < edges.back()))
+    return n - 1;
+  auto it = std::upper_bound(edges.begin(), edges.end(), x);
+  return it == edges.begin() ? 0 : static_cast<int>(it - edges.begin()) - 1;
+}
+
+std::vector<double> uniformEdges(int n, double lo, double hi) {
+  std::vector<double> edges(n + 1);
+  for (int i = 0; i <= n; ++i)
+    edges[i] = lo + (hi - lo) * i / n;
+  return edges;
+}
+
+// Narrow bins near zero and wide ones in the tail, like a dynamic binning
+std::vector<double> variableEdges(int n) {
+  std::vector<double> edges(n + 1);
+  for (int i = 0; i <= n; ++i)
+    edges[i] = std::pow(static_cast<double>(i) / n, 1.5) * 10.0;
+  return edges;
+}
+
+// Many narrow bins and one long tail bin, as Bayesian blocks can produce;
+// nearly every bin lands in the first table cell
+std::vector<double> skewedEdges(int n) {
+  auto edges = uniformEdges(n, 0.0, 1.0);
+  edges.push_back(1000.0);
+  return edges;
+}
+
+std::vector<double> samples(const std::vector<double> &edges, std::size_t n) {
+  std::mt19937 rng(7);
+  const double span = edges.back() - edges.front();
+  std::uniform_real_distribution<double> dist(edges.front() - 0.1 * span, edges.back() + 0.1 * span);
+  std::vector<double> xs(n);
+  for (auto &x : xs)
+    x = dist(rng);
+  return xs;
+}
+} // namespace
+
+TEST_CASE("bin lookup matches the folded binary search") {
+  const double inf = std::numeric_limits<double>::infinity();
+  const std::vector<std::vector<double>> cases{
+      uniformEdges(50, 0.0, 10.0), uniformEdges(7, -1.0, 0.3), variableEdges(40),
+      variableEdges(2000), skewedEdges(200), {0.0, 1.0, 1.0, 2.0, 5.0}, {-inf, 0.0, 1.0, inf}};
+  for (const auto &edges : cases) {
+    BinLookup lookup(edges);
+    auto xs = samples(edges, 5000);
+    xs.insert(xs.end(), edges.begin(), edges.end());
+    xs.insert(xs.end(), {std::nan(""), inf, -inf});
+    for (double x : xs) {
+      CHECK(lookup.find(x) == reference(edges, x));
+      CHECK(BinLookup::search(edges.data(), edges.data() + edges.size(), x) == reference(edges, x));
+    }
+  }
+}
+
+TEST_CASE("bin lookup keeps the table scan short") {
+  CHECK(BinLookup(variableEdges(40)).tabulated());
+  CHECK(BinLookup(variableEdges(1000)).tabulated());
+
+  const auto skewed = skewedEdges(200);
+  BinLookup lookup(skewed);
+  CHECK_FALSE(lookup.tabulated());
+  auto xs = samples(uniformEdges(1, 0.0, 1.0), 5000);
+  const auto tail = samples(skewed, 1000);
+  xs.insert(xs.end(), tail.begin(), tail.end());
+  for (double x : xs)
+    CHECK(lookup.find(x) == reference(skewed, x));
+}
+
+// Run with: test_bin_lookup "[benchmark]"
+TEST_CASE("bin lookup throughput", "[.][benchmark]") {
+  const auto uniform = uniformEdges(50, 0.0, 10.0);
+  const auto variable = variableEdges(50);
+  const auto xs = samples(variable, 1 << 16);
+
+  const auto sum = [&](auto &&find) {
+    long long total = 0;
+    for (double x : xs)
+      total += find(x);
+    return total;
+  };
+
+  BENCHMARK("upper_bound, variable edges") { return sum([&](double x) { return reference(variable, x); }); };
+  BENCHMARK("branch-free search, variable edges") {
+    return sum([&](double x) { return BinLookup::search(variable.data(), variable.data() + variable.size(), x); });
+  };
+  BinLookup table(variable);
+  BENCHMARK("table lookup, variable edges") { return sum([&](double x) { return table.find(x); }); };
+  BinLookup arithmetic(uniform);
+  BENCHMARK("arithmetic lookup, uniform edges") { return sum([&](double x) { return arithmetic.find(x); }); };
+
+  // One lookup per value followed by a vectorised add over the universes
+  Eigen::MatrixXd counts = Eigen::MatrixXd::Zero(500, 50);
+  const Eigen::VectorXd ratios = Eigen::VectorXd::Constant(500, 1.01);
+  BENCHMARK("universe fill, 500 universes") {
+    for (double x : xs)
+      counts.col(table.find(x)) += ratios;
+    return counts(0, 0);
+  };
+}
@@ -0,0 +1,102 @@
+#include <rarexsec/data/ColumnDependencies.h>
+#include <rarexsec/data/MuonSelectionProcessor.h>
+#include <rarexsec/data/PreselectionProcessor.h>
+#include <rarexsec/data/ReconstructionProcessor.h>
+
+#include "ROOT/RDataFrame.hxx"
+#include "ROOT/RVec.hxx"
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <algorithm>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+using namespace analysis;
+
+TEST_CASE("identifiers skip functions, literals and members") {
+    auto ids = ColumnDependencyGraph::identifiers(
+        "ROOT::VecOps::Sum(muon_mask) > 0 && topological_score > 0.06f && "
+        "track_length.size() < 3 && run != \"skip_me\" && static_cast<int>(num_slices) == 1");
+
+    REQUIRE(ids == std::vector<std::string>{"muon_mask", "topological_score", "track_length", "run", "num_slices"});
+}
+
+TEST_CASE("resolve closes analysis columns over the processor chain") {
+    ReconstructionProcessor reco;
+    reco.chainNextProcessor(std::make_unique<MuonSelectionProcessor>());
+    ColumnDependencyGraph graph;
+    reco.declareChainColumns(graph);
+
+    const std::set<std::string> available = {
+        "track_shower_scores", "trk_llr_pid_v", "track_length", "track_distance_to_vertex",
+        "track_start_x", "track_start_y", "track_start_z", "track_end_x", "track_end_y", "track_end_z",
+        "pfp_generations", "pfp_num_plane_hits_U", "pfp_num_plane_hits_V", "pfp_num_plane_hits_Y",
+        "reco_neutrino_vertex_sce_x", "reco_neutrino_vertex_sce_y", "reco_neutrino_vertex_sce_z",
+        "track_theta", "run", "software_trigger", "event_detector_image_u"};
+
+    auto req = graph.resolve({"has_muon", "in_reco_fiducial", "software_trigger", "missing_branch"}, available);
+
+    REQUIRE(req.derived == std::set<std::string>{"has_muon", "n_muons_tot", "muon_candidates", "in_reco_fiducial",
+                                                 "software_trigger"});
+    REQUIRE(req.inputs.count("track_shower_scores") == 1);
+    REQUIRE(req.inputs.count("reco_neutrino_vertex_sce_z") == 1);
+    REQUIRE(req.inputs.count("software_trigger") == 1);
+    REQUIRE(req.inputs.count("software_trigger_pre") == 0);
+    REQUIRE(req.inputs.count("event_detector_image_u") == 0);
+    REQUIRE(req.unknown == std::set<std::string>{"missing_branch"});
+}
+
+TEST_CASE("columns declared by several processors are reported as shared") {
+    ReconstructionProcessor reco;
+    reco.chainNextProcessor(std::make_unique<PreselectionProcessor>());
+    ColumnDependencyGraph graph;
+    reco.declareChainColumns(graph);
+
+    const auto shared = graph.shared();
+    REQUIRE(shared.size() == 3);
+    REQUIRE(shared.count("in_reco_fiducial") == 1);
+    REQUIRE(shared.count("n_pfps_gen2") == 1);
+    REQUIRE(shared.at("software_trigger").size() == 2);
+
+    auto req = graph.resolve({"numu_presel"});
+    const auto unused = graph.unused(req);
+    REQUIRE(unused.count("quality_event") == 1);
+    REQUIRE(unused.count("n_pfps_gen3") == 1);
+    REQUIRE(unused.count("in_reco_fiducial") == 0);
+}
+
+TEST_CASE("declared columns match the columns a processor defines") {
+    using ROOT::RVec;
+    const std::vector<std::string> float_inputs = {
+        "track_shower_scores", "trk_llr_pid_v", "track_length", "track_distance_to_vertex", "track_start_x",
+        "track_start_y", "track_start_z", "track_end_x", "track_end_y", "track_end_z", "track_theta"};
+
+    ROOT::RDF::RNode df = ROOT::RDataFrame(1);
+    for (const auto &column : float_inputs)
+        df = df.Define(column, [] { return RVec<float>{1.f}; });
+    df = df.Define("pfp_generations", [] { return RVec<unsigned>{2u}; });
+    for (const auto *column : {"pfp_num_plane_hits_U", "pfp_num_plane_hits_V", "pfp_num_plane_hits_Y"})
+        df = df.Define(column, [] { return RVec<int>{1}; });
+    const auto inputs = df.GetDefinedColumnNames();
+
+    MuonSelectionProcessor muon;
+    auto processed = muon.process(df, SampleOrigin::kMonteCarlo);
+    std::set<std::string> defined;
+    for (const auto &column : processed.GetDefinedColumnNames()) {
+        if (std::find(inputs.begin(), inputs.end(), column) == inputs.end())
+            defined.insert(column);
+    }
+
+    ColumnDependencyGraph graph;
+    muon.declareChainColumns(graph);
+    std::set<std::string> declared;
+    for (const auto &[column, deps] : graph.definitions()) {
+        declared.insert(column);
+        for (const auto &dep : deps)
+            REQUIRE((graph.isDerived(dep) || std::find(inputs.begin(), inputs.end(), dep) != inputs.end()));
+    }
+    REQUIRE(defined == declared);
+}
@@ -0,0 +1,40 @@
+#include <rarexsec/core/CutFlowCalculator.h>
+#include <rarexsec/core/CutFlowHelper.h>
+
+#include <catch2/catch_approx.hpp>
+#include <catch2/catch_test_macros.hpp>
+
+using namespace analysis;
+using Catch::Approx;
+
+TEST_CASE("cut flow helper tallies stages in one pass") {
+    std::vector<StratumIndex> indices{StratumIndex({10, 11}), StratumIndex({50})};
+    CutFlowHelper<double, int, int> helper(3, indices, 2);
+
+    // stage is the number of leading clauses passed
+    helper.Exec(0, 0, 1.0, 10, 50);
+    helper.Exec(1, 2, 2.0, 11, 50);
+    helper.Exec(0, 1, 3.0, 7, 3);
+    helper.Finalize();
+
+    std::vector<RegionAnalysis::StageCount> stages(3);
+    accumulateCutFlow(*helper.GetResultPtr(), {"a", "b"}, indices, stages);
+
+    REQUIRE(stages[0].total == Approx(6.0));
+    REQUIRE(stages[0].total_w2 == Approx(14.0));
+    REQUIRE(stages[1].total == Approx(5.0));
+    REQUIRE(stages[2].total == Approx(2.0));
+
+    REQUIRE(stages[0].schemes.at("a").at(10).first == Approx(1.0));
+    REQUIRE(stages[1].schemes.at("a").at(10).first == Approx(0.0));
+    REQUIRE(stages[2].schemes.at("a").at(11).first == Approx(2.0));
+    REQUIRE(stages[2].schemes.at("a").at(11).second == Approx(4.0));
+    REQUIRE(stages[0].schemes.at("b").at(50).first == Approx(3.0));
+    REQUIRE(stages[2].schemes.at("b").at(50).first == Approx(2.0));
+}
+
+TEST_CASE("cut flow stage expression short circuits on first failure") {
+    REQUIRE(CutFlowCalculator<int>::stageExpression({}) == "static_cast<int>(0)");
+    REQUIRE(CutFlowCalculator<int>::stageExpression({"x > 1", "y < 2"}) ==
+            "static_cast<int>(!(x > 1) ? 0 : !(y < 2) ? 1 : 2)");
+}
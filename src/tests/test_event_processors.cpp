@@ -0,0 +1,159 @@
+#include <rarexsec/data/BlipProcessor.h>
+#include <rarexsec/data/ExpressionCompiler.h>
+#include <rarexsec/data/MuonSelectionProcessor.h>
+#include <rarexsec/data/SampleCache.h>
+#include <rarexsec/data/TruthChannelProcessor.h>
+
+#include "ROOT/RDataFrame.hxx"
+#include "ROOT/RVec.hxx"
+
+#include <catch2/catch_approx.hpp>
+#include <catch2/catch_test_macros.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+using namespace analysis;
+using ROOT::RVec;
+
+namespace {
+// RVec comparisons are element-wise; compare as vectors instead.
+template <typename T> std::vector<T> values(const RVec<T> &v) { return std::vector<T>(v.begin(), v.end()); }
+} // namespace
+
+TEST_CASE("muon candidates keep the selected tracks in order") {
+    // Track 0 passes, 1 fails the score, 2 passes, 3 is outside the fiducial
+    // volume at its end and 4 has the wrong generation.
+    const RVec<float> scores{0.9f, 0.5f, 0.95f, 0.9f, 0.9f};
+    const RVec<float> llr{0.5f, 0.5f, 0.3f, 0.5f, 0.5f};
+    const RVec<float> lengths{20.f, 20.f, 15.f, 20.f, 20.f};
+    const RVec<float> dists{1.f, 1.f, 2.f, 1.f, 1.f};
+    const RVec<float> start_x{100.f, 100.f, 110.f, 100.f, 100.f};
+    const RVec<float> start_y(5, 0.f);
+    const RVec<float> start_z(5, 500.f);
+    const RVec<float> end_x{120.f, 120.f, 130.f, 300.f, 120.f};
+    const RVec<float> end_y(5, 10.f);
+    const RVec<float> end_z(5, 520.f);
+    const RVec<unsigned> gens{2u, 2u, 2u, 2u, 3u};
+    const RVec<int> hits(5, 10);
+    const RVec<float> theta{0.f, 0.f, 0.5f, 0.f, 0.f};
+
+    const auto c = MuonSelectionProcessor::selectCandidates(scores, llr, lengths, dists, start_x, start_y, start_z,
+                                                            end_x, end_y, end_z, gens, hits, hits, hits, theta);
+
+    REQUIRE(values(c.mask) == std::vector<bool>{true, false, true, false, false});
+    REQUIRE(c.size() == 2);
+    CHECK(values(c.score) == std::vector<float>{0.9f, 0.95f});
+    CHECK(values(c.start_x) == std::vector<float>{100.f, 110.f});
+    CHECK(values(c.end_x) == std::vector<float>{120.f, 130.f});
+    CHECK(values(c.length) == std::vector<float>{20.f, 15.f});
+    CHECK(values(c.generation) == std::vector<unsigned>{2u, 2u});
+    CHECK(c.costheta[0] == Catch::Approx(1.0));
+    CHECK(c.costheta[1] == Catch::Approx(std::cos(0.5)));
+}
+
+TEST_CASE("muon candidates of an event without tracks are empty") {
+    const RVec<float> none;
+    const RVec<unsigned> no_gens;
+    const RVec<int> no_hits;
+    const auto c = MuonSelectionProcessor::selectCandidates(none, none, none, none, none, none, none, none, none,
+                                                            none, no_gens, no_hits, no_hits, no_hits, none);
+    CHECK(c.mask.empty());
+    CHECK(c.size() == 0);
+    CHECK(c.generation.empty());
+}
+
+TEST_CASE("processed frames snapshot without a column list") {
+    const auto floats = [](float v) { return [v] { return RVec<float>(2, v); }; };
+    ROOT::RDF::RNode df = ROOT::RDataFrame(3)
+                              .Define("track_shower_scores", floats(0.9f))
+                              .Define("trk_llr_pid_v", floats(0.5f))
+                              .Define("track_length", floats(20.f))
+                              .Define("track_distance_to_vertex", floats(1.f))
+                              .Define("track_start_x", floats(100.f))
+                              .Define("track_start_y", floats(0.f))
+                              .Define("track_start_z", floats(500.f))
+                              .Define("track_end_x", floats(120.f))
+                              .Define("track_end_y", floats(10.f))
+                              .Define("track_end_z", floats(520.f))
+                              .Define("pfp_generations", [] { return RVec<unsigned>(2, 2u); })
+                              .Define("pfp_num_plane_hits_U", [] { return RVec<int>(2, 10); })
+                              .Define("pfp_num_plane_hits_V", [] { return RVec<int>(2, 10); })
+                              .Define("pfp_num_plane_hits_Y", [] { return RVec<int>(2, 10); })
+                              .Define("track_theta", floats(0.f));
+    MuonSelectionProcessor processor;
+    df = ExpressionCompiler::instance().filter(processor.process(df, SampleOrigin::kData), "n_muons_tot > 1");
+
+    const auto columns = persistentColumns(df);
+    CHECK(std::find(columns.begin(), columns.end(), MuonSelectionProcessor::kCandidatesColumn) == columns.end());
+    CHECK(std::none_of(columns.begin(), columns.end(), [](const std::string &c) { return isExpressionView(c); }));
+    CHECK(std::find(columns.begin(), columns.end(), "muon_trk_score_v") != columns.end());
+
+    const auto path = (std::filesystem::temp_directory_path() / "rarexsec_test_snapshot.root").string();
+    df.Snapshot("events", path, columns);
+    ROOT::RDataFrame written("events", path);
+    CHECK(*written.Count() == 3);
+    CHECK(values(written.Take<RVec<float>>("muon_trk_score_v")->front()) == std::vector<float>{0.9f, 0.9f});
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("genie mode frequencies count each event once across event loops") {
+    const auto ints = [](int v) { return [v] { return v; }; };
+    const auto floats = [](float v) { return [v] { return v; }; };
+    ROOT::RDF::RNode df = ROOT::RDataFrame(6)
+                              .Define("interaction_mode", [](ULong64_t e) { return e < 4 ? 0 : 1097; }, {"rdfentry_"})
+                              .Define("neutrino_vertex_x", floats(100.f))
+                              .Define("neutrino_vertex_y", floats(0.f))
+                              .Define("neutrino_vertex_z", floats(500.f))
+                              .Define("neutrino_pdg", ints(14))
+                              .Define("interaction_ccnc", ints(0))
+                              .Define("neutrino_purity_from_pfp", floats(1.f))
+                              .Define("neutrino_completeness_from_pfp", floats(1.f));
+    for (const char *count : {"count_kaon_plus", "count_kaon_minus", "count_kaon_zero", "count_lambda",
+                              "count_sigma_plus", "count_sigma_zero", "count_sigma_minus", "count_pi_plus",
+                              "count_pi_minus", "count_proton", "count_pi_zero", "count_gamma"})
+        df = df.Define(count, ints(0));
+
+    TruthChannelProcessor processor;
+    df = processor.process(df, SampleOrigin::kMonteCarlo);
+    CHECK(processor.modeStats().total() == 0);
+
+    // Two separate event loops over the same frame
+    CHECK(*df.Sum<int>("genie_int_mode") == -2);
+    CHECK(*df.Filter([](int mode) { return mode == 0; }, {"genie_int_mode"}).Count() == 4);
+
+    const auto stats = processor.modeStats();
+    CHECK(stats.total() == 6);
+    CHECK(stats.counts.at(0) == 4);
+    CHECK(stats.counts.at(1097) == 2);
+    CHECK(stats.uncategorised() == std::vector<int>{1097});
+}
+
+TEST_CASE("blip process interning matches the direct classification") {
+    const RVec<std::string> processes{"nCapture", "nCapture", "compt", "", "null", "exotic", "compt", "muIoni"};
+    BlipProcessor::ProcessInterner interner;
+
+    const auto codes = interner.codes(processes);
+    REQUIRE(codes.size() == processes.size());
+    for (std::size_t i = 0; i < processes.size(); ++i)
+        CHECK(codes[i] == blipProcessCode(processes[i]));
+    CHECK(values(codes) == std::vector<int>{2, 2, 4, 0, 0, -1, 4, 6});
+
+    // A later event reuses the table and gets its own array.
+    const auto next = interner.codes({"exotic", "hIoni"});
+    CHECK(values(next) == std::vector<int>{-1, 7});
+    CHECK(codes.size() == processes.size());
+}
+
+TEST_CASE("blip distances are measured from the vertex") {
+    const float bx[] = {3.f, 0.f};
+    const float by[] = {4.f, 0.f};
+    const float bz[] = {0.f, -2.f};
+    float out[2];
+    blipDistances(bx, by, bz, 2, 0.f, 0.f, 0.f, out);
+    CHECK(out[0] == Catch::Approx(5.f));
+    CHECK(out[1] == Catch::Approx(2.f));
+}
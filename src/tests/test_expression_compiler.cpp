@@ -0,0 +1,76 @@
+#include <rarexsec/data/ExpressionCompiler.h>
+
+#include "ROOT/RDataFrame.hxx"
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <string>
+#include <vector>
+
+using namespace analysis;
+
+namespace {
+
+bool parses(const std::string &expression) {
+    CompiledExpression program;
+    ExpressionParser parser(program);
+    return parser.parse(expression);
+}
+
+}
+
+TEST_CASE("selection grammar evaluates like the C++ expression") {
+    CompiledExpression program;
+    ExpressionParser parser(program);
+    REQUIRE(parser.parse("(x > 5 && x < 251) && !(n == 1 || -y >= 2 * n + 0.5f)"));
+    REQUIRE(program.columns() == std::vector<std::string>{"x", "n", "y"});
+    REQUIRE(program.boolean());
+
+    const double pass[] = {10.0, 2.0, 0.0};
+    const double fail_fv[] = {300.0, 2.0, 0.0};
+    const double fail_not[] = {10.0, 1.0, 0.0};
+    REQUIRE(program.evaluate(0, pass) == 1.0);
+    REQUIRE(program.evaluate(0, fail_fv) == 0.0);
+    REQUIRE(program.evaluate(0, fail_not) == 0.0);
+}
+
+TEST_CASE("clauses share one column table") {
+    CompiledExpression program;
+    ExpressionParser parser(program);
+    REQUIRE(parser.parse("has_muon"));
+    REQUIRE(parser.parse("num_slices == 1 and has_muon"));
+    REQUIRE(program.outputs() == 2);
+    REQUIRE(program.columns() == std::vector<std::string>{"has_muon", "num_slices"});
+    REQUIRE_FALSE(program.boolean());
+}
+
+TEST_CASE("constructs outside the grammar are left to JIT") {
+    REQUIRE_FALSE(parses("ROOT::VecOps::Sum(muon_mask) > 0"));
+    REQUIRE_FALSE(parses("track_length[0] > 10"));
+    REQUIRE_FALSE(parses("track_length.size() > 0"));
+    REQUIRE_FALSE(parses("n / 2 > 1"));
+    REQUIRE_FALSE(parses("n > 1 ? a : b"));
+    REQUIRE_FALSE(parses("mask & 4"));
+    REQUIRE_FALSE(parses("0x10 > n"));
+    REQUIRE(parses("order > 1 && notes < 2"));
+}
+
+TEST_CASE("integer columns keep their C++ semantics") {
+    const ULong64_t big_id = (ULong64_t{1} << 60) + 1;
+    ROOT::RDF::RNode df = ROOT::RDataFrame(4)
+                              .Define("event_id", [big_id](ULong64_t e) { return big_id - 1 + e; }, {"rdfentry_"})
+                              .Define("n", [](ULong64_t e) { return static_cast<int>(e); }, {"rdfentry_"})
+                              .Define("u", [](ULong64_t e) { return static_cast<unsigned>(e); }, {"rdfentry_"});
+    auto &compiler = ExpressionCompiler::instance();
+
+    // As doubles, big_id and its neighbours compare equal.
+    auto id_match = compiler.filter(df, "event_id == 1152921504606846977").Count();
+    // Integer division: n = 2 and n = 3 give 1.
+    auto halves = compiler.filter(df, "n / 2 == 1").Count();
+    // Unsigned wrap-around: 0u - 1 is large, not negative.
+    auto wrapped = compiler.filter(df, "u - 1 > 5").Count();
+
+    REQUIRE(*id_match == 1);
+    REQUIRE(*halves == 2);
+    REQUIRE(*wrapped == 1);
+}
@@ -0,0 +1,134 @@
+#include "ROOT/RDataFrame.hxx"
+#include "ROOT/RVec.hxx"
+#include <rarexsec/hist/BinnedHistogram.h>
+#include <rarexsec/hist/BinningDefinition.h>
+#include <rarexsec/hist/ColumnDispatch.h>
+#include <rarexsec/hist/CovarianceMatrix.h>
+#include <rarexsec/hist/HistogramCounts.h>
+#include <rarexsec/hist/HistogramFillHelper.h>
+#include <catch2/catch_test_macros.hpp>
+#include <Eigen/Dense>
+#include <cmath>
+#include <vector>
+
+using namespace analysis;
+
+namespace {
+BinningDefinition makeBinning() { return BinningDefinition({0.0, 1.0, 2.0}, "x", "x", {}); }
+
+BinnedHistogram makeHist(const BinningDefinition &b, std::vector<double> counts, std::vector<double> errors) {
+  Eigen::VectorXd sh = Eigen::Map<Eigen::VectorXd>(errors.data(), errors.size());
+  Eigen::MatrixXd m = sh;
+  return BinnedHistogram(b, counts, m);
+}
+} // namespace
+
+// In-place accumulation matches the copying operators
+TEST_CASE("histograms accumulate in place") {
+  auto b = makeBinning();
+  auto a = makeHist(b, {1.0, 2.0}, {0.3, 0.4});
+  auto c = makeHist(b, {3.0, 5.0}, {0.4, 0.3});
+  auto sum = a + c;
+  auto acc = a;
+  acc += c;
+  CHECK(acc.getBinContent(1) == sum.getBinContent(1));
+  CHECK(std::abs(acc.getBinError(0) - 0.5) < 1e-12);
+  acc.axpy(-2.0, c);
+  CHECK(acc.getBinContent(0) == -2.0);
+  CHECK(std::abs(acc.getBinError(1) - std::sqrt(0.25 + 0.36)) < 1e-12);
+
+  BinnedHistogram filled;
+  Eigen::MatrixXd sumw(2, 2), sumw2(2, 2);
+  sumw << 1.0, 2.0, 3.0, 4.0;
+  sumw2 << 1.0, 4.0, 9.0, 16.0;
+  for (int s = 0; s < 2; ++s)
+    filled.addSums(b, sumw.row(s).transpose(), sumw2.row(s).transpose());
+  CHECK(filled.getBinContent(1) == 6.0);
+  CHECK(std::abs(filled.getBinError(0) - std::sqrt(10.0)) < 1e-12);
+}
+
+// Statistical errors are carried as variances and only rooted when read
+TEST_CASE("histogram variances accumulate without square roots") {
+  auto b = makeBinning();
+  auto h = BinnedHistogram::createFromSums(b, Eigen::Vector2d(1.0, 2.0), Eigen::Vector2d(0.5, 2.0));
+  CHECK(h.hist.shifts.cols() == 0);
+  REQUIRE(h.hist.variance.size() == 2);
+  h += BinnedHistogram::createFromSums(b, Eigen::Vector2d(3.0, 1.0), Eigen::Vector2d(1.5, 0.25));
+  CHECK(h.hist.variance(0) == 2.0);
+  CHECK(h.hist.variance(1) == 2.25);
+  CHECK(h.getBinError(1) == 1.5);
+  h *= 2.0;
+  CHECK(h.hist.variance(0) == 8.0);
+  CHECK(std::abs(h.getSumError() - std::sqrt(17.0)) < 1e-12);
+
+  h.hist.clearBin(0);
+  CHECK(h.getBinContent(0) == 0.0);
+  CHECK(h.getBinError(0) == 0.0);
+}
+
+// A systematic band keeps its correlations until it is added to
+TEST_CASE("histogram covariance bands stay correlated") {
+  auto b = makeBinning();
+  auto h = BinnedHistogram::createFromSums(b, Eigen::Vector2d(1.0, 2.0), Eigen::Vector2d(1.0, 1.0));
+  Eigen::MatrixXd cov(2, 2);
+  cov << 3.0, 2.0, 2.0, 3.0;
+  h.addCovariance(CovarianceMatrix(cov));
+  CHECK(h.hist.variance.size() == 0);
+  CHECK(std::abs(h.getBinError(0) - 2.0) < 1e-12);
+  CHECK(std::abs(h.getSumError() - std::sqrt(4.0 + 4.0 + 2 * 2.0)) < 1e-12);
+
+  h.hist.clearErrors();
+  CHECK(h.getBinError(1) == 0.0);
+  CHECK(h.getSumError() == 0.0);
+
+  h.addCovariance(CovarianceMatrix(cov));
+  auto summed = h + makeHist(b, {1.0, 1.0}, {1.0, 0.0});
+  CHECK(std::abs(summed.getBinError(0) - 2.0) < 1e-12);
+  CHECK(std::abs(summed.getSumError() - std::sqrt(7.0)) < 1e-12);
+}
+
+// Plain counts fold under and overflow and convert without a TH1D
+TEST_CASE("histogram counts fill, merge and convert") {
+  auto b = makeBinning();
+  HistogramCounts a(b.getEdges()), c(b.getEdges());
+  a.fill(-1.0, 2.0);
+  a.fill(0.5, 1.0);
+  c.fill(1.5, 3.0);
+  c.fill(7.0, 1.0);
+  a += c;
+  CHECK(a.sumw()(0) == 3.0);
+  CHECK(a.sumw2()(0) == 5.0);
+  CHECK(a.sumw()(1) == 4.0);
+  auto h = BinnedHistogram::createFromCounts(b, a);
+  CHECK(h.getBinContent(1) == 4.0);
+  CHECK(std::abs(h.getBinError(1) - std::sqrt(10.0)) < 1e-12);
+}
+
+// Columns of any arithmetic type are histogrammed, as Histo1D allowed
+TEST_CASE("histogram counts book narrow and vector columns") {
+  ROOT::RDF::RNode df =
+      ROOT::RDataFrame(3)
+          .Define("s", [](ULong64_t e) { return static_cast<short>(e); }, {"rdfentry_"})
+          .Define("c", [](ULong64_t e) { return static_cast<unsigned char>(e + 1); }, {"rdfentry_"})
+          .Define("v", [](ULong64_t e) { return ROOT::RVec<long long>(e, 1); }, {"rdfentry_"})
+          .Define("w", [] { return 2.0; })
+          // A dataset column that the old "_as_double" suffix would have reused
+          .Define("s_as_double", [] { return -1.0; });
+  BinningDefinition b({0.0, 1.0, 2.0}, "s", "s", {});
+  auto by_short = bookHistogramCounts(df, b, "c");
+  auto by_vector = bookHistogramCounts(df, BinningDefinition({0.0, 1.0, 2.0}, "v", "v", {}), "w");
+
+  // s = 0, 1, 2 weighted by c = 1, 2, 3; the overflow folds into the last bin
+  CHECK(by_short->sumw()(0) == 1.0);
+  CHECK(by_short->sumw()(1) == 5.0);
+  CHECK(by_short->sumw2()(1) == 13.0);
+  // v holds e copies of 1
+  CHECK(by_vector->sumw()(0) == 0.0);
+  CHECK(by_vector->sumw()(1) == 6.0);
+
+  auto node = df;
+  const auto widened = widenColumn(node, "s", false);
+  CHECK(widened == "_widened_s");
+  CHECK(isWidenedColumn(widened));
+  CHECK_FALSE(isWidenedColumn("s_as_double"));
+}
@@ -0,0 +1,136 @@
+#include <rarexsec/core/AnalysisResult.h>
+#include <rarexsec/core/AnalysisResultIO.h>
+#include <rarexsec/core/ResultCache.h>
+#include <rarexsec/core/VariableResult.h>
+#include <rarexsec/data/ShardSpec.h>
+#include <rarexsec/hist/BinningDefinition.h>
+#include <rarexsec/syst/UniverseSystematicStrategy.h>
+#include <catch2/catch_test_macros.hpp>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+using namespace analysis;
+
+namespace {
+BinningDefinition makeBinning() { return BinningDefinition({0.0, 1.0, 2.0}, "x", "x", {}); }
+
+BinnedHistogram makeHist(const BinningDefinition &b, std::vector<double> counts, std::vector<double> errors) {
+  Eigen::VectorXd sh = Eigen::Map<Eigen::VectorXd>(errors.data(), errors.size());
+  Eigen::MatrixXd m = sh;
+  return BinnedHistogram(b, counts, m);
+}
+
+VariableResult makePartial(const BinningDefinition &b, double scale) {
+  VariableResult r;
+  r.binning_ = b;
+  r.total_mc_hist_ = makeHist(b, {scale, 2 * scale}, {0.3, 0.4});
+  r.strat_hists_[ChannelKey{"10"}] = makeHist(b, {scale, 2 * scale}, {0.3, 0.4});
+  Eigen::MatrixXd universes(2, 2);
+  universes << scale + 1, 2 * scale - 1, scale - 1, 2 * scale + 1;
+  r.universe_counts_[SystematicKey{"uni"}] = universes;
+  return r;
+}
+
+RegionAnalysis makeRegion(const BinningDefinition &b, double scale) {
+  RegionAnalysis region(RegionKey{"R"}, "region", 5.0, true, "numi_fhc", {"run1"});
+  region.addFinalVariable(VariableKey{"x"}, makePartial(b, scale));
+  RegionAnalysis::StageCount stage;
+  stage.total = scale;
+  stage.total_w2 = scale;
+  stage.schemes["channels"][10] = {scale, scale};
+  region.setCutFlow({stage});
+  return region;
+}
+} // namespace
+
+// Shard blocks partition the items without gaps or overlap
+TEST_CASE("shard blocks cover the range") {
+  std::size_t next = 0;
+  for (unsigned i = 0; i < 3; ++i) {
+    ShardSpec shard{i, 3, 0};
+    auto [first, last] = shard.block(10);
+    CHECK(first == next);
+    next = last;
+  }
+  CHECK(next == 10);
+  CHECK(ShardSpec::parse("2/4").index_ == 2);
+  CHECK(ShardSpec::parse("2/4").count_ == 4);
+}
+
+// Counts add, statistical errors add in quadrature, universes add
+TEST_CASE("variable results merge additively") {
+  auto b = makeBinning();
+  auto merged = makePartial(b, 1.0);
+  merged.merge(makePartial(b, 2.0));
+  CHECK(merged.total_mc_hist_.getBinContent(0) == 3.0);
+  CHECK(merged.total_mc_hist_.getBinContent(1) == 6.0);
+  CHECK(std::abs(merged.total_mc_hist_.getBinError(1) - std::sqrt(0.32)) < 1e-12);
+  CHECK(merged.strat_hists_.at(ChannelKey{"10"}).getBinContent(1) == 6.0);
+  CHECK(merged.universe_counts_.at(SystematicKey{"uni"})(0, 0) == 5.0);
+
+  // The covariance of the merged universes matches a single unsharded fill
+  UniverseSystematicStrategy s(UniverseDef{"uni", "uni_weights", 2});
+  SystematicFutures none;
+  auto cov = s.computeCovariance(merged, none);
+  // deltas are +-2 in both bins, anti-correlated
+  CHECK(std::abs(cov(0, 0) - 4.0) < 1e-12);
+  CHECK(std::abs(cov(0, 1) + 4.0) < 1e-12);
+}
+
+TEST_CASE("analysis results merge by region and round-trip through a file") {
+  auto b = makeBinning();
+  RegionAnalysisMap first{{RegionKey{"R"}, makeRegion(b, 1.0)}};
+  RegionAnalysisMap second{{RegionKey{"R"}, makeRegion(b, 2.0)}};
+  std::vector<AnalysisResult> parts;
+  parts.emplace_back(std::move(first));
+  parts.emplace_back(std::move(second));
+  auto merged = AnalysisResult::merge(std::move(parts));
+
+  const auto dir = std::filesystem::temp_directory_path() / "test_result_merge";
+  std::filesystem::remove_all(dir);
+  std::filesystem::create_directories(dir);
+  const auto path = (dir / "result.rxsr").string();
+  AnalysisResultIO::write(merged, path);
+  auto loaded = AnalysisResultIO::read(path);
+  // The file is written under a temporary name and renamed into place
+  std::vector<std::string> written;
+  for (const auto &entry : std::filesystem::directory_iterator(dir))
+    written.push_back(entry.path().filename().string());
+  CHECK(written == std::vector<std::string>{"result.rxsr"});
+  std::filesystem::remove_all(dir);
+
+  const auto &region = loaded.region(RegionKey{"R"});
+  CHECK(region.protonsOnTarget() == 5.0);
+  CHECK(region.beamConfig() == "numi_fhc");
+  REQUIRE(region.cutFlow().size() == 1);
+  CHECK(region.cutFlow()[0].total == 3.0);
+  CHECK(region.cutFlow()[0].schemes.at("channels").at(10).second == 3.0);
+  const auto &x = loaded.result(RegionKey{"R"}, VariableKey{"x"});
+  CHECK(x.binning_.getEdges() == b.getEdges());
+  CHECK(x.total_mc_hist_.getBinContent(1) == 6.0);
+  CHECK(x.universe_counts_.at(SystematicKey{"uni"})(1, 1) == 8.0);
+}
+
+// Entries are found again under the same inputs only
+TEST_CASE("result cache keys entries by their inputs") {
+  const auto dir = std::filesystem::temp_directory_path() / "test_result_cache";
+  std::filesystem::remove_all(dir);
+  ResultCache cache(ResultCacheConfig{dir.string(), true});
+  REQUIRE(cache.enabled());
+
+  auto b = makeBinning();
+  const auto path = cache.entryPath("R-x-mc", {"sel", "x", "0,1,2"});
+  CHECK(path == cache.entryPath("R-x-mc", {"sel", "x", "0,1,2"}));
+  CHECK(path != cache.entryPath("R-x-mc", {"sel", "x", "0,1,3"}));
+  CHECK_FALSE(cache.load(path));
+
+  cache.store(path, makePartial(b, 2.0));
+  auto loaded = cache.load(path);
+  REQUIRE(loaded);
+  CHECK(loaded->total_mc_hist_.getBinContent(1) == 4.0);
+  CHECK(loaded->universe_counts_.at(SystematicKey{"uni"})(1, 1) == 5.0);
+  std::filesystem::remove_all(dir);
+}
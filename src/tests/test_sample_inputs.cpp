@@ -0,0 +1,94 @@
+#include <rarexsec/data/SampleInputs.h>
+
+#include <catch2/catch_approx.hpp>
+#include <catch2/catch_test_macros.hpp>
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+using namespace analysis;
+
+namespace {
+
+// A directory of empty input files, with a subdirectory whose name also
+// matches the globs below.
+std::filesystem::path writeInputDir() {
+    const auto dir = std::filesystem::temp_directory_path() / "rarexsec_test_inputs";
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir / "run9.root");
+    for (const char *name : {"run2.root", "run1.root", "run10.root", "notes.txt"})
+        std::ofstream(dir / name);
+    return dir;
+}
+
+std::vector<std::string> names(const std::vector<std::string> &paths) {
+    std::vector<std::string> out;
+    for (const auto &path : paths)
+        out.push_back(std::filesystem::path(path).filename().string());
+    return out;
+}
+
+}
+
+TEST_CASE("file name globs match like the shell") {
+    CHECK(SampleInputs::matches("*.root", "run1.root"));
+    CHECK(SampleInputs::matches("*", ""));
+    CHECK(SampleInputs::matches("run*", "run"));
+    CHECK_FALSE(SampleInputs::matches("*.root", "run1.root.bak"));
+    CHECK(SampleInputs::matches("run?.root", "run1.root"));
+    CHECK_FALSE(SampleInputs::matches("run?.root", "run10.root"));
+    CHECK_FALSE(SampleInputs::matches("run?.root", "run.root"));
+    CHECK(SampleInputs::matches("run[0-4].root", "run3.root"));
+    CHECK_FALSE(SampleInputs::matches("run[!0-4].root", "run3.root"));
+    CHECK(SampleInputs::matches("run1.root", "run1.root"));
+    CHECK_FALSE(SampleInputs::matches("run1.root", "run2.root"));
+    CHECK_FALSE(SampleInputs::hasWildcard("run1.root"));
+    CHECK(SampleInputs::hasWildcard("run[12].root"));
+}
+
+TEST_CASE("globs expand to the sorted matching files of a directory") {
+    const auto dir = writeInputDir().string();
+    CHECK(names(SampleInputs::expand(dir, "run?.root")) == std::vector<std::string>{"run1.root", "run2.root"});
+    CHECK(names(SampleInputs::expand(dir, "*.root")) ==
+          std::vector<std::string>{"run1.root", "run10.root", "run2.root"});
+    CHECK(SampleInputs::expand(dir, "none*.root").empty());
+
+    // A path without wildcards is kept whether or not it exists.
+    const auto literal = SampleInputs::expand(dir, "missing.root");
+    REQUIRE(literal.size() == 1);
+    CHECK(literal.front() == (std::filesystem::path(dir) / "missing.root").string());
+    std::filesystem::remove_all(dir);
+}
+
+TEST_CASE("inputs combine globs and listed files with their exposure") {
+    const auto dir = writeInputDir().string();
+    const nlohmann::json j = {{"relative_path", {"run?.root", "notes.txt"}},
+                              {"files",
+                               {{{"path", "run10.root"}, {"pot", 1.5e19}, {"triggers", 100}},
+                                {{"path", "extra.root"}, {"pot", 0.5e19}, {"triggers", 20}}}}};
+
+    const auto files = SampleInputs::resolve(dir, j);
+    std::vector<std::string> paths;
+    for (const auto &file : files)
+        paths.push_back(file.path);
+    CHECK(names(paths) == std::vector<std::string>{"run1.root", "run2.root", "notes.txt", "run10.root", "extra.root"});
+    CHECK(files[0].pot == 0.0);
+    CHECK(files[3].pot == Catch::Approx(1.5e19));
+    CHECK(files[4].triggers == 20);
+
+    const auto [pot, triggers] = SampleInputs::exposure(j);
+    CHECK(pot == Catch::Approx(2.0e19));
+    CHECK(triggers == 120);
+
+    // Sample-level values take precedence over the per-file sums.
+    auto overridden = j;
+    overridden["pot"] = 3.0e19;
+    overridden["triggers"] = 7;
+    CHECK(SampleInputs::exposure(overridden, false).first == Catch::Approx(3.0e19));
+    CHECK(SampleInputs::exposure(overridden, false).second == 7);
+
+    CHECK(SampleInputs::describe(j) == "run?.root,notes.txt,run10.root,extra.root");
+    std::filesystem::remove_all(dir);
+}
@@ -0,0 +1,68 @@
+#include <rarexsec/data/SampleDefinition.h>
+#include <rarexsec/data/ShardSpec.h>
+
+#include "ROOT/RDataFrame.hxx"
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <algorithm>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+using namespace analysis;
+
+namespace {
+
+class PassThrough : public IEventProcessor {
+  public:
+    ROOT::RDF::RNode process(ROOT::RDF::RNode df, SampleOrigin) const override { return df; }
+};
+
+// Event trees with globally numbered "id" branches, in files of uneven size.
+std::vector<std::string> writeInputs(const std::vector<ULong64_t> &sizes) {
+    const auto dir = std::filesystem::temp_directory_path() / "rarexsec_test_sharding";
+    std::filesystem::create_directories(dir);
+    std::vector<std::string> paths;
+    ULong64_t offset = 0;
+    for (std::size_t i = 0; i < sizes.size(); ++i) {
+        const auto path = (dir / ("input_" + std::to_string(i) + ".root")).string();
+        ROOT::RDataFrame(sizes[i])
+            .Define("id", [offset](ULong64_t entry) { return offset + entry; }, {"rdfentry_"})
+            .Snapshot(kEventTreeName, path, {"id"});
+        paths.push_back(path);
+        offset += sizes[i];
+    }
+    return paths;
+}
+
+}
+
+TEST_CASE("entry shards are disjoint and cover every event") {
+    ROOT::EnableImplicitMT(4);
+    const std::vector<ULong64_t> sizes{1000, 37, 2500};
+    const auto paths = writeInputs(sizes);
+    const auto total = countEntries(paths);
+    REQUIRE(total == 3537);
+
+    PassThrough processor;
+    std::vector<ULong64_t> ids;
+    for (unsigned index = 0; index < 5; ++index) {
+        const auto [first, last] = ShardSpec{index, 5, 0}.block(total);
+        auto df = buildBaseDataFrame(paths, processor, SampleOrigin::kData, EntryRange{first, last});
+        const auto shard_ids = *df.Take<ULong64_t>("id");
+        CHECK(shard_ids.size() == last - first);
+        ids.insert(ids.end(), shard_ids.begin(), shard_ids.end());
+    }
+    ROOT::DisableImplicitMT();
+
+    std::sort(ids.begin(), ids.end());
+    REQUIRE(ids.size() == total);
+    for (ULong64_t i = 0; i < total; ++i)
+        REQUIRE(ids[i] == i);
+}
+
+TEST_CASE("input branches are read from the file header") {
+    const auto paths = writeInputs({10});
+    CHECK(treeBranches(paths.front()) == std::vector<std::string>{"id"});
+}
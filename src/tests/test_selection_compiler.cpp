@@ -0,0 +1,61 @@
+#include <rarexsec/core/SelectionCompiler.h>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <string>
+#include <vector>
+
+using namespace analysis;
+
+TEST_CASE("selection compiler shares clauses between regions") {
+    SelectionCompiler compiler;
+    RegionKey quality{"QUALITY_BREAKDOWN"};
+    RegionKey numu{"QUALITY_NUMU_CC_BREAKDOWN"};
+    RegionKey all{"ALL_EVENTS"};
+
+    REQUIRE(compiler.addRegion(quality, {"in_reco_fiducial", "num_slices == 1"}));
+    REQUIRE(compiler.addRegion(numu, {"in_reco_fiducial", " num_slices == 1 ", "has_muon"}));
+    REQUIRE(compiler.addRegion(all, {}));
+
+    REQUIRE(compiler.clauses().size() == 3);
+    REQUIRE(compiler.regionMask(quality) == 0b011);
+    REQUIRE(compiler.regionMask(numu) == 0b111);
+    REQUIRE(compiler.regionMask(all) == 0);
+    REQUIRE(compiler.regionBits(numu) == std::vector<int>{0, 1, 2});
+
+    REQUIRE(compiler.maskExpression() ==
+            "static_cast<ULong64_t>(((in_reco_fiducial) ? (1ULL << 0) : 0ULL) | "
+            "((num_slices == 1) ? (1ULL << 1) : 0ULL) | ((has_muon) ? (1ULL << 2) : 0ULL))");
+}
+
+TEST_CASE("selection compiler stages and N-1 tests read the mask") {
+    const std::vector<int> bits{2, 0, 1};
+    REQUIRE(SelectionCompiler::stageReached(0b000, bits) == 0);
+    REQUIRE(SelectionCompiler::stageReached(0b100, bits) == 1);
+    REQUIRE(SelectionCompiler::stageReached(0b110, bits) == 1);
+    REQUIRE(SelectionCompiler::stageReached(0b101, bits) == 2);
+    REQUIRE(SelectionCompiler::stageReached(0b111, bits) == 3);
+
+    REQUIRE(SelectionCompiler::passesAllBut(0b101, 0b111, 1));
+    REQUIRE_FALSE(SelectionCompiler::passesAllBut(0b101, 0b111, 0));
+}
+
+TEST_CASE("selection compiler leaves regions beyond 64 clauses uncompiled") {
+    SelectionCompiler compiler;
+    std::vector<std::string> clauses;
+    for (int i = 0; i < 64; ++i)
+        clauses.push_back("x > " + std::to_string(i));
+    REQUIRE(compiler.addRegion(RegionKey{"A"}, clauses));
+    REQUIRE_FALSE(compiler.addRegion(RegionKey{"B"}, {"y > 0"}));
+    REQUIRE_FALSE(compiler.compiled(RegionKey{"B"}));
+    REQUIRE(compiler.addRegion(RegionKey{"C"}, {"x > 3"}));
+}
+
+TEST_CASE("selection compiler keeps guarded clauses on the filter path") {
+    SelectionCompiler compiler;
+    REQUIRE_FALSE(compiler.addRegion(RegionKey{"A"}, {"n_tracks > 0", "track_length[0] > 10"}));
+    REQUIRE_FALSE(compiler.addRegion(RegionKey{"B"}, {"n_hits > 0", "n_pe / n_hits > 2"}));
+    REQUIRE_FALSE(compiler.compiled(RegionKey{"A"}));
+    REQUIRE(compiler.clauses().empty());
+    REQUIRE(compiler.addRegion(RegionKey{"C"}, {"n_tracks > 0", "n_hits >= 3 && !is_cosmic"}));
+}
@@ -1,4 +1,5 @@
 #include <rarexsec/hist/BinningDefinition.h>
+#include <rarexsec/syst/CovarianceAccumulator.h>
 #include <rarexsec/syst/DetectorSystematicStrategy.h>
 #include <rarexsec/syst/SystematicsProcessor.h>
 #include <rarexsec/syst/UniverseSystematicStrategy.h>
@@ -40,10 +41,10 @@ bool psd(const Eigen::MatrixXd &m) {
   Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> es(m);
   return (es.eigenvalues().array() >= -1e-12).all();
 }
-Eigen::MatrixXd toEigen(const TMatrixDSym &m) {
-  Eigen::MatrixXd out(m.GetNrows(), m.GetNcols());
-  for (int i = 0; i < m.GetNrows(); ++i)
-    for (int j = 0; j < m.GetNcols(); ++j)
+Eigen::MatrixXd toEigen(const CovarianceMatrix &m) {
+  Eigen::MatrixXd out(m.size(), m.size());
+  for (int i = 0; i < m.size(); ++i)
+    for (int j = 0; j < m.size(); ++j)
       out(i, j) = m(i, j);
   return out;
 }
@@ -143,6 +144,51 @@ TEST_CASE("universe systematic strategy covariance") {
   CHECK(psd(toEigen(cov)));
 }
 
+// Weight vectors shorter than configured: only the filled universes count
+TEST_CASE("universe systematic strategy normalises by filled universes") {
+  auto b = makeBinning();
+  std::vector<double> x{0.5, 1.5};
+  std::vector<ROOT::RVec<float>> u{ROOT::RVec<float>{2, 0},
+                                   ROOT::RVec<float>{0, 2}};
+  ROOT::RDataFrame df(x.size());
+  ROOT::RDF::RNode rnode =
+      df.Define("x", [&x](ULong64_t i) { return x[i]; }, {"rdfentry_"})
+          .Define("uni_weights", [&u](ULong64_t i) { return u[i]; },
+                  {"rdfentry_"});
+  UniverseSystematicStrategy s(UniverseDef{"uni", "uni_weights", 4});
+  SystematicFutures f;
+  SampleKey sk(std::string{"s"});
+  s.bookVariations(sk, rnode, b, b.toTH1DModel(), f);
+  auto r = makeResult(b);
+  auto cov = s.computeCovariance(r, f);
+  Eigen::MatrixXd exp =
+      covMatrix({Eigen::Vector2d(1, -1), Eigen::Vector2d(-1, 1)});
+  CHECK((toEigen(cov) - exp).norm() < 1e-6);
+}
+
+// All universes are filled by one booked action per sample
+TEST_CASE("universe systematic strategy books a single action") {
+  auto b = makeBinning();
+  std::vector<double> x{-1.0, 0.5, 1.5, 5.0};
+  std::vector<ROOT::RVec<unsigned short>> u(
+      x.size(), ROOT::RVec<unsigned short>{1, 1, 1});
+  ROOT::RDataFrame df(x.size());
+  ROOT::RDF::RNode rnode =
+      df.Define("x", [&x](ULong64_t i) { return x[i]; }, {"rdfentry_"})
+          .Define("uni_weights", [&u](ULong64_t i) { return u[i]; },
+                  {"rdfentry_"});
+  UniverseSystematicStrategy s(UniverseDef{"uni", "uni_weights", 3});
+  SystematicFutures f;
+  SampleKey sk(std::string{"s"});
+  s.bookVariations(sk, rnode, b, b.toTH1DModel(), f);
+  CHECK(f.variations.empty());
+  REQUIRE(f.universes.size() == 1);
+  auto &fill = f.universes.at(SystematicKey(std::string{"uni"})).at(sk);
+  // under- and overflow are folded into the edge bins
+  Eigen::MatrixXd exp = Eigen::MatrixXd::Constant(3, 2, 2.0);
+  CHECK((*fill - exp).norm() < 1e-12);
+}
+
 // Ensure that float-based weight vectors are handled correctly.
 TEST_CASE("universe systematic strategy covariance (float weights)") {
   auto b = makeBinning();
@@ -209,3 +255,40 @@ TEST_CASE("detector systematic strategy covariance") {
   CHECK((toEigen(cov) - exp).norm() < 1e-6);
   CHECK(psd(toEigen(cov)));
 }
+
+// Rank-update accumulation agrees with the dense product in every mode
+TEST_CASE("covariance accumulator modes agree") {
+  const Eigen::MatrixXd deltas = Eigen::MatrixXd::Random(300, 12);
+  const Eigen::MatrixXd exp = deltas.transpose() * deltas / 300.0;
+  for (bool single : {false, true}) {
+    for (bool parallel : {false, true}) {
+      CovarianceOptions options;
+      options.single_precision = single;
+      options.parallel = parallel;
+      options.block_rows = 32;
+      auto cov = CovarianceAccumulator::compute(deltas, 1.0 / 300.0, options);
+      CHECK((cov - exp).norm() < (single ? 1e-5 : 1e-12) * exp.norm());
+      CHECK(toEigen(CovarianceMatrix(cov)) == cov);
+    }
+  }
+}
+
+// Packed storage round-trips, and the cached factors describe the matrix
+TEST_CASE("covariance matrix packed storage") {
+  const Eigen::MatrixXd a = Eigen::MatrixXd::Random(6, 4);
+  const Eigen::MatrixXd dense =
+      a * a.transpose() + Eigen::MatrixXd::Identity(6, 6);
+  CovarianceMatrix cov(dense);
+  CHECK(cov.packed().size() == 21);
+  CHECK(cov.dense() == dense);
+  CHECK((cov.cholesky() * cov.cholesky().transpose() - dense).norm() < 1e-10);
+  const auto corr = cov.correlation();
+  for (int i = 0; i < 6; ++i) {
+    CHECK(std::abs(corr(i, i) - 1.0) < 1e-12);
+    CHECK(std::abs(cov.error(i) - std::sqrt(dense(i, i))) < 1e-12);
+  }
+  CHECK(std::abs(corr(4, 1) - dense(4, 1) / std::sqrt(dense(4, 4) * dense(1, 1))) < 1e-12);
+  const auto root = cov.toTMatrixDSym();
+  CHECK(root(1, 4) == dense(1, 4));
+  CHECK((toEigen(CovarianceMatrix::fromTMatrixDSym(root)) - dense).norm() == 0.0);
+}